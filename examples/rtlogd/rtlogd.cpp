@@ -0,0 +1,150 @@
+// rtlogd: collects the logs of every process on the host that logs with rtlog::SharedLogger into one stream.
+//
+// usage: rtlogd [--dir DIR] [--binary BASE] [--merge-delay-ms N]
+//
+// Rings are looked for in DIR (/dev/shm by default). Records are printed to stdout as
+// "<sequence number> L<level> R<region> T<thread id> <time logged> <process name>[<pid>] <message>", coloured by level
+// on a terminal, or, with --binary, written to the binary log BASE (see rtlog::BinaryLogSink and rtlog-read). Stop it
+// with SIGINT or SIGTERM; it drains all rings first.
+
+#include <rtlog/BinaryLog.h>
+#include <rtlog/ConsoleSink.h>
+#include <rtlog/SharedLogCollector.h>
+#include <rtlog/TimestampFormatter.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+std::atomic<bool> gRunning{ true };
+
+constexpr auto kRescanInterval = std::chrono::milliseconds( 200 );
+constexpr auto kIdleWait       = std::chrono::milliseconds( 5 );
+
+void Stop( int )
+{
+    gRunning = false;
+}
+
+void PrintUsage()
+{
+    std::fprintf( stderr, "usage: rtlogd [--dir DIR] [--binary BASE] [--merge-delay-ms N]\n" );
+}
+
+// Prints records with a ConsoleSink, which writes each drained batch with one write, with the producer's time and
+// process put in front of the message
+class TextSink
+{
+public:
+    void operator()( const rtlog::LogRecord<rtlog::SharedLogData>& record )
+    {
+        auto length = mTimestamps.Format( record.mLogData.timestamp, mMessage.data() );
+        length += static_cast<size_t>( std::max( std::snprintf( mMessage.data() + length,
+                                                                mMessage.size() - length,
+                                                                " %s[%u] ",
+                                                                record.mLogData.processName,
+                                                                record.mLogData.processId ),
+                                                 0 ) );
+        length = std::min( length, mMessage.size() - 1 );
+
+        const auto messageLength = std::min( record.mMessageLength, mMessage.size() - 1 - length );
+        std::memcpy( mMessage.data() + length, record.mMessage, messageLength );
+        length += messageLength;
+        mMessage[length] = '\0';
+
+        auto prefixed           = record;
+        prefixed.mMessage       = mMessage.data();
+        prefixed.mMessageLength = length;
+        mConsole( prefixed );
+    }
+
+    void Flush()
+    {
+        mConsole.Flush();
+    }
+
+private:
+    // Time, process name and id, and the spaces around them
+    static constexpr size_t kPrefixBytes  = rtlog::TimestampFormatter::kMaxBytes + rtlog::kSharedLogMaxNameLength + 16;
+    static constexpr size_t kMessageBytes = kPrefixBytes + rtlog::kDefaultSharedLogMaxMessageLength + 1;
+
+    rtlog::TimestampFormatter                mTimestamps{};
+    rtlog::ConsoleSink<rtlog::SharedLogData> mConsole{};
+    std::array<char, kMessageBytes>          mMessage{};
+};
+
+template <typename SinkType>
+void Run( rtlog::SharedLogCollector<>& collector, SinkType& sink )
+{
+    auto lastRescan = std::chrono::steady_clock::time_point{};
+    while ( gRunning ) {
+        const auto now = std::chrono::steady_clock::now();
+        if ( now - lastRescan >= kRescanInterval ) {
+            collector.Rescan();
+            lastRescan = now;
+        }
+
+        const auto numDrained = collector.Drain( sink );
+        sink.Flush();
+        if ( numDrained == 0 ) {
+            std::this_thread::sleep_for( kIdleWait );
+        }
+    }
+
+    collector.Drain( sink, true );
+    sink.Flush();
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+    std::string                      directory = "/dev/shm";
+    std::string                      binaryBasePath;
+    rtlog::SharedLogCollectorOptions options;
+
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if ( argument == "--dir" && i + 1 < argc ) {
+            directory = argv[++i];
+        }
+        else if ( argument == "--binary" && i + 1 < argc ) {
+            binaryBasePath = argv[++i];
+        }
+        else if ( argument == "--merge-delay-ms" && i + 1 < argc ) {
+            options.mMergeDelay = std::chrono::milliseconds( std::strtoll( argv[++i], nullptr, 10 ) );
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::signal( SIGINT, Stop );
+    std::signal( SIGTERM, Stop );
+
+    rtlog::SharedLogCollector<> collector( directory, options );
+    if ( binaryBasePath.empty() ) {
+        TextSink sink;
+        Run( collector, sink );
+    }
+    else {
+        rtlog::BinaryLogSink<rtlog::SharedLogData> sink( binaryBasePath );
+        Run( collector, sink );
+        if ( sink.NumWriteErrors() > 0 ) {
+            std::fprintf( stderr, "rtlogd: could not write all records to %s\n", binaryBasePath.c_str() );
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+
+namespace rtlog
+{
+
+/**
+ * @brief A print log function that holds back low level messages, and only prints them if something goes wrong.
+ *
+ * Pass this to PrintAndClearLogQueue (or a LogProcessingThread) in place of your own print log function. Messages
+ * below bufferBelowLevel are not printed; instead the last NumRecordsPerThread of them are kept per producer thread,
+ * overwriting the oldest. When a message at or above flushAtLevel comes through, the messages held for its thread are
+ * printed first, oldest first, followed by the message itself. Everything else is printed straight away.
+ *
+ * This gives you the debug context leading up to a warning without paying to write out all debug traffic. Levels are
+ * read with LogDataTraits.
+ *
+ * All memory is allocated on construction. Lives entirely on the consumer thread.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ * @tparam PrintLogFn The print log function messages are eventually printed with.
+ * @tparam MaxMessageLength The MaxMessageLength of the logger this is used with.
+ * @tparam NumRecordsPerThread How many held back messages to keep for each thread.
+ * @tparam MaxNumThreads The number of producer threads to keep messages for. Threads are mapped onto these slots by
+ * their CurrentThreadId; if two threads share a slot, the newer one takes it over.
+ */
+template <typename LogData,
+          typename PrintLogFn,
+          size_t MaxMessageLength,
+          size_t NumRecordsPerThread = 64,
+          size_t MaxNumThreads       = 32>
+class BacktraceBuffer
+{
+public:
+    /**
+     * @param printLogFn The print log function messages are eventually printed with.
+     * @param bufferBelowLevel Messages with a level below this are held back.
+     * @param flushAtLevel Messages with at least this level print the held back messages of their thread first.
+     */
+    BacktraceBuffer( PrintLogFn& printLogFn, int bufferBelowLevel, int flushAtLevel )
+    : mPrintLogFn( printLogFn )
+    , mBufferBelowLevel( bufferBelowLevel )
+    , mFlushAtLevel( flushAtLevel )
+    , mThreads( MaxNumThreads )
+    {
+    }
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        const auto level = LogDataTraits<LogData>::Level( record.mLogData );
+
+        if ( level < mBufferBelowLevel ) {
+            Hold( record );
+            return;
+        }
+
+        if ( level >= mFlushAtLevel ) {
+            PrintHeld( ThreadFor( record.mThreadId ) );
+        }
+
+        PrintLogRecord( mPrintLogFn, record );
+    }
+
+    /**
+     * @brief Prints every held back message, thread by thread.
+     */
+    void FlushAll()
+    {
+        for ( auto& thread : mThreads ) {
+            PrintHeld( thread );
+        }
+    }
+
+    /**
+     * @brief Flushes the print log function messages are printed with, if it has a Flush(), as buffering sinks do.
+     * Held back messages stay held back.
+     *
+     * LogProcessingThread calls this after each batch, as it would on the print log function itself.
+     */
+    void Flush()
+    {
+        if constexpr ( detail::HasFlush<PrintLogFn>::value ) {
+            mPrintLogFn.Flush();
+        }
+    }
+
+    /**
+     * @brief Returns the number of held back messages that were overwritten without ever being printed.
+     */
+    size_t NumDiscarded() const
+    {
+        return mNumDiscarded;
+    }
+
+private:
+    struct HeldRecord
+    {
+        LogData                            mLogData{};
+        size_t                             mSequenceNumber{};
+        size_t                             mMessageLength{};
+        std::array<char, MaxMessageLength> mMessage{};
+    };
+
+    struct ThreadRecords
+    {
+        std::uint32_t                                mThreadId{};
+        size_t                                       mFirst{};
+        size_t                                       mCount{};
+        std::array<HeldRecord, NumRecordsPerThread> mRecords{};
+    };
+
+    ThreadRecords& ThreadFor( std::uint32_t threadId )
+    {
+        auto& thread = mThreads[threadId % MaxNumThreads];
+        if ( thread.mThreadId != threadId ) {
+            mNumDiscarded += thread.mCount;
+            thread.mThreadId = threadId;
+            thread.mFirst    = 0;
+            thread.mCount    = 0;
+        }
+        return thread;
+    }
+
+    void Hold( const LogRecord<LogData>& record )
+    {
+        auto& thread = ThreadFor( record.mThreadId );
+
+        if ( thread.mCount == NumRecordsPerThread ) {
+            thread.mFirst = ( thread.mFirst + 1 ) % NumRecordsPerThread;
+            thread.mCount--;
+            mNumDiscarded++;
+        }
+
+        auto& held           = thread.mRecords[( thread.mFirst + thread.mCount ) % NumRecordsPerThread];
+        held.mLogData        = record.mLogData;
+        held.mSequenceNumber = record.mSequenceNumber;
+        held.mMessageLength  = std::min( record.mMessageLength, MaxMessageLength - 1 );
+        std::memcpy( held.mMessage.data(), record.mMessage, held.mMessageLength );
+        held.mMessage[held.mMessageLength] = '\0';
+        thread.mCount++;
+    }
+
+    void PrintHeld( ThreadRecords& thread )
+    {
+        for ( size_t i = 0; i < thread.mCount; i++ ) {
+            const auto&              held = thread.mRecords[( thread.mFirst + i ) % NumRecordsPerThread];
+            const LogRecord<LogData> record{
+                held.mLogData, held.mSequenceNumber, held.mMessage.data(), held.mMessageLength, thread.mThreadId };
+            PrintLogRecord( mPrintLogFn, record );
+        }
+        thread.mFirst = 0;
+        thread.mCount = 0;
+    }
+
+    PrintLogFn&                mPrintLogFn;
+    int                        mBufferBelowLevel{};
+    int                        mFlushAtLevel{};
+    std::vector<ThreadRecords> mThreads{};
+    size_t                     mNumDiscarded{};
+};
+
+} // namespace rtlog
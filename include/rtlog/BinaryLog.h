@@ -0,0 +1,951 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Crc32c.h"
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+
+namespace rtlog
+{
+
+/*
+ * The binary log format.
+ *
+ * A log is a series of segment files, each with a sparse index next to it:
+ *
+ *   segment: BinaryLogFileHeader, then blocks, then, once the segment is complete, a bloom filter and BinaryLogFooter
+ *   block:   BinaryLogBlockHeader, starting with kBinaryLogSyncMarker, then mNumRecords records
+ *   record:  BinaryLogRecordHeader as varints (see EncodeBinaryLogRecordHeader), then the LogData, packed with
+ *            LogDataTraits if it has Pack, then the message (not null terminated)
+ *   index:   BinaryLogFileHeader (with the index magic), then one BinaryLogIndexEntry per block
+ *
+ * All integers are little endian, as written by the machine that wrote the log. Structures are packed without padding
+ * and may be unaligned in the file, so read them with memcpy.
+ *
+ * Every block starts with the same sync marker, so a reader dropped at any offset in a segment can find the next
+ * block by searching for it. That lets a segment be split between threads, and reading carry on past damage. Blocks
+ * carry a CRC32C, so damage, such as the garbage a crash in the middle of a write leaves behind, is also recognized.
+ *
+ * The bloom filter holds every level, region, thread id and message token (see BinaryLogBloomFilter) in the segment,
+ * so a search can rule out a whole segment by reading its last few pages.
+ */
+
+constexpr char          kBinaryLogMagic[8]       = { 'R', 'T', 'L', 'O', 'G', 'B', 'I', 'N' };
+constexpr char          kBinaryLogIndexMagic[8]  = { 'R', 'T', 'L', 'O', 'G', 'I', 'D', 'X' };
+constexpr char          kBinaryLogFooterMagic[8] = { 'R', 'T', 'L', 'O', 'G', 'F', 'T', 'R' };
+constexpr std::uint32_t kBinaryLogVersion        = 4;
+
+constexpr unsigned char kBinaryLogSyncMarker[16] = { 0xf3, 0x52, 0x54, 0x4c, 0x9e, 0x0b, 0x53, 0x59,
+                                                      0x4e, 0xc7, 0x21, 0x8d, 0x42, 0x4c, 0x4b, 0x5a };
+
+struct BinaryLogFileHeader
+{
+    char          mMagic[8]{};
+    std::uint32_t mVersion{};
+    std::uint32_t mLogDataBytes{}; // sizeof( LogData ) of the sink that wrote the log; unused in index files
+};
+
+struct BinaryLogBlockHeader
+{
+    unsigned char mSyncMarker[16]{};
+    std::uint32_t mBlockBytes{}; // including this header
+    std::uint32_t mNumRecords{};
+    std::uint64_t mFirstSequenceNumber{};
+    std::int64_t  mFirstTimestamp{}; // nanoseconds since the epoch
+    std::uint32_t mCrc32c{};         // of the whole block except this field and mReserved, see BinaryLogBlockCrc
+    std::uint32_t mReserved{};
+};
+
+// Not stored as is, see EncodeBinaryLogRecordHeader
+struct BinaryLogRecordHeader
+{
+    std::uint64_t mSequenceNumber{};
+    std::int64_t  mTimestamp{}; // nanoseconds since the epoch, taken when the record was written
+    std::int32_t  mLevel{};     // see LogDataTraits
+    std::int32_t  mRegion{};    // see LogDataTraits
+    std::uint32_t mThreadId{};  // see CurrentThreadId
+    std::uint32_t mLogDataBytes{};
+    std::uint32_t mMessageLength{};
+};
+
+struct BinaryLogIndexEntry
+{
+    std::uint64_t mOffset{}; // of the block in the segment file
+    std::uint64_t mSequenceNumber{};
+    std::int64_t  mTimestamp{};
+};
+
+struct BinaryLogFooter
+{
+    std::uint32_t mFilterBytes{}; // the bloom filter comes right before the footer
+    std::uint32_t mNumHashes{};
+    char          mMagic[8]{};    // last, so that it ends the file
+};
+
+static_assert( sizeof( BinaryLogFileHeader ) == 16 && sizeof( BinaryLogBlockHeader ) == 48
+                   && sizeof( BinaryLogIndexEntry ) == 24
+                   && sizeof( BinaryLogFooter ) == 16,
+               "The binary log structures must not have padding" );
+
+/**
+ * @brief Returns the CRC32C of a block: everything from its header up to mCrc32c, then everything after the header.
+ */
+inline std::uint32_t BinaryLogBlockCrc( const char* block, size_t blockBytes )
+{
+    const auto crc = Crc32c( block, offsetof( BinaryLogBlockHeader, mCrc32c ) );
+    return Crc32c( block + sizeof( BinaryLogBlockHeader ), blockBytes - sizeof( BinaryLogBlockHeader ), crc );
+}
+
+namespace detail
+{
+
+inline unsigned char* WriteVarint( std::uint64_t value, unsigned char* out )
+{
+    for ( ; value >= 0x80; value >>= 7 ) {
+        *out++ = static_cast<unsigned char>( value | 0x80 );
+    }
+    *out++ = static_cast<unsigned char>( value );
+    return out;
+}
+
+// Returns nullptr if the varint runs past end or is longer than 10 bytes
+inline const unsigned char* ReadVarint( const unsigned char* in, const unsigned char* end, std::uint64_t& value )
+{
+    value = 0;
+    for ( int shift = 0; in < end && shift < 64; shift += 7 ) {
+        const auto byte = *in++;
+        value |= static_cast<std::uint64_t>( byte & 0x7f ) << shift;
+        if ( ( byte & 0x80 ) == 0 ) {
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+// Maps small negative numbers to small varints: 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+inline std::uint64_t ZigZag( std::int64_t value )
+{
+    return ( static_cast<std::uint64_t>( value ) << 1 ) ^ static_cast<std::uint64_t>( value >> 63 );
+}
+
+inline std::int64_t UnZigZag( std::uint64_t value )
+{
+    return static_cast<std::int64_t>( value >> 1 ) ^ -static_cast<std::int64_t>( value & 1 );
+}
+
+} // namespace detail
+
+constexpr size_t kMaxEncodedBinaryLogRecordHeaderBytes = 2 * 10 + 5 * 5;
+
+/**
+ * @brief Writes header to out as a series of varints and returns the end of what was written.
+ *
+ * The sequence number and timestamp are stored as deltas from the previous record of the block, or from the block
+ * header for the first one, and signed fields are zigzag encoded, so a typical record header takes 8 to 10 bytes.
+ *
+ * @param out Room for kMaxEncodedBinaryLogRecordHeaderBytes bytes.
+ */
+inline unsigned char* EncodeBinaryLogRecordHeader( const BinaryLogRecordHeader& header,
+                                                   const BinaryLogRecordHeader& previous,
+                                                   unsigned char*               out )
+{
+    out = detail::WriteVarint( header.mSequenceNumber - previous.mSequenceNumber, out );
+    out = detail::WriteVarint( detail::ZigZag( header.mTimestamp - previous.mTimestamp ), out );
+    out = detail::WriteVarint( detail::ZigZag( header.mLevel ), out );
+    out = detail::WriteVarint( detail::ZigZag( header.mRegion ), out );
+    out = detail::WriteVarint( header.mThreadId, out );
+    out = detail::WriteVarint( header.mLogDataBytes, out );
+    return detail::WriteVarint( header.mMessageLength, out );
+}
+
+/**
+ * @brief Reads what EncodeBinaryLogRecordHeader wrote, returning the end of it, or nullptr if it runs past end.
+ */
+inline const unsigned char* DecodeBinaryLogRecordHeader( const unsigned char*         in,
+                                                         const unsigned char*         end,
+                                                         const BinaryLogRecordHeader& previous,
+                                                         BinaryLogRecordHeader&       header )
+{
+    std::uint64_t fields[7];
+    for ( auto& field : fields ) {
+        in = in == nullptr ? nullptr : detail::ReadVarint( in, end, field );
+    }
+    if ( in == nullptr ) {
+        return nullptr;
+    }
+    header.mSequenceNumber = previous.mSequenceNumber + fields[0];
+    header.mTimestamp      = previous.mTimestamp + detail::UnZigZag( fields[1] );
+    header.mLevel          = static_cast<std::int32_t>( detail::UnZigZag( fields[2] ) );
+    header.mRegion         = static_cast<std::int32_t>( detail::UnZigZag( fields[3] ) );
+    header.mThreadId       = static_cast<std::uint32_t>( fields[4] );
+    header.mLogDataBytes   = static_cast<std::uint32_t>( fields[5] );
+    header.mMessageLength  = static_cast<std::uint32_t>( fields[6] );
+    return in;
+}
+
+/**
+ * @brief What a key in a BinaryLogBloomFilter stands for, so that e.g. level 3 and region 3 are different keys.
+ */
+enum class BinaryLogKey : unsigned char
+{
+    Level,
+    Region,
+    ThreadId,
+    Token,
+};
+
+/**
+ * @brief A bloom filter over the keys of a binary log segment.
+ *
+ * Tokens are the runs of at least kMinTokenLength letters, digits and underscores in a message, so "buffer underrun on
+ * bus 12" has the tokens "buffer", "underrun" and "bus". MayContain never returns false for a key that was inserted,
+ * and returns true for one that wasn't with a probability that grows with the number of distinct keys per filter byte.
+ */
+class BinaryLogBloomFilter
+{
+public:
+    static constexpr size_t kMinTokenLength = 3;
+
+    BinaryLogBloomFilter() = default;
+
+    BinaryLogBloomFilter( size_t numBytes, std::uint32_t numHashes )
+    : mBits( numBytes, 0 )
+    , mNumHashes( numHashes )
+    {
+    }
+
+    static std::uint64_t Hash( BinaryLogKey key, const void* data, size_t numBytes )
+    {
+        // FNV-1a, then a murmur style finalizer to spread the bits for double hashing
+        std::uint64_t hash  = ( 14695981039346656037ull ^ static_cast<std::uint64_t>( key ) ) * 1099511628211ull;
+        const auto*   bytes = static_cast<const unsigned char*>( data );
+        for ( size_t i = 0; i < numBytes; i++ ) {
+            hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static std::uint64_t Hash( BinaryLogKey key, std::int64_t value )
+    {
+        return Hash( key, &value, sizeof( value ) );
+    }
+
+    /**
+     * @brief Calls fn( const char* token, size_t length ) for each token of text.
+     */
+    template <typename TokenFn>
+    static void ForEachToken( const char* text, size_t length, TokenFn&& fn )
+    {
+        size_t start = 0;
+        for ( size_t i = 0; i <= length; i++ ) {
+            if ( i < length && IsTokenCharacter( text[i] ) ) {
+                continue;
+            }
+            if ( i - start >= kMinTokenLength ) {
+                fn( text + start, i - start );
+            }
+            start = i + 1;
+        }
+    }
+
+    static bool IsTokenCharacter( char c )
+    {
+        return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '_';
+    }
+
+    void Insert( std::uint64_t hash )
+    {
+        ForEachBit( mBits.size(), mNumHashes, hash, [this]( size_t bit ) {
+            mBits[bit / 8] |= static_cast<unsigned char>( 1u << ( bit % 8 ) );
+            return true;
+        } );
+    }
+
+    bool MayContain( std::uint64_t hash ) const
+    {
+        return MayContain( mBits.data(), mBits.size(), mNumHashes, hash );
+    }
+
+    /**
+     * @brief Tests a hash against the bits of a filter that was written out, without copying them.
+     */
+    static bool MayContain( const void* bits, size_t numBytes, std::uint32_t numHashes, std::uint64_t hash )
+    {
+        const auto* bytes = static_cast<const unsigned char*>( bits );
+        return ForEachBit( numBytes, numHashes, hash, [bytes]( size_t bit ) {
+            return ( bytes[bit / 8] & ( 1u << ( bit % 8 ) ) ) != 0;
+        } );
+    }
+
+    void Clear()
+    {
+        std::fill( mBits.begin(), mBits.end(), 0 );
+    }
+
+    const unsigned char* Bits() const
+    {
+        return mBits.data();
+    }
+
+    size_t NumBytes() const
+    {
+        return mBits.size();
+    }
+
+    std::uint32_t NumHashes() const
+    {
+        return mNumHashes;
+    }
+
+private:
+    // Double hashing: bit i is h1 + i * h2, which is as good as independent hashes for a bloom filter
+    template <typename BitFn>
+    static bool ForEachBit( size_t numBytes, std::uint32_t numHashes, std::uint64_t hash, BitFn&& fn )
+    {
+        const auto numBits = numBytes * 8;
+        if ( numBits == 0 ) {
+            return true;
+        }
+        const auto h1 = hash & 0xffffffffu;
+        const auto h2 = ( hash >> 32 ) | 1;
+        for ( std::uint32_t i = 0; i < numHashes; i++ ) {
+            if ( !fn( static_cast<size_t>( ( h1 + i * h2 ) % numBits ) ) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<unsigned char> mBits{};
+    std::uint32_t              mNumHashes{};
+};
+
+/**
+ * @brief Returns the path of the segment with the given number, for a log written to basePath.
+ */
+inline std::string BinaryLogSegmentPath( const std::string& basePath, size_t segmentNumber )
+{
+    char suffix[32];
+    std::snprintf( suffix, sizeof( suffix ), ".%06zu.rtlog", segmentNumber );
+    return basePath + suffix;
+}
+
+/**
+ * @brief Returns the path of the sparse index that goes with a segment.
+ */
+inline std::string BinaryLogIndexPath( const std::string& segmentPath )
+{
+    const auto extension = segmentPath.rfind( ".rtlog" );
+    return ( extension == std::string::npos ? segmentPath : segmentPath.substr( 0, extension ) ) + ".rtidx";
+}
+
+struct BinaryLogSinkOptions
+{
+    size_t mRecordsPerBlock   = 256;               // also how sparse the index is
+    size_t mMaxBlockBytes     = 64 * 1024;         // a block is written out once it would grow past this
+    size_t mMaxSegmentBytes   = 256 * 1024 * 1024; // a new segment is started once a segment would grow past this
+    size_t mBloomFilterBytes  = 128 * 1024;        // of each segment's bloom filter; 0 leaves the filter out
+    size_t mBloomFilterHashes = 4;
+
+    bool mDirectIo = false; // write segments with O_DIRECT, see BinaryLogSink
+
+    int                       mDurableMinLevel = INT_MAX; // records with at least this level are made durable
+    std::chrono::microseconds mGroupCommitWindow{ 2000 }; // the least time between two commits
+
+    // Called on the thread that writes the log after each commit, with the new BinaryLogSink::DurableSequenceNumber
+    std::function<void( std::uint64_t )> mOnDurable{};
+};
+
+/**
+ * @brief A print log function that writes messages to a compact, seekable binary log.
+ *
+ * NOT REALTIME SAFE - use it on the thread that processes the log queue, e.g. with a LogProcessingThread.
+ *
+ * Each message is stamped with the time it is written, its level and region (read with LogDataTraits), the id of the
+ * thread that logged it, and its LogData, packed with LogDataTraits::Pack if there is one and copied as raw bytes
+ * otherwise, so it must be trivially copyable. The header of a record is varint and delta encoded, so a record costs
+ * about 10 bytes plus its LogData and message. Records are gathered into blocks, and each block is written with a
+ * single write once it is full. Next to every segment goes a sparse index with one entry per block, which
+ * BinaryLogReader uses to jump to a sequence number or a time with a binary search.
+ * When a segment is complete, a bloom filter of its levels, regions, thread ids and message tokens is appended to it.
+ *
+ * Call Flush after each PrintAndClearLogQueue, or whenever messages should reach the file before the block is full.
+ * LogProcessingThread does that by itself.
+ *
+ * With mDirectIo, segments are written with O_DIRECT, so the log doesn't fill the page cache and push out data the rest
+ * of the process needs. Writes then go through an aligned buffer and always cover whole kDirectIoAlignment pages: the
+ * last, partly filled page is padded with zeros and written again with more data next time, and the padding is cut off
+ * when the segment is closed. Readers skip over the padding of a segment that is still being written. Where the file
+ * system refuses O_DIRECT, at open or at the first write, the sink falls back to buffered writes.
+ *
+ * Records with a level of at least mDurableMinLevel are durable: they are committed to disk with fdatasync. Commits
+ * are grouped, so that however many durable records arrive, there is at most one per mGroupCommitWindow, each covering
+ * everything written so far. A durable record is committed by the first Flush after it is written once the window since
+ * the previous commit has passed. Non real-time threads that need to know when their record is on disk can wait for it
+ * with WaitUntilDurable, or be told through mOnDurable. A failed commit is tried again by the next Flush, and a segment
+ * whose commit fails as it is closed is kept open until a later commit has synced it too.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ */
+template <typename LogData>
+class BinaryLogSink
+{
+    static_assert( std::is_trivially_copyable<LogData>::value, "BinaryLogSink writes LogData as raw bytes" );
+
+public:
+    static constexpr size_t kDirectIoAlignment = 4096; // a multiple of the logical block size of common devices
+
+    /**
+     * @param basePath Where to write the log. Segments are named basePath.000000.rtlog, basePath.000001.rtlog, ...
+     * @param options Block and segment sizes.
+     */
+    explicit BinaryLogSink( std::string basePath, const BinaryLogSinkOptions& options = {} )
+    : mBasePath( std::move( basePath ) )
+    , mOptions( options )
+    , mFilter( options.mBloomFilterBytes, static_cast<std::uint32_t>( options.mBloomFilterHashes ) )
+    {
+        mBlock.reserve( mOptions.mMaxBlockBytes );
+        StartBlock();
+    }
+
+    ~BinaryLogSink()
+    {
+        Flush();
+        CloseSegment();
+        for ( const int fd : mUnsyncedSegmentFds ) {
+            ::close( fd );
+        }
+    }
+
+    BinaryLogSink( const BinaryLogSink& )            = delete;
+    BinaryLogSink& operator=( const BinaryLogSink& ) = delete;
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        unsigned char packedLogData[sizeof( LogData )];
+        const auto    packedLogDataBytes = detail::PackLogData( record.mLogData, packedLogData );
+
+        const auto maxRecordBytes = kMaxEncodedBinaryLogRecordHeaderBytes + packedLogDataBytes + record.mMessageLength;
+        const bool blockIsFull    = mNumBlockRecords == mOptions.mRecordsPerBlock
+                              || mBlock.size() + maxRecordBytes > mOptions.mMaxBlockBytes;
+        if ( mNumBlockRecords > 0 && blockIsFull ) {
+            Flush();
+        }
+
+        BinaryLogRecordHeader header;
+        header.mSequenceNumber = record.mSequenceNumber;
+        header.mTimestamp      = Now();
+        header.mLevel          = LogDataTraits<LogData>::Level( record.mLogData );
+        header.mRegion         = detail::RegionOf( record.mLogData );
+        header.mThreadId       = record.mThreadId;
+        header.mLogDataBytes   = static_cast<std::uint32_t>( packedLogDataBytes );
+        header.mMessageLength  = static_cast<std::uint32_t>( record.mMessageLength );
+
+        mBlockMaxSequenceNumber = std::max( mBlockMaxSequenceNumber, header.mSequenceNumber );
+        mBlockHasDurable        = mBlockHasDurable || header.mLevel >= mOptions.mDurableMinLevel;
+        if ( mNumBlockRecords == 0 ) {
+            mBlockHeader.mFirstSequenceNumber = header.mSequenceNumber;
+            mBlockHeader.mFirstTimestamp      = header.mTimestamp;
+            mPreviousHeader.mSequenceNumber   = header.mSequenceNumber;
+            mPreviousHeader.mTimestamp        = header.mTimestamp;
+        }
+
+        unsigned char encodedHeader[kMaxEncodedBinaryLogRecordHeaderBytes];
+        const auto*   encodedHeaderEnd = EncodeBinaryLogRecordHeader( header, mPreviousHeader, encodedHeader );
+        mPreviousHeader                = header;
+
+        Append( encodedHeader, static_cast<size_t>( encodedHeaderEnd - encodedHeader ) );
+        Append( packedLogData, packedLogDataBytes );
+        Append( record.mMessage, record.mMessageLength );
+        mNumBlockRecords++;
+
+        // The keys are only added to the filter once it is known which segment the block goes into
+        if ( mFilter.NumBytes() > 0 ) {
+            mBlockKeys.push_back( BinaryLogBloomFilter::Hash( BinaryLogKey::Level, header.mLevel ) );
+            mBlockKeys.push_back( BinaryLogBloomFilter::Hash( BinaryLogKey::Region, header.mRegion ) );
+            mBlockKeys.push_back( BinaryLogBloomFilter::Hash( BinaryLogKey::ThreadId, header.mThreadId ) );
+            BinaryLogBloomFilter::ForEachToken(
+                record.mMessage, record.mMessageLength, [this]( const char* token, size_t length ) {
+                    mBlockKeys.push_back( BinaryLogBloomFilter::Hash( BinaryLogKey::Token, token, length ) );
+                } );
+        }
+    }
+
+    /**
+     * @brief Writes out the block being gathered, if it has any records, then commits if a commit is due.
+     *
+     * @return false if the block could not be written. It is dropped either way.
+     */
+    bool Flush()
+    {
+        const bool written = WriteBlock();
+        CommitIfDue();
+        return written;
+    }
+
+    /**
+     * @brief Returns the sequence number up to which records are known to be on disk. REALTIME SAFE
+     *
+     * That assumes records reach the sink in sequence number order, which they do from a single Logger.
+     */
+    std::uint64_t DurableSequenceNumber() const
+    {
+        return mDurableSequenceNumber.load( std::memory_order_acquire );
+    }
+
+    /**
+     * @brief Waits until the record with the given sequence number is on disk. NOT REALTIME SAFE
+     *
+     * Also makes the sink commit as soon as that record has been written and the group commit window allows, whatever
+     * its level. To wait for a message you logged, wait for the logger's sequence number as read after Log returned,
+     * which is at least the sequence number of your message.
+     *
+     * @return false if it timed out first.
+     */
+    bool WaitUntilDurable( std::uint64_t sequenceNumber, std::chrono::milliseconds timeout )
+    {
+        auto requested = mRequestedSequenceNumber.load( std::memory_order_relaxed );
+        while ( requested < sequenceNumber
+                && !mRequestedSequenceNumber.compare_exchange_weak( requested, sequenceNumber ) ) {
+        }
+
+        std::unique_lock<std::mutex> lock( mDurableMutex );
+        return mDurableChanged.wait_for( lock, timeout, [this, sequenceNumber] {
+            return DurableSequenceNumber() >= sequenceNumber;
+        } );
+    }
+
+    /**
+     * @brief Returns whether the current segment is being written with O_DIRECT.
+     */
+    bool UsesDirectIo() const
+    {
+        return mDirectIo;
+    }
+
+    /**
+     * @brief Returns the number of commits made so far.
+     */
+    size_t NumCommits() const
+    {
+        return mNumCommits;
+    }
+
+    /**
+     * @brief Returns the number of blocks that could not be written, and of commits and footers that failed.
+     */
+    size_t NumWriteErrors() const
+    {
+        return mNumWriteErrors;
+    }
+
+    /**
+     * @brief Returns the number of segments started so far.
+     */
+    size_t NumSegments() const
+    {
+        return mNumSegments;
+    }
+
+private:
+    bool WriteBlock()
+    {
+        if ( mNumBlockRecords == 0 ) {
+            return true;
+        }
+
+        std::memcpy( mBlockHeader.mSyncMarker, kBinaryLogSyncMarker, sizeof( mBlockHeader.mSyncMarker ) );
+        mBlockHeader.mBlockBytes = static_cast<std::uint32_t>( mBlock.size() );
+        mBlockHeader.mNumRecords = static_cast<std::uint32_t>( mNumBlockRecords );
+        std::memcpy( mBlock.data(), &mBlockHeader, sizeof( mBlockHeader ) );
+        mBlockHeader.mCrc32c = BinaryLogBlockCrc( mBlock.data(), mBlock.size() );
+        std::memcpy( mBlock.data() + offsetof( BinaryLogBlockHeader, mCrc32c ),
+                     &mBlockHeader.mCrc32c,
+                     sizeof( mBlockHeader.mCrc32c ) );
+
+        const bool segmentIsFull = mSegmentBytes > sizeof( BinaryLogFileHeader )
+                                && mSegmentBytes + mBlock.size() > mOptions.mMaxSegmentBytes;
+
+        bool written = true;
+        if ( mSegmentFd < 0 || segmentIsFull ) {
+            written = OpenNextSegment();
+        }
+        if ( written ) {
+            const BinaryLogIndexEntry entry{
+                mSegmentBytes, mBlockHeader.mFirstSequenceNumber, mBlockHeader.mFirstTimestamp };
+            written = AppendToSegment( mBlock.data(), mBlock.size() );
+            if ( written ) {
+                // The block is in the segment from here on, whether or not its index entry makes it
+                mSegmentBytes += mBlock.size();
+                for ( const auto key : mBlockKeys ) {
+                    mFilter.Insert( key );
+                }
+                mWrittenSequenceNumber = std::max( mWrittenSequenceNumber, mBlockMaxSequenceNumber );
+                mHasUncommittedDurable = mHasUncommittedDurable || mBlockHasDurable;
+                written                = WriteAll( mIndexFd, &entry, sizeof( entry ) );
+            }
+        }
+        if ( !written ) {
+            mNumWriteErrors++;
+        }
+
+        StartBlock();
+        return written;
+    }
+
+    bool HasUncommitted() const
+    {
+        const auto durable = DurableSequenceNumber();
+        return mHasUncommittedDurable || !mUnsyncedSegmentFds.empty()
+            || ( mRequestedSequenceNumber.load( std::memory_order_acquire ) > durable
+                 && mWrittenSequenceNumber > durable );
+    }
+
+    void CommitIfDue()
+    {
+        if ( mSegmentFd < 0 || !HasUncommitted() ) {
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if ( mNumCommits == 0 || now - mLastCommit >= mOptions.mGroupCommitWindow ) {
+            mLastCommit = now;
+            Commit();
+        }
+    }
+
+    bool Commit()
+    {
+        // A new segment's directory entry has to reach the disk too, or a crash could lose the whole file. So do the
+        // earlier segments that were closed while their last commit failed; everything written goes in one commit
+        bool committed = ( mSegmentIsInDirectory && mUnsyncedSegmentFds.empty() ) || SyncDirectory();
+        for ( const int fd : mUnsyncedSegmentFds ) {
+            committed = committed && SyncData( fd );
+        }
+        committed = committed && ( mSegmentFd < 0 || SyncData( mSegmentFd ) );
+        if ( !committed ) {
+            // The durable records stay uncommitted, so the next Flush tries again
+            mNumWriteErrors++;
+            return false;
+        }
+        for ( const int fd : mUnsyncedSegmentFds ) {
+            ::close( fd );
+        }
+        mUnsyncedSegmentFds.clear();
+        mHasUncommittedDurable = false;
+        mSegmentIsInDirectory  = true;
+        mNumCommits++;
+
+        {
+            std::lock_guard<std::mutex> lock( mDurableMutex );
+            mDurableSequenceNumber.store( mWrittenSequenceNumber, std::memory_order_release );
+        }
+        mDurableChanged.notify_all();
+        if ( mOptions.mOnDurable ) {
+            mOptions.mOnDurable( mWrittenSequenceNumber );
+        }
+        return true;
+    }
+
+    static bool SyncData( int fd )
+    {
+#if defined( __APPLE__ )
+        return ::fsync( fd ) == 0;
+#else
+        return ::fdatasync( fd ) == 0;
+#endif
+    }
+
+    bool SyncDirectory() const
+    {
+        const auto slash     = mBasePath.rfind( '/' );
+        const auto directory = slash == std::string::npos ? std::string( "." ) : mBasePath.substr( 0, slash + 1 );
+        const int  fd        = ::open( directory.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 ) {
+            return false;
+        }
+        const bool synced = ::fsync( fd ) == 0;
+        ::close( fd );
+        return synced;
+    }
+
+    static std::int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch() )
+            .count();
+    }
+
+    static bool WriteAll( int fd, const void* data, size_t numBytes )
+    {
+        const auto* bytes = static_cast<const char*>( data );
+        while ( numBytes > 0 ) {
+            const auto written = ::write( fd, bytes, numBytes );
+            if ( written < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += written;
+            numBytes -= static_cast<size_t>( written );
+        }
+        return true;
+    }
+
+    static BinaryLogFileHeader MakeFileHeader( const char ( &magic )[8], std::uint32_t logDataBytes )
+    {
+        BinaryLogFileHeader header;
+        std::memcpy( header.mMagic, magic, sizeof( header.mMagic ) );
+        header.mVersion      = kBinaryLogVersion;
+        header.mLogDataBytes = logDataBytes;
+        return header;
+    }
+
+    static bool PwriteAll( int fd, const void* data, size_t numBytes, off_t offset )
+    {
+        const auto* bytes = static_cast<const char*>( data );
+        while ( numBytes > 0 ) {
+            const auto written = ::pwrite( fd, bytes, numBytes, offset );
+            if ( written < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += written;
+            numBytes -= static_cast<size_t>( written );
+            offset += written;
+        }
+        return true;
+    }
+
+    static size_t RoundUpToDirectIoAlignment( size_t numBytes )
+    {
+        return ( numBytes + kDirectIoAlignment - 1 ) / kDirectIoAlignment * kDirectIoAlignment;
+    }
+
+    bool AppendToSegment( const void* data, size_t numBytes )
+    {
+        if ( !mDirectIo ) {
+            return WriteAll( mSegmentFd, data, numBytes );
+        }
+
+        // The buffer holds the start of the last, partly written page, followed by the new data
+        const auto neededBytes = RoundUpToDirectIoAlignment( mDirectBufferBytes + numBytes );
+        if ( neededBytes > mDirectBufferCapacity ) {
+            auto buffer = AllocateDirectIoBuffer( std::max( neededBytes, 2 * mDirectBufferCapacity ) );
+            if ( buffer == nullptr ) {
+                return false;
+            }
+            std::memcpy( buffer.get(), mDirectBuffer.get(), mDirectBufferBytes );
+            mDirectBuffer         = std::move( buffer );
+            mDirectBufferCapacity = std::max( neededBytes, 2 * mDirectBufferCapacity );
+        }
+        std::memcpy( mDirectBuffer.get() + mDirectBufferBytes, data, numBytes );
+        mDirectBufferBytes += numBytes;
+        std::memset( mDirectBuffer.get() + mDirectBufferBytes, 0, neededBytes - mDirectBufferBytes );
+
+        if ( !PwriteAll( mSegmentFd, mDirectBuffer.get(), neededBytes, static_cast<off_t>( mDirectBufferOffset ) ) ) {
+            return errno == EINVAL && FallBackToBufferedIo();
+        }
+
+        const auto completeBytes = mDirectBufferBytes / kDirectIoAlignment * kDirectIoAlignment;
+        std::memmove( mDirectBuffer.get(), mDirectBuffer.get() + completeBytes, mDirectBufferBytes - completeBytes );
+        mDirectBufferOffset += completeBytes;
+        mDirectBufferBytes -= completeBytes;
+        return true;
+    }
+
+    // For file systems that accept O_DIRECT at open but not at write: writes what is buffered the usual way
+    bool FallBackToBufferedIo()
+    {
+        mDirectIo = false;
+#if defined( O_DIRECT )
+        const auto flags = ::fcntl( mSegmentFd, F_GETFL );
+        if ( flags < 0 || ::fcntl( mSegmentFd, F_SETFL, flags & ~O_DIRECT ) != 0 ) {
+            return false;
+        }
+#endif
+        const auto bufferOffset = static_cast<off_t>( mDirectBufferOffset );
+        const auto segmentSize  = static_cast<off_t>( DirectIoSegmentSize() );
+        return PwriteAll( mSegmentFd, mDirectBuffer.get(), mDirectBufferBytes, bufferOffset )
+            && ::ftruncate( mSegmentFd, segmentSize ) == 0
+            && ::lseek( mSegmentFd, segmentSize, SEEK_SET ) == segmentSize;
+    }
+
+    // The size of the segment without the padding of its last page
+    size_t DirectIoSegmentSize() const
+    {
+        return mDirectBufferOffset + mDirectBufferBytes;
+    }
+
+    static std::unique_ptr<unsigned char, decltype( &std::free )> AllocateDirectIoBuffer( size_t numBytes )
+    {
+        void* buffer = nullptr;
+        if ( ::posix_memalign( &buffer, kDirectIoAlignment, numBytes ) != 0 ) {
+            buffer = nullptr;
+        }
+        return { static_cast<unsigned char*>( buffer ), &std::free };
+    }
+
+    void StartBlock()
+    {
+        mBlock.assign( sizeof( BinaryLogBlockHeader ), 0 );
+        mBlockHeader            = {};
+        mNumBlockRecords        = 0;
+        mBlockMaxSequenceNumber = 0;
+        mBlockHasDurable        = false;
+        mBlockKeys.clear();
+    }
+
+    void Append( const void* data, size_t numBytes )
+    {
+        const auto* bytes = static_cast<const char*>( data );
+        mBlock.insert( mBlock.end(), bytes, bytes + numBytes );
+    }
+
+    // If either file can't be opened or started, there is no segment, and the next block tries again with the same name
+    bool OpenNextSegment()
+    {
+        CloseSegment();
+
+        const auto segmentPath = BinaryLogSegmentPath( mBasePath, mNumSegments );
+        constexpr int kFlags   = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        mSegmentIsInDirectory  = false;
+        mDirectIo              = false;
+        mDirectBufferOffset    = 0;
+        mDirectBufferBytes     = 0;
+#if defined( O_DIRECT )
+        if ( mOptions.mDirectIo ) {
+            if ( mDirectBuffer == nullptr ) {
+                mDirectBufferCapacity = RoundUpToDirectIoAlignment( mOptions.mMaxBlockBytes ) + kDirectIoAlignment;
+                mDirectBuffer         = AllocateDirectIoBuffer( mDirectBufferCapacity );
+            }
+            mSegmentFd = mDirectBuffer == nullptr ? -1 : ::open( segmentPath.c_str(), kFlags | O_DIRECT, 0644 );
+            mDirectIo  = mSegmentFd >= 0;
+        }
+#endif
+        if ( mSegmentFd < 0 ) {
+            mSegmentFd = ::open( segmentPath.c_str(), kFlags, 0644 );
+        }
+        mIndexFd      = ::open( BinaryLogIndexPath( segmentPath ).c_str(), kFlags, 0644 );
+        mSegmentBytes = sizeof( BinaryLogFileHeader );
+
+        const auto segmentHeader = MakeFileHeader( kBinaryLogMagic, static_cast<std::uint32_t>( sizeof( LogData ) ) );
+        const auto indexHeader   = MakeFileHeader( kBinaryLogIndexMagic, 0 );
+        const bool opened        = mSegmentFd >= 0 && mIndexFd >= 0
+                         && AppendToSegment( &segmentHeader, sizeof( segmentHeader ) )
+                         && WriteAll( mIndexFd, &indexHeader, sizeof( indexHeader ) );
+        if ( !opened ) {
+            for ( int* fd : { &mSegmentFd, &mIndexFd } ) {
+                if ( *fd >= 0 ) {
+                    ::close( *fd );
+                }
+                *fd = -1;
+            }
+            mDirectIo = false;
+            return false;
+        }
+        mNumSegments++;
+        return true;
+    }
+
+    bool WriteFooter()
+    {
+        BinaryLogFooter footer;
+        footer.mFilterBytes = static_cast<std::uint32_t>( mFilter.NumBytes() );
+        footer.mNumHashes   = mFilter.NumHashes();
+        std::memcpy( footer.mMagic, kBinaryLogFooterMagic, sizeof( footer.mMagic ) );
+
+        const bool written = AppendToSegment( mFilter.Bits(), mFilter.NumBytes() )
+                          && AppendToSegment( &footer, sizeof( footer ) );
+        mFilter.Clear();
+        return written;
+    }
+
+    void CloseSegment()
+    {
+        if ( mSegmentFd >= 0 ) {
+            // What is still uncommitted can't wait for the next window once the segment is closed
+            const bool committed = !HasUncommitted() || Commit();
+            if ( mFilter.NumBytes() > 0 && !WriteFooter() ) {
+                mNumWriteErrors++;
+            }
+            if ( mDirectIo && ::ftruncate( mSegmentFd, static_cast<off_t>( DirectIoSegmentSize() ) ) != 0 ) {
+                mNumWriteErrors++;
+            }
+            // Syncing another file says nothing about this one, so if its commit failed, it stays open for the next
+            // commit to sync again, and nothing written since is durable before that succeeds
+            if ( committed ) {
+                ::close( mSegmentFd );
+            }
+            else {
+                mUnsyncedSegmentFds.push_back( mSegmentFd );
+            }
+        }
+        if ( mIndexFd >= 0 ) {
+            ::close( mIndexFd );
+        }
+        mSegmentFd = -1;
+        mIndexFd   = -1;
+    }
+
+    std::string                mBasePath{};
+    BinaryLogSinkOptions       mOptions{};
+    BinaryLogBloomFilter       mFilter{};
+    std::vector<std::uint64_t> mBlockKeys{}; // hashes of the keys of the block being gathered
+    std::vector<char>          mBlock{};
+    BinaryLogBlockHeader       mBlockHeader{};
+    BinaryLogRecordHeader      mPreviousHeader{}; // the one the next record's deltas are taken from
+    size_t                     mNumBlockRecords{};
+    std::uint64_t              mBlockMaxSequenceNumber{};
+    bool                       mBlockHasDurable{};
+    int                        mSegmentFd{ -1 };
+    int                        mIndexFd{ -1 };
+    size_t                     mSegmentBytes{};
+    size_t                     mNumSegments{};
+    size_t                     mNumWriteErrors{};
+
+    bool                                                   mDirectIo{};
+    std::unique_ptr<unsigned char, decltype( &std::free )> mDirectBuffer{ nullptr, &std::free };
+    size_t                                                 mDirectBufferCapacity{};
+    size_t                                                 mDirectBufferOffset{}; // where the buffer goes in the file
+    size_t                                                 mDirectBufferBytes{};
+
+    std::uint64_t                         mWrittenSequenceNumber{}; // the highest one written to the segment files
+    bool                                  mHasUncommittedDurable{};
+    std::vector<int>                      mUnsyncedSegmentFds{}; // closed segments whose last commit failed
+    bool                                  mSegmentIsInDirectory{};
+    std::chrono::steady_clock::time_point mLastCommit{};
+    size_t                                mNumCommits{};
+    std::atomic<std::uint64_t>            mDurableSequenceNumber{};
+    std::atomic<std::uint64_t>            mRequestedSequenceNumber{}; // the highest one waited for
+    std::mutex                            mDurableMutex{};
+    std::condition_variable               mDurableChanged{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BinaryLog.h"
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+/**
+ * @brief A read only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile( const std::string& path )
+    {
+        const int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 ) {
+            return;
+        }
+        struct stat status;
+        if ( ::fstat( fd, &status ) == 0 && status.st_size > 0 ) {
+            void* mapped = ::mmap( nullptr, static_cast<size_t>( status.st_size ), PROT_READ, MAP_SHARED, fd, 0 );
+            if ( mapped != MAP_FAILED ) {
+                mData = static_cast<const char*>( mapped );
+                mSize = static_cast<size_t>( status.st_size );
+            }
+        }
+        ::close( fd );
+    }
+
+    ~MappedFile()
+    {
+        if ( mData != nullptr ) {
+            ::munmap( const_cast<char*>( mData ), mSize );
+        }
+    }
+
+    MappedFile( const MappedFile& )            = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    const char* Data() const
+    {
+        return mData;
+    }
+
+    size_t Size() const
+    {
+        return mSize;
+    }
+
+private:
+    const char* mData{};
+    size_t      mSize{};
+};
+
+template <typename T>
+T ReadUnaligned( const char* data )
+{
+    T value;
+    std::memcpy( &value, data, sizeof( T ) );
+    return value;
+}
+
+} // namespace detail
+
+/**
+ * @brief One record of a binary log, as handed out by BinaryLogReader. Points into the mapped file.
+ */
+struct BinaryLogRecordView
+{
+    std::uint64_t mSequenceNumber{};
+    std::int64_t  mTimestamp{}; // nanoseconds since the epoch
+    int           mLevel{};
+    int           mRegion{};
+    std::uint32_t mThreadId{};
+    const void*   mLogData{}; // packed, read it with UnpackLogData
+    size_t        mLogDataBytes{};
+    const char*   mMessage{};   // not null terminated
+    size_t        mMessageLength{};
+};
+
+/**
+ * @brief Unpacks the LogData of a record, with LogDataTraits::Unpack if there is one, or as raw bytes otherwise.
+ *
+ * @return false if the record's LogData doesn't unpack into a LogData, for instance because it was written by a
+ * sink with a different LogData.
+ */
+template <typename LogData>
+bool UnpackLogData( const BinaryLogRecordView& record, LogData& data )
+{
+    return detail::UnpackLogData( static_cast<const unsigned char*>( record.mLogData ), record.mLogDataBytes, data );
+}
+
+/**
+ * @brief What a search is looking for, to rule segments out with their bloom filters. See BinaryLogReader::MayContain.
+ */
+struct BinaryLogQuery
+{
+    std::optional<int>           mLevel{};
+    std::optional<int>           mRegion{};
+    std::optional<std::uint32_t> mThreadId{};
+    std::vector<std::string>     mTokens{}; // whole tokens, see BinaryLogBloomFilter
+
+    /**
+     * @brief Adds the tokens that any message containing substring must have.
+     *
+     * Those are the tokens of substring that don't touch either end of it, as the ones that do may be part of a longer
+     * token in the message: "underrun on bus" gives "on" (if it were long enough), not "underrun" or "bus".
+     */
+    void AddTokensWithin( const std::string& substring )
+    {
+        BinaryLogBloomFilter::ForEachToken(
+            substring.data(), substring.size(), [&]( const char* token, size_t length ) {
+                if ( token != substring.data() && token + length != substring.data() + substring.size() ) {
+                    mTokens.emplace_back( token, length );
+                }
+            } );
+    }
+};
+
+/**
+ * @brief Reads one segment of a log written by BinaryLogSink.
+ *
+ * NOT REALTIME SAFE
+ *
+ * The segment and its sparse index are memory mapped. Seeking to a sequence number or a time binary searches the index
+ * for the block it is in, so only a logarithmic number of index pages and then a single block are touched, however big
+ * the segment is. If the index is missing, one is built by walking the block headers.
+ *
+ * A segment that ends in a partially written block, for instance after a crash, is read up to the last complete block.
+ * Every block's CRC32C is checked before it is read, and anything that isn't a valid block is skipped by searching for
+ * the next sync marker.
+ *
+ * Use MayContain to skip segments that a search can't match, using the bloom filter at the end of complete segments.
+ */
+class BinaryLogReader
+{
+public:
+    explicit BinaryLogReader( const std::string& segmentPath )
+    : mLog( segmentPath )
+    , mIndexFile( BinaryLogIndexPath( segmentPath ) )
+    {
+        if ( mLog.Size() < sizeof( BinaryLogFileHeader ) ) {
+            return;
+        }
+        const auto header = detail::ReadUnaligned<BinaryLogFileHeader>( mLog.Data() );
+        if ( std::memcmp( header.mMagic, kBinaryLogMagic, sizeof( header.mMagic ) ) != 0
+             || header.mVersion != kBinaryLogVersion ) {
+            return;
+        }
+        mLogDataBytes = header.mLogDataBytes;
+        mDataSize     = mLog.Size();
+        mIsOpen       = true;
+
+        UseFooter();
+        if ( !UseIndexFile() ) {
+            BuildIndex();
+        }
+    }
+
+    /**
+     * @brief Returns false if the segment could not be read, or is not a binary log of a version this reader knows.
+     */
+    bool IsOpen() const
+    {
+        return mIsOpen;
+    }
+
+    /**
+     * @brief Returns sizeof( LogData ) of the sink that wrote the segment.
+     */
+    size_t LogDataBytes() const
+    {
+        return mLogDataBytes;
+    }
+
+    size_t NumIndexEntries() const
+    {
+        return mNumIndexEntries;
+    }
+
+    /**
+     * @brief Returns the sequence number of the first record in the segment, or 0 if it is empty.
+     */
+    std::uint64_t FirstSequenceNumber() const
+    {
+        return mNumIndexEntries == 0 ? 0 : IndexEntry( 0 ).mSequenceNumber;
+    }
+
+    /**
+     * @brief Returns the timestamp of the first record in the segment, or 0 if it is empty.
+     */
+    std::int64_t FirstTimestamp() const
+    {
+        return mNumIndexEntries == 0 ? 0 : IndexEntry( 0 ).mTimestamp;
+    }
+
+    /**
+     * @brief Returns whether the segment ends in a bloom filter, which it does once the sink has moved on from it.
+     */
+    bool HasBloomFilter() const
+    {
+        return mFilter != nullptr;
+    }
+
+    /**
+     * @brief Returns false if no record in the segment can match query, true if some may.
+     *
+     * Only reads the few pages of the bloom filter that the query's keys hash to. Returns true if the segment has no
+     * bloom filter.
+     */
+    bool MayContain( const BinaryLogQuery& query ) const
+    {
+        if ( mFilter == nullptr ) {
+            return true;
+        }
+        const auto mayContain = [this]( std::uint64_t hash ) {
+            return BinaryLogBloomFilter::MayContain( mFilter, mFilterBytes, mNumFilterHashes, hash );
+        };
+        if ( ( query.mLevel && !mayContain( BinaryLogBloomFilter::Hash( BinaryLogKey::Level, *query.mLevel ) ) )
+             || ( query.mRegion && !mayContain( BinaryLogBloomFilter::Hash( BinaryLogKey::Region, *query.mRegion ) ) )
+             || ( query.mThreadId
+                  && !mayContain( BinaryLogBloomFilter::Hash( BinaryLogKey::ThreadId, *query.mThreadId ) ) ) ) {
+            return false;
+        }
+        return std::all_of( query.mTokens.begin(), query.mTokens.end(), [&]( const std::string& token ) {
+            return mayContain( BinaryLogBloomFilter::Hash( BinaryLogKey::Token, token.data(), token.size() ) );
+        } );
+    }
+
+    /**
+     * @brief Hands every record to readFn, in the order they were written.
+     *
+     * @tparam ReadFn Callable as readFn( const BinaryLogRecordView& record ) -> bool, returning false to stop.
+     * @return size_t The number of records handed out.
+     */
+    template <typename ReadFn>
+    size_t ReadAll( ReadFn&& readFn ) const
+    {
+        return ReadFromBlock( 0, readFn, []( const BinaryLogRecordView& ) { return true; } );
+    }
+
+    /**
+     * @brief Hands out the records of the blocks that start in [beginOffset, endOffset) of the segment file. See
+     * ReadAll.
+     *
+     * Blocks are found by their sync marker, so the segment can be cut into ranges at arbitrary offsets, for instance
+     * to read it from several threads, and every block is read by exactly one of the ranges.
+     */
+    template <typename ReadFn>
+    size_t ReadRange( size_t beginOffset, size_t endOffset, ReadFn&& readFn ) const
+    {
+        return ReadBlocks( beginOffset, endOffset, readFn, []( const BinaryLogRecordView& ) { return true; } );
+    }
+
+    /**
+     * @brief Returns the size of the segment file in bytes.
+     */
+    size_t Size() const
+    {
+        return mLog.Size();
+    }
+
+    /**
+     * @brief Hands out records from the first one with at least the given sequence number. See ReadAll.
+     *
+     * Assumes sequence numbers increase through the segment, as they do for a single Logger.
+     */
+    template <typename ReadFn>
+    size_t ReadFromSequenceNumber( std::uint64_t sequenceNumber, ReadFn&& readFn ) const
+    {
+        const auto block = FindBlock( [sequenceNumber]( const BinaryLogIndexEntry& entry ) {
+            return entry.mSequenceNumber <= sequenceNumber;
+        } );
+        return ReadFromBlock( block, readFn, [sequenceNumber]( const BinaryLogRecordView& record ) {
+            return record.mSequenceNumber >= sequenceNumber;
+        } );
+    }
+
+    /**
+     * @brief Hands out records from the first one written at or after the given time. See ReadAll.
+     *
+     * @param timestamp Nanoseconds since the epoch.
+     */
+    template <typename ReadFn>
+    size_t ReadFromTimestamp( std::int64_t timestamp, ReadFn&& readFn ) const
+    {
+        const auto block =
+            FindBlock( [timestamp]( const BinaryLogIndexEntry& entry ) { return entry.mTimestamp <= timestamp; } );
+        return ReadFromBlock(
+            block, readFn, [timestamp]( const BinaryLogRecordView& record ) { return record.mTimestamp >= timestamp; } );
+    }
+
+private:
+    void UseFooter()
+    {
+        if ( mLog.Size() < sizeof( BinaryLogFileHeader ) + sizeof( BinaryLogFooter ) ) {
+            return;
+        }
+        const auto footerOffset = mLog.Size() - sizeof( BinaryLogFooter );
+        const auto footer       = detail::ReadUnaligned<BinaryLogFooter>( mLog.Data() + footerOffset );
+        if ( std::memcmp( footer.mMagic, kBinaryLogFooterMagic, sizeof( footer.mMagic ) ) != 0
+             || footer.mFilterBytes > footerOffset - sizeof( BinaryLogFileHeader ) ) {
+            return;
+        }
+        mFilter          = mLog.Data() + footerOffset - footer.mFilterBytes;
+        mFilterBytes     = footer.mFilterBytes;
+        mNumFilterHashes = footer.mNumHashes;
+        mDataSize        = footerOffset - footer.mFilterBytes;
+    }
+
+    bool UseIndexFile()
+    {
+        if ( mIndexFile.Size() < sizeof( BinaryLogFileHeader ) ) {
+            return false;
+        }
+        const auto header = detail::ReadUnaligned<BinaryLogFileHeader>( mIndexFile.Data() );
+        if ( std::memcmp( header.mMagic, kBinaryLogIndexMagic, sizeof( header.mMagic ) ) != 0
+             || header.mVersion != kBinaryLogVersion ) {
+            return false;
+        }
+        mIndex           = mIndexFile.Data() + sizeof( BinaryLogFileHeader );
+        mNumIndexEntries = ( mIndexFile.Size() - sizeof( BinaryLogFileHeader ) ) / sizeof( BinaryLogIndexEntry );
+        return true;
+    }
+
+    void BuildIndex()
+    {
+        for ( auto offset = FindNextBlock( 0 ); offset < mDataSize; offset = FindNextBlock( offset ) ) {
+            const auto                header = detail::ReadUnaligned<BinaryLogBlockHeader>( mLog.Data() + offset );
+            const BinaryLogIndexEntry entry{ offset, header.mFirstSequenceNumber, header.mFirstTimestamp };
+            const auto*               bytes  = reinterpret_cast<const char*>( &entry );
+            mBuiltIndex.insert( mBuiltIndex.end(), bytes, bytes + sizeof( entry ) );
+            offset += header.mBlockBytes;
+        }
+        mIndex           = mBuiltIndex.data();
+        mNumIndexEntries = mBuiltIndex.size() / sizeof( BinaryLogIndexEntry );
+    }
+
+    BinaryLogIndexEntry IndexEntry( size_t i ) const
+    {
+        return detail::ReadUnaligned<BinaryLogIndexEntry>( mIndex + i * sizeof( BinaryLogIndexEntry ) );
+    }
+
+    // Returns the index of the last block for which isAtOrBefore holds, or 0
+    template <typename Predicate>
+    size_t FindBlock( Predicate isAtOrBefore ) const
+    {
+        size_t first = 0;
+        size_t count = mNumIndexEntries;
+        while ( count > 0 ) {
+            const auto step = count / 2;
+            if ( isAtOrBefore( IndexEntry( first + step ) ) ) {
+                first += step + 1;
+                count -= step + 1;
+            }
+            else {
+                count = step;
+            }
+        }
+        return first == 0 ? 0 : first - 1;
+    }
+
+    // Returns the size of the block at offset if it starts with a sync marker and lies entirely within the file, or 0
+    size_t CompleteBlockBytes( size_t offset ) const
+    {
+        if ( offset + sizeof( BinaryLogBlockHeader ) > mDataSize ) {
+            return 0;
+        }
+        const auto header = detail::ReadUnaligned<BinaryLogBlockHeader>( mLog.Data() + offset );
+        if ( std::memcmp( header.mSyncMarker, kBinaryLogSyncMarker, sizeof( header.mSyncMarker ) ) != 0
+             || header.mBlockBytes < sizeof( BinaryLogBlockHeader ) || offset + header.mBlockBytes > mDataSize ) {
+            return 0;
+        }
+        return header.mBlockBytes;
+    }
+
+    // Returns the size of the block at offset if it is complete and its checksum matches, or 0
+    size_t ValidBlockBytes( size_t offset ) const
+    {
+        const auto blockBytes = CompleteBlockBytes( offset );
+        if ( blockBytes == 0 ) {
+            return 0;
+        }
+        const auto header = detail::ReadUnaligned<BinaryLogBlockHeader>( mLog.Data() + offset );
+        return BinaryLogBlockCrc( mLog.Data() + offset, blockBytes ) == header.mCrc32c ? blockBytes : 0;
+    }
+
+    // Returns the offset of the first valid block at or after offset, or the size of the file if there is none
+    size_t FindNextBlock( size_t offset ) const
+    {
+        offset = std::max( offset, sizeof( BinaryLogFileHeader ) );
+        while ( offset < mDataSize ) {
+            if ( ValidBlockBytes( offset ) != 0 ) {
+                return offset;
+            }
+            const void* marker = ::memmem( mLog.Data() + offset + 1,
+                                           mDataSize - offset - 1,
+                                           kBinaryLogSyncMarker,
+                                           sizeof( kBinaryLogSyncMarker ) );
+            if ( marker == nullptr ) {
+                break;
+            }
+            offset = static_cast<size_t>( static_cast<const char*>( marker ) - mLog.Data() );
+        }
+        return mDataSize;
+    }
+
+    // Reads the blocks starting in [offset, endOffset), skipping over anything that isn't a valid block
+    template <typename ReadFn, typename StartFn>
+    size_t ReadBlocks( size_t offset, size_t endOffset, ReadFn& readFn, StartFn hasStarted ) const
+    {
+        if ( !mIsOpen ) {
+            return 0;
+        }
+
+        endOffset = std::min( endOffset, mDataSize );
+
+        size_t numRead = 0;
+        bool   started = false;
+        for ( offset = FindNextBlock( offset ); offset < endOffset; offset = FindNextBlock( offset ) ) {
+            const auto  blockBytes  = CompleteBlockBytes( offset );
+            const auto  blockHeader = detail::ReadUnaligned<BinaryLogBlockHeader>( mLog.Data() + offset );
+            const auto* blockStart  = reinterpret_cast<const unsigned char*>( mLog.Data() + offset );
+            const auto* blockEnd    = blockStart + blockBytes;
+            const auto* record      = blockStart + sizeof( BinaryLogBlockHeader );
+
+            BinaryLogRecordHeader header;
+            header.mSequenceNumber = blockHeader.mFirstSequenceNumber;
+            header.mTimestamp      = blockHeader.mFirstTimestamp;
+            while ( record < blockEnd ) {
+                record = DecodeBinaryLogRecordHeader( record, blockEnd, header, header );
+                if ( record == nullptr
+                     || static_cast<size_t>( blockEnd - record ) < size_t{ header.mLogDataBytes } + header.mMessageLength ) {
+                    break;
+                }
+
+                BinaryLogRecordView view;
+                view.mSequenceNumber = header.mSequenceNumber;
+                view.mTimestamp      = header.mTimestamp;
+                view.mLevel          = header.mLevel;
+                view.mRegion         = header.mRegion;
+                view.mThreadId       = header.mThreadId;
+                view.mLogData        = record;
+                view.mLogDataBytes   = header.mLogDataBytes;
+                view.mMessage        = reinterpret_cast<const char*>( record ) + header.mLogDataBytes;
+                view.mMessageLength  = header.mMessageLength;
+                record += header.mLogDataBytes + header.mMessageLength;
+
+                started = started || hasStarted( view );
+                if ( !started ) {
+                    continue;
+                }
+                numRead++;
+                if ( !readFn( static_cast<const BinaryLogRecordView&>( view ) ) ) {
+                    return numRead;
+                }
+            }
+            offset += blockBytes;
+        }
+        return numRead;
+    }
+
+    template <typename ReadFn, typename StartFn>
+    size_t ReadFromBlock( size_t block, ReadFn& readFn, StartFn hasStarted ) const
+    {
+        const auto offset = mNumIndexEntries == 0 ? 0 : IndexEntry( block ).mOffset;
+        return ReadBlocks( offset, mDataSize, readFn, hasStarted );
+    }
+
+    detail::MappedFile mLog;
+    detail::MappedFile mIndexFile;
+    std::vector<char>  mBuiltIndex{};
+    const char*        mIndex{};
+    size_t             mNumIndexEntries{};
+    size_t             mLogDataBytes{};
+    size_t             mDataSize{}; // of the segment up to the footer
+    const char*        mFilter{};
+    size_t             mFilterBytes{};
+    std::uint32_t      mNumFilterHashes{};
+    bool               mIsOpen{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "TextLineFormat.h"
+
+namespace rtlog
+{
+
+enum class ConsoleColor
+{
+    Auto,   // when the file descriptor is a terminal and NO_COLOR isn't set
+    Always,
+    Never
+};
+
+struct ConsoleSinkOptions
+{
+    int          mFd    = STDOUT_FILENO;
+    ConsoleColor mColor = ConsoleColor::Auto;
+
+    // ANSI escape sequences starting the lines of each level, from level 0; higher levels use the last one
+    std::vector<std::string> mLevelColors{ "\033[2m", "", "\033[33m", "\033[1;31m" };
+
+    size_t mBufferBytes = 64 * 1024;
+
+    bool          mTimestamps    = false; // start lines with the time they are written, see TimestampFormatter
+    TimestampZone mTimestampZone = TimestampZone::Utc;
+};
+
+/**
+ * @brief A print log function that writes text lines to the console, a whole batch of them with one write.
+ *
+ * NOT REALTIME SAFE - use it on the thread that processes the log queue, e.g. with a LogProcessingThread.
+ *
+ * printf takes the stdio lock for every message, and flushes every line when stdout is a terminal. This sink formats
+ * the records with FormatTextLine into a buffer of its own, and writes it out on Flush, which LogProcessingThread calls
+ * after each batch, or when it fills up. Lines are optionally coloured by level.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ */
+template <typename LogData>
+class ConsoleSink
+{
+public:
+    explicit ConsoleSink( const ConsoleSinkOptions& options = {} )
+    : mFd( options.mFd )
+    , mLevelColors( options.mLevelColors )
+    , mBuffer( std::max<size_t>( options.mBufferBytes, 4096 ) )
+    {
+        if ( options.mTimestamps ) {
+            mTimestamps.emplace( 6, options.mTimestampZone );
+        }
+        const bool colorTerminal = ::isatty( mFd ) == 1 && std::getenv( "NO_COLOR" ) == nullptr;
+        mUsesColor = options.mColor == ConsoleColor::Always
+                  || ( options.mColor == ConsoleColor::Auto && colorTerminal );
+        if ( !mUsesColor || mLevelColors.empty() ) {
+            mLevelColors.assign( 1, std::string() );
+        }
+        for ( const auto& color : mLevelColors ) {
+            mMaxColorBytes = std::max( mMaxColorBytes, color.size() + sizeof( kColorReset ) - 1 );
+        }
+    }
+
+    ~ConsoleSink()
+    {
+        Flush();
+    }
+
+    ConsoleSink( const ConsoleSink& )            = delete;
+    ConsoleSink& operator=( const ConsoleSink& ) = delete;
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        const auto lineBytes = mMaxColorBytes + kMaxTextLineOverhead + record.mMessageLength;
+        if ( mNumBuffered + lineBytes > mBuffer.size() ) {
+            Flush();
+        }
+
+        const auto  level = static_cast<size_t>( std::max( LogDataTraits<LogData>::Level( record.mLogData ), 0 ) );
+        const auto& color = mLevelColors[std::min( level, mLevelColors.size() - 1 )];
+        std::memcpy( mBuffer.data() + mNumBuffered, color.data(), color.size() );
+        mNumBuffered += color.size();
+
+        // Cut short if a message is longer than the whole buffer
+        const auto capacity   = mBuffer.size() - mNumBuffered - ( sizeof( kColorReset ) - 1 );
+        auto*      timestamps = mTimestamps ? &*mTimestamps : nullptr;
+        const auto length     = FormatTextLine( record, mBuffer.data() + mNumBuffered, capacity, timestamps );
+        if ( length == 0 ) {
+            mNumBuffered -= color.size();
+            return;
+        }
+        mNumBuffered += length;
+        if ( !color.empty() ) {
+            // Reset before the newline, so the colour doesn't run into whatever is printed next
+            std::memcpy( mBuffer.data() + mNumBuffered - 1, kColorReset, sizeof( kColorReset ) - 1 );
+            mNumBuffered += sizeof( kColorReset ) - 1;
+            mBuffer[mNumBuffered - 1] = '\n';
+        }
+    }
+
+    /**
+     * @brief Writes out the lines buffered so far.
+     *
+     * @return false if they could not be written. They are dropped either way.
+     */
+    bool Flush()
+    {
+        size_t offset = 0;
+        while ( offset < mNumBuffered ) {
+            const auto numWritten = ::write( mFd, mBuffer.data() + offset, mNumBuffered - offset );
+            if ( numWritten < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                mNumWriteErrors++;
+                break;
+            }
+            offset += static_cast<size_t>( numWritten );
+            mNumWrites++;
+        }
+        const bool written = offset == mNumBuffered;
+        mNumBuffered       = 0;
+        return written;
+    }
+
+    bool UsesColor() const
+    {
+        return mUsesColor;
+    }
+
+    /**
+     * @brief Returns the number of write calls made, usually one per batch.
+     */
+    size_t NumWrites() const
+    {
+        return mNumWrites;
+    }
+
+    /**
+     * @brief Returns the number of times lines were dropped, because the console could not be written.
+     */
+    size_t NumWriteErrors() const
+    {
+        return mNumWriteErrors;
+    }
+
+private:
+    static constexpr char kColorReset[] = "\033[0m";
+
+    int                               mFd{ STDOUT_FILENO };
+    std::vector<std::string>          mLevelColors{};
+    bool                              mUsesColor{};
+    size_t                            mMaxColorBytes{};
+    std::optional<TimestampFormatter> mTimestamps{};
+    std::vector<char>                 mBuffer{};
+    size_t                            mNumBuffered{};
+    size_t                            mNumWrites{};
+    size_t                            mNumWriteErrors{};
+};
+
+} // namespace rtlog
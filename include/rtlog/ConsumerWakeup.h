@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined( __linux__ )
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace rtlog
+{
+
+/**
+ * @brief How a producer wakes the consumer early, see Logger::EnableEarlyWake.
+ */
+enum class WakePolicy
+{
+    /**
+     * The producer only sets a flag, which costs one atomic exchange and never enters the kernel. The consumer polls
+     * the flag every millisecond while it waits, so it wakes up within a millisecond of the flag being set.
+     */
+    Flag,
+
+    /**
+     * The producer sets the flag and, if it was not set yet, wakes the consumer with a FUTEX_WAKE. That is a non
+     * blocking system call, made at most once per wait, which many real-time budgets allow but some don't. The consumer
+     * sleeps in the kernel until woken or timed out. Falls back to Flag where futexes are not available.
+     */
+    Futex,
+};
+
+/**
+ * @brief Lets producers cut the consumer's wait short.
+ *
+ * Producers call Notify, the consumer calls Wait between processing runs.
+ */
+class ConsumerWakeup
+{
+public:
+    /**
+     * @brief Asks the consumer to wake up. REALTIME SAFE - wait-free, see WakePolicy for the one system call.
+     */
+    void Notify( WakePolicy policy )
+    {
+        // Look before exchanging so that producers don't bounce the cache line around while the flag is already set
+        if ( mPending.load( std::memory_order_relaxed ) != 0 || mPending.exchange( 1, std::memory_order_release ) != 0 ) {
+            return;
+        }
+#if defined( __linux__ )
+        if ( policy == WakePolicy::Futex ) {
+            syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( &mPending ), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0 );
+        }
+#else
+        (void) policy;
+#endif
+    }
+
+    /**
+     * @brief Waits until timeout has passed or a producer called Notify. NOT REALTIME SAFE
+     *
+     * @return true if woken by Notify, false if timed out.
+     */
+    bool Wait( std::chrono::milliseconds timeout, WakePolicy policy )
+    {
+        constexpr auto kPollInterval = std::chrono::milliseconds( 1 );
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while ( mPending.exchange( 0, std::memory_order_acquire ) == 0 ) {
+            const auto now = std::chrono::steady_clock::now();
+            if ( now >= deadline ) {
+                return false;
+            }
+
+#if defined( __linux__ )
+            static_assert( sizeof( std::atomic<std::uint32_t> ) == sizeof( std::uint32_t ),
+                           "The wake flag doubles as a futex word" );
+            if ( policy == WakePolicy::Futex ) {
+                const auto      remaining = std::chrono::duration_cast<std::chrono::nanoseconds>( deadline - now );
+                struct timespec relative {};
+                relative.tv_sec  = static_cast<time_t>( remaining.count() / 1000000000 );
+                relative.tv_nsec = static_cast<long>( remaining.count() % 1000000000 );
+                syscall( SYS_futex,
+                         reinterpret_cast<std::uint32_t*>( &mPending ),
+                         FUTEX_WAIT_PRIVATE,
+                         0,
+                         &relative,
+                         nullptr,
+                         0 );
+                continue;
+            }
+#else
+            (void) policy;
+#endif
+            std::this_thread::sleep_for( std::min<std::chrono::steady_clock::duration>( kPollInterval, deadline - now ) );
+        }
+        return true;
+    }
+
+private:
+    std::atomic<std::uint32_t> mPending{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#include <nmmintrin.h>
+#define RTLOG_CRC32C_X86 1
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+#include <arm_acle.h>
+#define RTLOG_CRC32C_ARM 1
+#endif
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+constexpr std::uint32_t kCrc32cPolynomial = 0x82f63b78; // Castagnoli, reflected
+
+constexpr std::array<std::uint32_t, 256> MakeCrc32cTable()
+{
+    std::array<std::uint32_t, 256> table{};
+    for ( std::uint32_t i = 0; i < 256; i++ ) {
+        std::uint32_t crc = i;
+        for ( int bit = 0; bit < 8; bit++ ) {
+            crc = ( crc >> 1 ) ^ ( ( crc & 1 ) != 0 ? kCrc32cPolynomial : 0 );
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto kCrc32cTable = MakeCrc32cTable();
+
+inline std::uint32_t Crc32cTable( std::uint32_t crc, const unsigned char* bytes, size_t numBytes )
+{
+    for ( size_t i = 0; i < numBytes; i++ ) {
+        crc = kCrc32cTable[( crc ^ bytes[i] ) & 0xff] ^ ( crc >> 8 );
+    }
+    return crc;
+}
+
+#if defined( RTLOG_CRC32C_X86 )
+
+__attribute__( ( target( "sse4.2" ) ) ) inline std::uint32_t
+Crc32cSse42( std::uint32_t crc, const unsigned char* bytes, size_t numBytes )
+{
+    std::uint64_t crc64 = crc;
+    for ( ; numBytes >= 8; bytes += 8, numBytes -= 8 ) {
+        std::uint64_t word;
+        std::memcpy( &word, bytes, sizeof( word ) );
+        crc64 = _mm_crc32_u64( crc64, word );
+    }
+    crc = static_cast<std::uint32_t>( crc64 );
+    for ( ; numBytes > 0; bytes++, numBytes-- ) {
+        crc = _mm_crc32_u8( crc, *bytes );
+    }
+    return crc;
+}
+
+inline bool HasSse42()
+{
+    static const bool hasSse42 = __builtin_cpu_supports( "sse4.2" );
+    return hasSse42;
+}
+
+#elif defined( RTLOG_CRC32C_ARM )
+
+inline std::uint32_t Crc32cArm( std::uint32_t crc, const unsigned char* bytes, size_t numBytes )
+{
+    for ( ; numBytes >= 8; bytes += 8, numBytes -= 8 ) {
+        std::uint64_t word;
+        std::memcpy( &word, bytes, sizeof( word ) );
+        crc = __crc32cd( crc, word );
+    }
+    for ( ; numBytes > 0; bytes++, numBytes-- ) {
+        crc = __crc32cb( crc, *bytes );
+    }
+    return crc;
+}
+
+#endif
+
+} // namespace detail
+
+/**
+ * @brief Returns the CRC32C (Castagnoli) of numBytes bytes at data. REALTIME SAFE
+ *
+ * Uses the crc32 instruction where the CPU has it (SSE4.2 on x86-64, checked once at run time, or the ARMv8 CRC
+ * extension when compiled for it), which checksums 8 bytes per instruction, and a byte-wise table otherwise.
+ *
+ * @param crc The CRC of the preceding bytes, to checksum data in several pieces; 0 to start.
+ */
+inline std::uint32_t Crc32c( const void* data, size_t numBytes, std::uint32_t crc = 0 )
+{
+    const auto* bytes = static_cast<const unsigned char*>( data );
+    crc               = ~crc;
+#if defined( RTLOG_CRC32C_X86 )
+    crc = detail::HasSse42() ? detail::Crc32cSse42( crc, bytes, numBytes ) : detail::Crc32cTable( crc, bytes, numBytes );
+#elif defined( RTLOG_CRC32C_ARM )
+    crc = detail::Crc32cArm( crc, bytes, numBytes );
+#else
+    crc = detail::Crc32cTable( crc, bytes, numBytes );
+#endif
+    return ~crc;
+}
+
+} // namespace rtlog
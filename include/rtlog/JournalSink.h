@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stb_sprintf.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+
+namespace rtlog
+{
+
+constexpr char kJournalSocketPath[] = "/run/systemd/journal/socket";
+
+/**
+ * @brief Adds fields to a journal entry, see JournalSink.
+ *
+ * Field names are upper case letters, digits and underscores, and must not start with an underscore, which journald
+ * keeps for the fields it adds itself. Values may hold any bytes.
+ */
+class JournalFieldWriter
+{
+public:
+    explicit JournalFieldWriter( std::vector<char>& out )
+    : mOut( out )
+    {
+    }
+
+    void Add( const char* name, const char* value, size_t valueLength )
+    {
+        const auto nameLength = std::strlen( name );
+        mOut.insert( mOut.end(), name, name + nameLength );
+        if ( std::memchr( value, '\n', valueLength ) == nullptr ) {
+            mOut.push_back( '=' );
+        }
+        else {
+            // Values with newlines are written as the name, a newline, and the length as 64 bits little endian
+            mOut.push_back( '\n' );
+            for ( int i = 0; i < 8; i++ ) {
+                mOut.push_back( static_cast<char>( static_cast<std::uint64_t>( valueLength ) >> ( 8 * i ) ) );
+            }
+        }
+        mOut.insert( mOut.end(), value, value + valueLength );
+        mOut.push_back( '\n' );
+    }
+
+    void Add( const char* name, const char* value )
+    {
+        Add( name, value, std::strlen( value ) );
+    }
+
+    void Add( const char* name, long long value )
+    {
+        char       digits[24];
+        const auto length = stbsp_snprintf( digits, sizeof( digits ), "%lld", value );
+        Add( name, digits, static_cast<size_t>( length ) );
+    }
+
+private:
+    std::vector<char>& mOut;
+};
+
+namespace detail
+{
+
+template <typename LogData, typename = void>
+struct HasJournalFieldsTrait : std::false_type
+{
+};
+
+template <typename LogData>
+struct HasJournalFieldsTrait<LogData,
+                             std::void_t<decltype( LogDataTraits<LogData>::JournalFields(
+                                 std::declval<const LogData&>(), std::declval<JournalFieldWriter&>() ) )>>
+: std::true_type
+{
+};
+
+} // namespace detail
+
+struct JournalSinkOptions
+{
+    std::string mSocketPath{ kJournalSocketPath };
+    std::string mIdentifier{}; // SYSLOG_IDENTIFIER of every entry, if set
+
+    // The syslog priority (0 emergency to 7 debug) of each level, from level 0; higher levels use the last one
+    std::vector<int> mLevelPriorities{ 7, 6, 4, 2 };
+
+    size_t mBatchSize = 64; // entries sent with one sendmmsg
+
+    std::chrono::microseconds mTimeBudget{ 2000 }; // the longest a Flush waits for journald to take more
+};
+
+/**
+ * @brief A print log function that sends records to systemd-journald over its native protocol, as structured entries.
+ *
+ * NOT REALTIME SAFE - use it on the thread that processes the log queue, e.g. with a LogProcessingThread.
+ *
+ * Logging to stdout under systemd copies every line through a pipe to journald, which then has only the text. This
+ * sink sends each record as one datagram to the journal socket, carrying MESSAGE, PRIORITY (from the level, see
+ * mLevelPriorities), RTLOG_LEVEL, RTLOG_REGION, RTLOG_THREAD and RTLOG_SEQUENCE_NUMBER, and whatever fields LogData
+ * maps itself to. Datagrams are gathered and sent mBatchSize at a time with one sendmmsg, and on Flush, which
+ * LogProcessingThread calls after each batch.
+ *
+ * To add fields of your own, give the LogDataTraits specialization of your LogData a JournalFields function:
+ *
+ * @code
+ *     static void JournalFields( const MyLogData& data, rtlog::JournalFieldWriter& fields )
+ *     {
+ *         fields.Add( "AUDIO_DEVICE", data.deviceName );
+ *         fields.Add( "CHANNEL", data.channel );
+ *     }
+ * @endcode
+ *
+ * Sends don't block. When journald falls behind, Flush waits for it for at most mTimeBudget, then drops the entries
+ * it could not send and counts them. If journald restarts, the sink connects to the new socket. An entry too large for
+ * a datagram is written to a sealed memfd and the descriptor sent instead, as sd_journal_sendv does.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ */
+template <typename LogData>
+class JournalSink
+{
+public:
+    explicit JournalSink( const JournalSinkOptions& options = {} )
+    : mOptions( options )
+    , mMessages( std::max<size_t>( options.mBatchSize, 1 ) )
+    , mIovecs( mMessages.size() )
+    {
+        if ( mOptions.mLevelPriorities.empty() ) {
+            mOptions.mLevelPriorities.assign( 1, 6 );
+        }
+        mDatagramEnds.reserve( mMessages.size() );
+        Connect();
+    }
+
+    ~JournalSink()
+    {
+        Flush();
+        if ( mFd >= 0 ) {
+            ::close( mFd );
+        }
+    }
+
+    JournalSink( const JournalSink& )            = delete;
+    JournalSink& operator=( const JournalSink& ) = delete;
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        const auto level    = LogDataTraits<LogData>::Level( record.mLogData );
+        const auto priority = mOptions.mLevelPriorities[std::min( static_cast<size_t>( std::max( level, 0 ) ),
+                                                                  mOptions.mLevelPriorities.size() - 1 )];
+
+        JournalFieldWriter fields( mBuffer );
+        fields.Add( "PRIORITY", priority );
+        if ( !mOptions.mIdentifier.empty() ) {
+            fields.Add( "SYSLOG_IDENTIFIER", mOptions.mIdentifier.data(), mOptions.mIdentifier.size() );
+        }
+        fields.Add( "RTLOG_LEVEL", level );
+        fields.Add( "RTLOG_REGION", detail::RegionOf( record.mLogData ) );
+        fields.Add( "RTLOG_THREAD", static_cast<long long>( record.mThreadId ) );
+        fields.Add( "RTLOG_SEQUENCE_NUMBER", static_cast<long long>( record.mSequenceNumber ) );
+        if constexpr ( detail::HasJournalFieldsTrait<LogData>::value ) {
+            LogDataTraits<LogData>::JournalFields( record.mLogData, fields );
+        }
+        fields.Add( "MESSAGE", record.mMessage, record.mMessageLength );
+
+        mDatagramEnds.push_back( mBuffer.size() );
+        if ( mDatagramEnds.size() == mMessages.size() ) {
+            Send( std::chrono::steady_clock::now() + mOptions.mTimeBudget );
+        }
+    }
+
+    /**
+     * @brief Sends the entries gathered so far, waiting at most mTimeBudget for journald to take them.
+     *
+     * @return false if some could not be sent. They are dropped either way.
+     */
+    bool Flush()
+    {
+        const auto numDropped = mNumDropped;
+        Send( std::chrono::steady_clock::now() + mOptions.mTimeBudget );
+        return mNumDropped == numDropped;
+    }
+
+    size_t NumSent() const
+    {
+        return mNumSent;
+    }
+
+    /**
+     * @brief Returns the number of entries dropped, because journald could not be reached or didn't keep up.
+     */
+    size_t NumDropped() const
+    {
+        return mNumDropped;
+    }
+
+    /**
+     * @brief Returns the number of sendmmsg calls made, usually one per mBatchSize entries.
+     */
+    size_t NumSendCalls() const
+    {
+        return mNumSendCalls;
+    }
+
+private:
+    bool Connect()
+    {
+        if ( mFd < 0 ) {
+            mFd = ::socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+        }
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        mOptions.mSocketPath.copy( address.sun_path, sizeof( address.sun_path ) - 1 );
+        return mFd >= 0 && ::connect( mFd, reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) ) == 0;
+    }
+
+    void Send( std::chrono::steady_clock::time_point deadline )
+    {
+        const auto numDatagrams = mDatagramEnds.size();
+        size_t     start        = 0;
+        for ( size_t i = 0; i < numDatagrams; i++ ) {
+            mIovecs[i].iov_base             = mBuffer.data() + start;
+            mIovecs[i].iov_len              = mDatagramEnds[i] - start;
+            mMessages[i]                    = {};
+            mMessages[i].msg_hdr.msg_iov    = &mIovecs[i];
+            mMessages[i].msg_hdr.msg_iovlen = 1;
+            start                           = mDatagramEnds[i];
+        }
+
+        bool   reconnected = false;
+        size_t numSent     = 0;
+        while ( numSent < numDatagrams ) {
+            const int result = ::sendmmsg( mFd,
+                                           mMessages.data() + numSent,
+                                           static_cast<unsigned int>( numDatagrams - numSent ),
+                                           MSG_DONTWAIT | MSG_NOSIGNAL );
+            mNumSendCalls++;
+            if ( result > 0 ) {
+                numSent += static_cast<size_t>( result );
+                mNumSent += static_cast<size_t>( result );
+                continue;
+            }
+            if ( result < 0 && errno == EINTR ) {
+                continue;
+            }
+            if ( result < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) && WaitUntilWritable( deadline ) ) {
+                continue;
+            }
+            if ( result < 0 && !reconnected
+                 && ( errno == ENOTCONN || errno == ECONNREFUSED || errno == ENOENT || errno == EDESTADDRREQ
+                      || errno == EBADF ) ) {
+                // journald restarted, or wasn't there when the sink was made, or there was no socket to make then
+                reconnected = true;
+                if ( Connect() ) {
+                    continue;
+                }
+            }
+            if ( result < 0 && errno == EMSGSIZE ) {
+                // Too large for one datagram; only this entry goes another way
+                if ( SendAsMemfd( mIovecs[numSent], deadline ) ) {
+                    mNumSent++;
+                }
+                else {
+                    mNumDropped++;
+                }
+                numSent++;
+                continue;
+            }
+            mNumDropped += numDatagrams - numSent;
+            break;
+        }
+
+        mBuffer.clear();
+        mDatagramEnds.clear();
+    }
+
+    // journald only reads memfds sealed against changes, so the entry can't be altered as it reads it
+    bool SendAsMemfd( const iovec& entry, std::chrono::steady_clock::time_point deadline )
+    {
+        const int memfd = ::memfd_create( "rtlog-journal-entry", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+        if ( memfd < 0 ) {
+            return false;
+        }
+
+        const auto* data     = static_cast<const char*>( entry.iov_base );
+        size_t      numBytes = 0;
+        while ( numBytes < entry.iov_len ) {
+            const auto numWritten = ::write( memfd, data + numBytes, entry.iov_len - numBytes );
+            if ( numWritten < 0 && errno != EINTR ) {
+                break;
+            }
+            numBytes += static_cast<size_t>( std::max<ssize_t>( numWritten, 0 ) );
+        }
+
+        bool sent = false;
+        if ( numBytes == entry.iov_len
+             && ::fcntl( memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL ) == 0 ) {
+            alignas( cmsghdr ) char control[CMSG_SPACE( sizeof( int ) )]{};
+            msghdr                  message{};
+            message.msg_control    = control;
+            message.msg_controllen = sizeof( control );
+
+            auto* header       = CMSG_FIRSTHDR( &message );
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type  = SCM_RIGHTS;
+            header->cmsg_len   = CMSG_LEN( sizeof( int ) );
+            std::memcpy( CMSG_DATA( header ), &memfd, sizeof( int ) );
+
+            while ( true ) {
+                const auto result = ::sendmsg( mFd, &message, MSG_DONTWAIT | MSG_NOSIGNAL );
+                if ( result >= 0 ) {
+                    sent = true;
+                    break;
+                }
+                const bool retry = errno == EINTR
+                                   || ( ( errno == EAGAIN || errno == EWOULDBLOCK ) && WaitUntilWritable( deadline ) );
+                if ( !retry ) {
+                    break;
+                }
+            }
+        }
+        ::close( memfd );
+        return sent;
+    }
+
+    bool WaitUntilWritable( std::chrono::steady_clock::time_point deadline )
+    {
+        const auto now      = std::chrono::steady_clock::now();
+        const auto timeLeft = std::chrono::ceil<std::chrono::milliseconds>( deadline - now );
+        if ( timeLeft.count() <= 0 ) {
+            return false;
+        }
+        pollfd fd{ mFd, POLLOUT, 0 };
+        return ::poll( &fd, 1, static_cast<int>( timeLeft.count() ) ) > 0;
+    }
+
+    JournalSinkOptions   mOptions{};
+    int                  mFd{ -1 };
+    std::vector<char>    mBuffer{};       // the datagrams gathered, back to back
+    std::vector<size_t>  mDatagramEnds{}; // where each of them ends in mBuffer
+    std::vector<mmsghdr> mMessages{};
+    std::vector<iovec>   mIovecs{};
+    size_t               mNumSent{};
+    size_t               mNumDropped{};
+    size_t               mNumSendCalls{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+/**
+ * Shed messages are counted separately for levels 0 to RTLOG_NUM_SHED_COUNTED_LEVELS - 1. Messages with a level
+ * outside that range are counted with the nearest level inside it.
+ */
+#ifndef RTLOG_NUM_SHED_COUNTED_LEVELS
+#define RTLOG_NUM_SHED_COUNTED_LEVELS 8
+#endif // RTLOG_NUM_SHED_COUNTED_LEVELS
+
+namespace rtlog
+{
+
+/**
+ * @brief One step of load shedding: once the queue is at least mFill full, messages below mMinLevel are dropped.
+ */
+struct LoadSheddingWatermark
+{
+    float mFill{};     // fraction of the queue in use, 0 to 1
+    int   mMinLevel{}; // messages with a level below this are dropped while this watermark is crossed
+};
+
+/**
+ * @brief Drops low level messages while a queue is filling up, so that there is still room for the important ones.
+ *
+ * Producers call ShouldShed with the level of the message they are about to log and how full their queue is. Once the
+ * fill crosses a watermark, messages below that watermark's minimum level are shed; the watermarks are crossed back
+ * one by one as the consumer catches up and the fill drops a hysteresis margin below them, so the level does not
+ * flap around a watermark. Shed messages are counted per level.
+ *
+ * The watermark that is currently crossed is shared by all producers, so one busy thread raises the level for every
+ * thread logging into the same queue. That is deliberate: they all compete for the same space.
+ *
+ * Logger::EnableLoadShedding uses this; you generally don't need it directly.
+ */
+class LoadShedder
+{
+public:
+    static constexpr size_t kMaxNumWatermarks = 4;
+
+    /**
+     * @brief Watermarks that suit the usual Debug, Info, Warning, Critical levels numbered from 0: Debug goes at half
+     * full, Info at three quarters full and Warning at 90% full. Critical messages are never shed.
+     */
+    static constexpr std::array<LoadSheddingWatermark, 3> kDefaultWatermarks{ {
+        { 0.5f, 1 },
+        { 0.75f, 2 },
+        { 0.9f, 3 },
+    } };
+
+    static constexpr float kDefaultHysteresis = 0.1f;
+
+    /**
+     * @brief Turns shedding on. REALTIME SAFE - but producers logging at the same time may see a mix of the old and
+     * new watermarks for a moment.
+     *
+     * @param watermarks Up to kMaxNumWatermarks watermarks, in increasing order of fill. Further ones are ignored.
+     * @param hysteresis How far the fill has to drop below a watermark before it is no longer considered crossed.
+     */
+    void Enable( std::initializer_list<LoadSheddingWatermark> watermarks, float hysteresis = kDefaultHysteresis )
+    {
+        Enable( watermarks.begin(), watermarks.end(), hysteresis );
+    }
+
+    template <typename Iterator>
+    void Enable( Iterator first, Iterator last, float hysteresis = kDefaultHysteresis )
+    {
+        mNumWatermarks.store( 0, std::memory_order_relaxed );
+        mStage.store( 0, std::memory_order_relaxed );
+
+        size_t numWatermarks = 0;
+        for ( ; first != last && numWatermarks < kMaxNumWatermarks; ++first, ++numWatermarks ) {
+            mFills[numWatermarks].store( ToPermille( first->mFill ), std::memory_order_relaxed );
+            mMinLevels[numWatermarks].store( first->mMinLevel, std::memory_order_relaxed );
+        }
+        mHysteresis.store( ToPermille( hysteresis ), std::memory_order_relaxed );
+        mNumWatermarks.store( numWatermarks, std::memory_order_release );
+    }
+
+    /**
+     * @brief Turns shedding off. REALTIME SAFE
+     */
+    void Disable()
+    {
+        mNumWatermarks.store( 0, std::memory_order_relaxed );
+        mStage.store( 0, std::memory_order_relaxed );
+    }
+
+    bool IsEnabled() const
+    {
+        return mNumWatermarks.load( std::memory_order_relaxed ) != 0;
+    }
+
+    /**
+     * @brief Updates the crossed watermark from the current fill, and decides whether a message should be dropped.
+     *
+     * REALTIME SAFE - wait-free
+     *
+     * @param level The level of the message, see LogDataTraits.
+     * @param used How much of the queue is in use, in any unit.
+     * @param capacity How much the queue holds, in the same unit.
+     * @return true if the message should be dropped. It has already been counted.
+     */
+    bool ShouldShed( int level, size_t used, size_t capacity )
+    {
+        const auto numWatermarks = mNumWatermarks.load( std::memory_order_acquire );
+        if ( numWatermarks == 0 || capacity == 0 ) {
+            return false;
+        }
+
+        const auto fill       = static_cast<std::uint32_t>( std::min( used, capacity ) * 1000 / capacity );
+        const auto hysteresis = mHysteresis.load( std::memory_order_relaxed );
+
+        const auto oldStage = std::min( mStage.load( std::memory_order_relaxed ), numWatermarks );
+        auto       stage    = oldStage;
+        while ( stage < numWatermarks && fill >= mFills[stage].load( std::memory_order_relaxed ) ) {
+            stage++;
+        }
+        while ( stage > 0 && fill + hysteresis < mFills[stage - 1].load( std::memory_order_relaxed ) ) {
+            stage--;
+        }
+        if ( stage != oldStage ) {
+            mStage.store( stage, std::memory_order_relaxed );
+        }
+
+        if ( stage == 0 || level >= mMinLevels[stage - 1].load( std::memory_order_relaxed ) ) {
+            return false;
+        }
+
+        mNumShed[CounterFor( level )].fetch_add( 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    /**
+     * @brief Returns the level below which messages are currently being shed, or INT_MIN if none are.
+     */
+    int CurrentMinLevel() const
+    {
+        const auto stage = std::min( mStage.load( std::memory_order_relaxed ),
+                                     mNumWatermarks.load( std::memory_order_relaxed ) );
+        return stage == 0 ? INT_MIN : mMinLevels[stage - 1].load( std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Returns the number of messages of the given level that were shed. See RTLOG_NUM_SHED_COUNTED_LEVELS.
+     */
+    std::uint64_t NumShed( int level ) const
+    {
+        return mNumShed[CounterFor( level )].load( std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Returns the number of messages that were shed, of all levels.
+     */
+    std::uint64_t NumShed() const
+    {
+        std::uint64_t total = 0;
+        for ( const auto& count : mNumShed ) {
+            total += count.load( std::memory_order_relaxed );
+        }
+        return total;
+    }
+
+private:
+    static std::uint32_t ToPermille( float fraction )
+    {
+        return static_cast<std::uint32_t>( std::clamp( fraction, 0.0f, 1.0f ) * 1000.0f + 0.5f );
+    }
+
+    static size_t CounterFor( int level )
+    {
+        return static_cast<size_t>( std::clamp( level, 0, RTLOG_NUM_SHED_COUNTED_LEVELS - 1 ) );
+    }
+
+    std::array<std::atomic<std::uint32_t>, kMaxNumWatermarks>             mFills{};
+    std::array<std::atomic<int>, kMaxNumWatermarks>                       mMinLevels{};
+    std::atomic<std::uint32_t>                                            mHysteresis{};
+    std::atomic<size_t>                                                   mNumWatermarks{};
+    std::atomic<size_t>                                                   mStage{};
+    std::array<std::atomic<std::uint64_t>, RTLOG_NUM_SHED_COUNTED_LEVELS> mNumShed{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+template <typename LogData, typename = void>
+struct HasLevelMember : std::false_type
+{
+};
+
+template <typename LogData>
+struct HasLevelMember<LogData, std::void_t<decltype( std::declval<const LogData&>().level )>> : std::true_type
+{
+};
+
+template <typename LogData, typename = void>
+struct HasRegionMember : std::false_type
+{
+};
+
+template <typename LogData>
+struct HasRegionMember<LogData, std::void_t<decltype( std::declval<const LogData&>().region )>> : std::true_type
+{
+};
+
+} // namespace detail
+
+/**
+ * @brief Tells rtlog how to read the fields it cares about out of your LogData.
+ *
+ * Features such as BacktraceBuffer need to know the level of a message, and binary logs also record its region. By
+ * default, if LogData has a member called `level` (an enum or an integer), it is used, with higher values meaning more
+ * severe, and likewise a member called `region`. Otherwise they are 0. To use something else, specialize this
+ * template for your type:
+ *
+ * @code
+ * template <>
+ * struct rtlog::LogDataTraits<MyLogData>
+ * {
+ *     static int Level( const MyLogData& data ) { return data.severity; }
+ *     static int Region( const MyLogData& data ) { return data.subsystem; }
+ * };
+ * @endcode
+ *
+ * Binary logs store LogData as raw bytes. To store it more compactly, also give the specialization a Pack function
+ * that writes at most sizeof( LogData ) bytes and returns how many it wrote, and an Unpack function that reverses it.
+ * Fields that Level and Region already return need not be packed again, as they are stored with every record anyway:
+ *
+ * @code
+ *     static size_t Pack( const MyLogData& data, unsigned char* out ) { out[0] = data.channel; return 1; }
+ *     static bool Unpack( const unsigned char* packed, size_t numBytes, MyLogData& data ) { ... }
+ * @endcode
+ *
+ * JournalSink also looks for a JournalFields function here, to send fields of LogData as journal fields.
+ */
+template <typename LogData, typename = void>
+struct LogDataTraits
+{
+    static int Level( [[maybe_unused]] const LogData& data )
+    {
+        if constexpr ( detail::HasLevelMember<LogData>::value ) {
+            return static_cast<int>( data.level );
+        }
+        else {
+            return 0;
+        }
+    }
+
+    static int Region( [[maybe_unused]] const LogData& data )
+    {
+        if constexpr ( detail::HasRegionMember<LogData>::value ) {
+            return static_cast<int>( data.region );
+        }
+        else {
+            return 0;
+        }
+    }
+};
+
+namespace detail
+{
+
+template <typename LogData, typename = void>
+struct HasRegionTrait : std::false_type
+{
+};
+
+template <typename LogData>
+struct HasRegionTrait<LogData, std::void_t<decltype( LogDataTraits<LogData>::Region( std::declval<const LogData&>() ) )>>
+: std::true_type
+{
+};
+
+template <typename LogData, typename = void>
+struct HasPackTrait : std::false_type
+{
+};
+
+template <typename LogData>
+struct HasPackTrait<
+    LogData,
+    std::void_t<decltype( LogDataTraits<LogData>::Pack( std::declval<const LogData&>(), std::declval<unsigned char*>() ) ),
+                decltype( LogDataTraits<LogData>::Unpack(
+                    std::declval<const unsigned char*>(), std::declval<size_t>(), std::declval<LogData&>() ) )>>
+: std::true_type
+{
+};
+
+// Writes the packed form of data to out, which has room for sizeof( LogData ) bytes, and returns its size
+template <typename LogData>
+size_t PackLogData( const LogData& data, unsigned char* out )
+{
+    if constexpr ( HasPackTrait<LogData>::value ) {
+        return LogDataTraits<LogData>::Pack( data, out );
+    }
+    else {
+        std::memcpy( out, &data, sizeof( LogData ) );
+        return sizeof( LogData );
+    }
+}
+
+template <typename LogData>
+bool UnpackLogData( const unsigned char* packed, size_t numBytes, LogData& data )
+{
+    if constexpr ( HasPackTrait<LogData>::value ) {
+        return LogDataTraits<LogData>::Unpack( packed, numBytes, data );
+    }
+    else {
+        if ( numBytes != sizeof( LogData ) ) {
+            return false;
+        }
+        std::memcpy( &data, packed, sizeof( LogData ) );
+        return true;
+    }
+}
+
+// The region of a message, or 0 for specializations of LogDataTraits written before Region was asked for
+template <typename LogData>
+int RegionOf( const LogData& data )
+{
+    if constexpr ( HasRegionTrait<LogData>::value ) {
+        return LogDataTraits<LogData>::Region( data );
+    }
+    else {
+        return 0;
+    }
+}
+
+} // namespace detail
+
+} // namespace rtlog
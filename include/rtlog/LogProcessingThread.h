@@ -1,16 +1,118 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <thread>
+#include <type_traits>
+
+#include "LogRecord.h"
 
 namespace rtlog
 {
+
+namespace detail
+{
+
+template <typename LoggerType, typename = void>
+struct CanWaitForWork : std::false_type
+{
+};
+
+template <typename LoggerType>
+struct CanWaitForWork<
+    LoggerType,
+    std::void_t<decltype( std::declval<LoggerType&>().WaitForWork( std::declval<std::chrono::milliseconds>() ) ),
+                decltype( std::declval<LoggerType&>().WakeConsumer() )>>
+: std::true_type
+{
+};
+
+} // namespace detail
+
+/**
+ * @brief Bounds and target for the wait time of a LogProcessingThread that adapts to how fast messages arrive.
+ */
+struct AdaptivePollInterval
+{
+    std::chrono::milliseconds mMin{ 1 };
+    std::chrono::milliseconds mMax{ 100 };
+    float                     mTargetFill{ 0.25f }; // the fraction of the queue that may fill up during one wait
+};
+
+/**
+ * @brief Picks how long to wait before processing the queue again, from how many messages the last run processed.
+ *
+ * The arrival rate is estimated from the number of messages processed and the time since the previous run. The
+ * estimate follows increases straight away, so a burst shortens the very next wait, and decays slowly, so a lull in
+ * the middle of busy traffic doesn't make the wait jump to the maximum. The next wait is the time it would take, at
+ * that rate, to fill the target fraction of the queue, clamped to the bounds.
+ */
+class AdaptivePollScheduler
+{
+public:
+    /**
+     * @param interval The bounds and target.
+     * @param queueCapacity The number of messages the queue holds.
+     */
+    AdaptivePollScheduler( const AdaptivePollInterval& interval, size_t queueCapacity )
+    : mInterval( interval )
+    , mQueueCapacity( queueCapacity )
+    {
+    }
+
+    /**
+     * @param numProcessed The number of messages the last run processed.
+     * @param sincePreviousRun The time between the start of the previous run and the start of the last one.
+     * @return std::chrono::milliseconds How long to wait before the next run.
+     */
+    std::chrono::milliseconds Next( size_t numProcessed, std::chrono::steady_clock::duration sincePreviousRun )
+    {
+        // The weight of the latest run when the rate is going down
+        constexpr double kDecay = 0.25;
+
+        const auto seconds = std::max( std::chrono::duration<double>( sincePreviousRun ).count(), 1e-6 );
+        const auto rate    = static_cast<double>( numProcessed ) / seconds;
+        mMessagesPerSecond = rate >= mMessagesPerSecond ? rate : kDecay * rate + ( 1.0 - kDecay ) * mMessagesPerSecond;
+
+        if ( mMessagesPerSecond <= 0.0 ) {
+            return mInterval.mMax;
+        }
+
+        const auto budget = static_cast<double>( mQueueCapacity ) * static_cast<double>( mInterval.mTargetFill );
+        const auto next   = std::chrono::duration<double, std::milli>( 1000.0 * budget / mMessagesPerSecond );
+        if ( next >= mInterval.mMax ) {
+            return mInterval.mMax;
+        }
+        return std::max( std::chrono::duration_cast<std::chrono::milliseconds>( next ), mInterval.mMin );
+    }
+
+    /**
+     * @brief Returns the current estimate of messages arriving per second.
+     */
+    double MessagesPerSecond() const
+    {
+        return mMessagesPerSecond;
+    }
+
+private:
+    AdaptivePollInterval mInterval{};
+    size_t               mQueueCapacity{};
+    double               mMessagesPerSecond{};
+};
+
 /**
  * @brief A class representing a log processing thread.
  *
  * This class represents a log processing thread that continuously dequeues log data from a LoggerType object and calls
  * a PrintLogFn object to print the log data. The wait time between each log processing iteration can be specified in
- * milliseconds.
+ * milliseconds. If the logger has WaitForWork and WakeConsumer (rtlog::Logger does, see Logger::EnableEarlyWake), the
+ * thread waits with them, so producers can wake it before the wait time is up and Stop doesn't have to wait it out.
+ * Instead of a fixed wait time, an AdaptivePollInterval can be given, in which case the wait time follows the rate at
+ * which messages arrive (see AdaptivePollScheduler).
+ *
+ * If the PrintLogFn has a Flush() member, as BinaryLogSink does, it is called after each processing iteration.
  *
  * @tparam LoggerType The type of the logger object to be used for log processing.
  * @tparam PrintLogFn The type of the print log function object.
@@ -47,6 +149,25 @@ public:
         mThread = std::thread( &LogProcessingThread::ThreadMain, this );
     }
 
+    /**
+     * @brief Constructs a new LogProcessingThread that adapts its wait time to the rate at which messages arrive.
+     *
+     * The logger must tell how many messages its queue holds with a static QueueCapacity(), as rtlog::Logger does.
+     *
+     * @param logger The logger object to be used for log processing.
+     * @param printFn The print log function object to be used to print the log data.
+     * @param pollInterval The bounds of the wait time, and how full the queue may get during a wait.
+     */
+    LogProcessingThread( LoggerType& logger, PrintLogFn& printFn, const AdaptivePollInterval& pollInterval )
+    : mPrintFn( printFn )
+    , mLogger( logger )
+    , mWaitTime( pollInterval.mMax )
+    , mScheduler( AdaptivePollScheduler( pollInterval, LoggerType::QueueCapacity() ) )
+    , mIsAdaptive( true )
+    {
+        mThread = std::thread( &LogProcessingThread::ThreadMain, this );
+    }
+
     ~LogProcessingThread()
     {
         if ( mThread.joinable() ) {
@@ -58,6 +179,18 @@ public:
     void Stop()
     {
         mShouldRun.store( false );
+        if constexpr ( detail::CanWaitForWork<LoggerType>::value ) {
+            mLogger.WakeConsumer();
+        }
+    }
+
+    /**
+     * @brief Returns how long the thread currently waits between runs; with an AdaptivePollInterval, the wait last
+     * picked by its AdaptivePollScheduler.
+     */
+    std::chrono::milliseconds WaitTime() const
+    {
+        return mWaitTime.load( std::memory_order_relaxed );
     }
 
 
@@ -69,23 +202,58 @@ public:
 private:
     void ThreadMain()
     {
+        auto previousRun = std::chrono::steady_clock::now();
+
         while ( mShouldRun.load() ) {
 
-            if ( mLogger.PrintAndClearLogQueue( mPrintFn ) == 0 ) {
-                std::this_thread::sleep_for( mWaitTime );
+            if ( mIsAdaptive ) {
+                const auto numProcessed = static_cast<size_t>( std::max( Drain(), 0 ) );
+                const auto now          = std::chrono::steady_clock::now();
+                mWaitTime.store( mScheduler.Next( numProcessed, now - previousRun ), std::memory_order_relaxed );
+                previousRun = now;
+                Wait();
+                continue;
+            }
+
+            if ( Drain() == 0 && Wait() ) {
+                continue;
             }
 
-            std::this_thread::sleep_for( mWaitTime );
+            Wait();
         }
 
-        mLogger.PrintAndClearLogQueue( mPrintFn );
+        Drain();
+    }
+
+    // Print functions that buffer, such as BinaryLogSink, get to write out (and commit) what they have after each run
+    int Drain()
+    {
+        const auto numProcessed = mLogger.PrintAndClearLogQueue( mPrintFn );
+        if constexpr ( detail::HasFlush<PrintLogFn>::value ) {
+            mPrintFn.Flush();
+        }
+        return numProcessed;
+    }
+
+    // Returns true if the logger woke us up early
+    bool Wait()
+    {
+        if constexpr ( detail::CanWaitForWork<LoggerType>::value ) {
+            return mLogger.WaitForWork( WaitTime() );
+        }
+        else {
+            std::this_thread::sleep_for( WaitTime() );
+            return false;
+        }
     }
 
-    PrintLogFn&               mPrintFn{};
-    LoggerType&               mLogger{};
-    std::thread               mThread{};
-    std::atomic<bool>         mShouldRun{ true };
-    std::chrono::milliseconds mWaitTime{};
+    PrintLogFn&                            mPrintFn{};
+    LoggerType&                            mLogger{};
+    std::thread                            mThread{};
+    std::atomic<bool>                      mShouldRun{ true };
+    std::atomic<std::chrono::milliseconds> mWaitTime{};
+    AdaptivePollScheduler                  mScheduler{ AdaptivePollInterval{}, 0 };
+    bool                                   mIsAdaptive{};
 };
 
 } // namespace rtlog
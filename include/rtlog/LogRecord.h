@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace rtlog
+{
+
+/**
+ * @brief Everything known about one message, as handed to a print log function that accepts it.
+ *
+ * PrintAndClearLogQueue calls your print log function as printLogFn( logData, sequenceNumber, "%s", message ). If the
+ * function can instead be called with a `const LogRecord<LogData>&`, that is preferred, which gives it the extra
+ * fields below. The record, and everything it points to, is only valid for the duration of the call.
+ */
+template <typename LogData>
+struct LogRecord
+{
+    const LogData& mLogData;
+    size_t         mSequenceNumber{};
+    const char*    mMessage{};       // null terminated
+    size_t         mMessageLength{}; // not including the null terminator
+    std::uint32_t  mThreadId{};      // see CurrentThreadId
+    void* const*   mStackFrames{};   // return addresses, see Logger::SetStackCaptureLevel and Symbolizer
+    size_t         mNumStackFrames{};
+};
+
+namespace detail
+{
+
+inline std::atomic<std::uint32_t>& NextThreadId()
+{
+    static std::atomic<std::uint32_t> nextThreadId{ 1 };
+    return nextThreadId;
+}
+
+template <typename PrintLogFn, typename = void>
+struct HasFlush : std::false_type
+{
+};
+
+template <typename PrintLogFn>
+struct HasFlush<PrintLogFn, std::void_t<decltype( std::declval<PrintLogFn&>().Flush() )>> : std::true_type
+{
+};
+
+} // namespace detail
+
+/**
+ * @brief Returns a small number identifying the calling thread, unique for the life of the process. Never 0.
+ *
+ * REALTIME SAFE
+ */
+inline std::uint32_t CurrentThreadId()
+{
+    static thread_local const std::uint32_t threadId = detail::NextThreadId().fetch_add( 1 );
+    return threadId;
+}
+
+/**
+ * @brief Hands a record to printLogFn in whichever of the two forms it accepts.
+ */
+template <typename PrintLogFn, typename LogData>
+void PrintLogRecord( PrintLogFn& printLogFn, const LogRecord<LogData>& record )
+{
+    if constexpr ( std::is_invocable<PrintLogFn&, const LogRecord<LogData>&>::value ) {
+        printLogFn( record );
+    }
+    else {
+        printLogFn( record.mLogData, record.mSequenceNumber, "%s", record.mMessage );
+    }
+}
+
+} // namespace rtlog
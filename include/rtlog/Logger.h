@@ -1,14 +1,43 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <stb_sprintf.h>
+#include <type_traits>
+#include <vector>
 
 #include <boost/lockfree/spsc_queue.hpp>
 
+#include "ConsumerWakeup.h"
+#include "LoadShedding.h"
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "MpscByteRing.h"
+#include "PerCpuLanes.h"
+#include "StackCapture.h"
+#include "ThreadLaneRegistry.h"
+
 #ifdef RTLOG_USE_FMTLIB
 #include <fmt/format.h>
 #endif // RTLOG_USE_FMTLIB
 
+/**
+ * The most records one PrintAndClearLogQueue thread claims at a time from a
+ * QueuePolicy::MultipleProducerMultipleConsumer logger. Larger runs mean fewer claims, smaller ones spread bursts over
+ * more threads.
+ */
+#ifndef RTLOG_RECORDS_PER_CLAIM
+#define RTLOG_RECORDS_PER_CLAIM 64
+#endif // RTLOG_RECORDS_PER_CLAIM
+
 namespace rtlog
 {
 
@@ -18,6 +47,50 @@ enum class Status
 
     Error_QueueFull        = 1,
     Error_MessageTruncated = 2,
+    Error_MessageShed      = 3,
+};
+
+/**
+ * @brief Selects the queue a Logger is built on.
+ */
+enum class QueuePolicy
+{
+    /** A single thread calls Log, a single thread calls PrintAndClearLogQueue. Fixed size records. */
+    SingleProducerSingleConsumer,
+
+    /**
+     * Any number of threads call Log, a single thread calls PrintAndClearLogQueue. Records are packed into a byte
+     * ring (see MpscByteRing) and only take up as much space as their message needs.
+     */
+    MultipleProducerSingleConsumer,
+
+    /**
+     * Any number of threads call Log, a single thread calls PrintAndClearLogQueue. Each CPU gets its own byte ring
+     * (see PerCpuLanes), so memory scales with cores instead of threads and producers on different CPUs never share a
+     * cache line. On Linux x86-64 and aarch64 producers claim space with restartable sequences rather than atomics.
+     * Each PrintAndClearLogQueue merges the lanes back into sequence number order, among the messages already in them;
+     * one still being written when it runs comes out of the next call.
+     */
+    PerCpuMultipleProducerSingleConsumer,
+
+    /**
+     * Any number of threads call Log, a single thread calls PrintAndClearLogQueue. Each thread is handed its own single
+     * producer queue from a pool of RTLOG_MAX_NUM_THREAD_LANES on its first Log (see ThreadLaneRegistry), and the queue
+     * goes back into the pool once the thread has exited and its messages have been processed. Call
+     * Logger::WarmUpCurrentThread from real-time threads before they start logging. Each PrintAndClearLogQueue merges
+     * the queues back into sequence number order, among the messages already in them; one still being written when it
+     * runs comes out of the next call.
+     */
+    PerThreadSingleProducerSingleConsumer,
+
+    /**
+     * Any number of threads call Log, and any number of threads call PrintAndClearLogQueue at the same time, for
+     * loggers whose print log function is too slow for one thread. Built on the same byte ring as
+     * MultipleProducerSingleConsumer; each PrintAndClearLogQueue claims runs of up to RTLOG_RECORDS_PER_CLAIM records
+     * and processes them in order (see MpscByteRing::ReadChunk), but runs are processed in parallel, so messages only
+     * come out in sequence number order within each thread's print log function. Give every thread its own.
+     */
+    MultipleProducerMultipleConsumer,
 };
 
 /**
@@ -27,8 +100,10 @@ enum class Status
  * For instance: The log level, the log region, the file name, the line number, etc.
  * See examples or tests for some ideas.
  *
- * TODO: Currently is built on a single input/single output queue. Do not call Log or PrintAndClearLogQueue from
- * multiple threads.
+ * By default this is built on a single input/single output queue. Do not call Log or PrintAndClearLogQueue from
+ * multiple threads, unless you pick QueuePolicy::MultipleProducerSingleConsumer, which allows Log to be called from
+ * any number of threads. PrintAndClearLogQueue must always be called from one thread at a time, except with
+ * QueuePolicy::MultipleProducerMultipleConsumer.
  *
  * @tparam LogData The type of the data to be logged.
  * @tparam MaxNumMessages The maximum number of messages that can be enqueud at once. If this number is exceeded, the
@@ -37,8 +112,15 @@ enum class Status
  * enqueued
  * @tparam SequenceNumber This number is incremented when the message is enqueued. It is assumed that your non-realtime
  * logger increments and logs it on Log.
+ * @tparam QPolicy The queue the messages are passed through, see QueuePolicy. With the byte ring based policies
+ * LogData must be trivially copyable, and MaxNumMessages is the number of maximum length messages that fit (per CPU
+ * for QueuePolicy::PerCpuMultipleProducerSingleConsumer); more fit if they are shorter.
  */
-template <typename LogData, size_t MaxNumMessages, size_t MaxMessageLength, std::atomic<std::size_t>& SequenceNumber>
+template <typename LogData,
+          size_t                    MaxNumMessages,
+          size_t                    MaxMessageLength,
+          std::atomic<std::size_t>& SequenceNumber,
+          QueuePolicy               QPolicy = QueuePolicy::SingleProducerSingleConsumer>
 class Logger
 {
 public:
@@ -60,34 +142,62 @@ public:
      *
      * This function attempts to enqueue the log message regardless of whether the message was truncated due to being
      * too long for the buffer. If the message queue is full, the function returns `Status::Error_QueueFull`. If the
-     * message was truncated, the function returns `Status::Error_MessageTruncated`. Otherwise, it returns
+     * message was truncated, the function returns `Status::Error_MessageTruncated`. If the message was dropped by load
+     * shedding (see EnableLoadShedding), the function returns `Status::Error_MessageShed`. Otherwise, it returns
      * `Status::Success`.
      */
     Status Log( LogData&& inputData, const char* format, ... ) __attribute__( ( format( printf, 3, 4 ) ) )
     {
+        va_list args;
+        va_start( args, format );
+        const auto retVal = LogV( std::forward<LogData>( inputData ), format, args );
+        va_end( args );
+        return retVal;
+    }
+
+    /**
+     * @brief The same as Log, taking a va_list so that it can be called from your own variadic functions.
+     *
+     * REALTIME SAFE - except on systems where va_args allocates
+     */
+    Status LogV( LogData&& inputData, const char* format, va_list args ) __attribute__( ( format( printf, 3, 0 ) ) )
+    {
+        if ( ShedUnderLoad( inputData ) ) {
+            return Status::Error_MessageShed;
+        }
+
         auto retVal = Status::Success;
 
         InternalLogData dataToQueue;
         dataToQueue.mLogData        = std::forward<LogData>( inputData );
         dataToQueue.mSequenceNumber = ++SequenceNumber;
+        dataToQueue.mThreadId       = CurrentThreadId();
+#if RTLOG_MAX_STACK_FRAMES > 0
+        if ( LogDataTraits<LogData>::Level( dataToQueue.mLogData )
+             >= mStackCaptureLevel.load( std::memory_order_relaxed ) ) {
+            dataToQueue.mNumStackFrames = static_cast<std::uint32_t>(
+                CaptureStackFrames( dataToQueue.mStackFrames.data(), dataToQueue.mStackFrames.size() ) );
+        }
+#endif
 
-        va_list args;
-        va_start( args, format );
         const auto charsPrinted =
             stbsp_vsnprintf( dataToQueue.mMessage.data(), dataToQueue.mMessage.size(), format, args );
-        va_end( args );
 
-        if ( charsPrinted < 0 || static_cast<size_t>( charsPrinted ) >= dataToQueue.mMessage.size() ) {
-            retVal = Status::Error_MessageTruncated;
+        auto messageLength = static_cast<size_t>( charsPrinted );
+        if ( charsPrinted < 0 || messageLength >= dataToQueue.mMessage.size() ) {
+            retVal        = Status::Error_MessageTruncated;
+            messageLength = charsPrinted < 0 ? 0 : dataToQueue.mMessage.size() - 1;
         }
 
         // Even if the message was truncated, we still try to enqueue it to minimize data loss
-        const bool dataWasEnqueued = mQueue.push( dataToQueue );
+        const bool dataWasEnqueued = Enqueue( dataToQueue, messageLength );
 
         if ( !dataWasEnqueued ) {
             retVal = Status::Error_QueueFull;
         }
 
+        WakeConsumerIfFilling();
+
         return retVal;
     }
 
@@ -112,49 +222,224 @@ public:
      *
      * This function attempts to enqueue the log message regardless of whether the message was truncated due to being
      * too long for the buffer. If the message queue is full, the function returns `Status::Error_QueueFull`. If the
-     * message was truncated, the function returns `Status::Error_MessageTruncated`. Otherwise, it returns
+     * message was truncated, the function returns `Status::Error_MessageTruncated`. If the message was dropped by load
+     * shedding (see EnableLoadShedding), the function returns `Status::Error_MessageShed`. Otherwise, it returns
      * `Status::Success`.
      */
     template <typename... T>
     Status LogFmt( LogData&& inputData, fmt::format_string<T...> fmtString, T&&... args )
     {
+        if ( ShedUnderLoad( inputData ) ) {
+            return Status::Error_MessageShed;
+        }
+
         auto retVal = Status::Success;
 
         InternalLogData dataToQueue;
         dataToQueue.mLogData        = std::forward<LogData>( inputData );
         dataToQueue.mSequenceNumber = ++SequenceNumber;
+        dataToQueue.mThreadId       = CurrentThreadId();
+#if RTLOG_MAX_STACK_FRAMES > 0
+        if ( LogDataTraits<LogData>::Level( dataToQueue.mLogData )
+             >= mStackCaptureLevel.load( std::memory_order_relaxed ) ) {
+            dataToQueue.mNumStackFrames = static_cast<std::uint32_t>(
+                CaptureStackFrames( dataToQueue.mStackFrames.data(), dataToQueue.mStackFrames.size() ) );
+        }
+#endif
 
         const auto maxMessageLength = dataToQueue.mMessage.size() - 1; // Account for null terminator
 
         const auto result = fmt::format_to_n( dataToQueue.mMessage.data(), maxMessageLength, fmtString, args... );
 
+        auto messageLength = result.size;
         if ( result.size >= dataToQueue.mMessage.size() ) {
-            dataToQueue.mMessage[dataToQueue.mMessage.size() - 1] = '\0';
-            retVal                                                = Status::Error_MessageTruncated;
-        }
-        else {
-            dataToQueue.mMessage[result.size] = '\0';
+            messageLength = maxMessageLength;
+            retVal        = Status::Error_MessageTruncated;
         }
+        dataToQueue.mMessage[messageLength] = '\0';
 
         // Even if the message was truncated, we still try to enqueue it to minimize data loss
-        const bool dataWasEnqueued = mQueue.try_enqueue( dataToQueue );
+        const bool dataWasEnqueued = Enqueue( dataToQueue, messageLength );
 
         if ( !dataWasEnqueued ) {
             retVal = Status::Error_QueueFull;
         }
 
+        WakeConsumerIfFilling();
+
         return retVal;
     };
 
 #endif // RTLOG_USE_FMTLIB
 
+    /**
+     * @brief Prepares the calling thread to log without allocating.
+     *
+     * NOT REALTIME SAFE
+     *
+     * With QueuePolicy::PerThreadSingleProducerSingleConsumer this claims the thread's queue up front. It also looks up
+     * the thread's stack bounds for stack capture (see SetStackCaptureLevel). Call it from every real-time thread
+     * before it enters its real-time loop.
+     *
+     * @return true if the thread is ready to log, false if no more per-thread queues are available.
+     */
+    bool WarmUpCurrentThread()
+    {
+        WarmUpStackCapture();
+
+        if constexpr ( QPolicy == QueuePolicy::PerThreadSingleProducerSingleConsumer ) {
+            return mQueue->WarmUpCurrentThread();
+        }
+        else {
+            return true;
+        }
+    }
+
+    /**
+     * @brief Records a stack trace with every message at or above level.
+     *
+     * REALTIME SAFE
+     *
+     * Stack traces are captured on the logging thread by walking frame pointers (see CaptureStackFrames), up to
+     * RTLOG_MAX_STACK_FRAMES deep, and handed to print log functions that accept a LogRecord. Turn them into names
+     * with Symbolizer on the processing thread. Levels are read with LogDataTraits. Off by default. Only threads that
+     * have called WarmUpCurrentThread (or WarmUpStackCapture) capture stacks; the others log without one.
+     *
+     * Does nothing unless RTLOG_MAX_STACK_FRAMES is defined above 0. For complete traces, build with
+     * -fno-omit-frame-pointer.
+     */
+    void SetStackCaptureLevel( int level )
+    {
+        mStackCaptureLevel.store( level, std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Turns stack capture off again.
+     */
+    void DisableStackCapture()
+    {
+        SetStackCaptureLevel( INT_MAX );
+    }
+
+    /**
+     * @brief Drops low level messages while the queue is filling up, to keep room for the important ones.
+     *
+     * REALTIME SAFE
+     *
+     * Each Log checks how full the queue it is about to write to is. As the fill crosses the watermarks, the minimum
+     * level of the messages that are kept goes up; it comes back down as PrintAndClearLogQueue catches up. Dropped
+     * messages return Status::Error_MessageShed, don't take a sequence number and are counted per level, see
+     * NumShedMessages. Levels are read with LogDataTraits. Off by default.
+     *
+     * Without arguments, LoadShedder::kDefaultWatermarks are used, which suit levels numbered Debug = 0, Info,
+     * Warning, Critical.
+     */
+    void EnableLoadShedding( std::initializer_list<LoadSheddingWatermark> watermarks,
+                             float                                        hysteresis = LoadShedder::kDefaultHysteresis )
+    {
+        mLoadShedder.Enable( watermarks, hysteresis );
+    }
+
+    void EnableLoadShedding()
+    {
+        mLoadShedder.Enable( LoadShedder::kDefaultWatermarks.begin(), LoadShedder::kDefaultWatermarks.end() );
+    }
+
+    void DisableLoadShedding()
+    {
+        mLoadShedder.Disable();
+    }
+
+    /**
+     * @brief Returns the number of messages of the given level dropped by load shedding.
+     */
+    std::uint64_t NumShedMessages( int level ) const
+    {
+        return mLoadShedder.NumShed( level );
+    }
+
+    /**
+     * @brief Returns the number of messages of any level dropped by load shedding.
+     */
+    std::uint64_t NumShedMessages() const
+    {
+        return mLoadShedder.NumShed();
+    }
+
+    /**
+     * @brief Wakes the processing thread early once the queue is filling up, instead of waiting for its next tick.
+     *
+     * REALTIME SAFE
+     *
+     * After each successful Log, the queue's fill is compared against fill. Once it is at or above it, the consumer
+     * waiting in WaitForWork (LogProcessingThread does) is woken as described by policy. This lets you size the queue
+     * for typical bursts rather than for everything that could arrive in one wait interval. Off by default.
+     *
+     * @param fill The fraction of the queue in use, 0 to 1, at which to wake the consumer.
+     * @param policy How to wake the consumer, see WakePolicy.
+     */
+    void EnableEarlyWake( float fill = 0.5f, WakePolicy policy = WakePolicy::Futex )
+    {
+        mWakePolicy.store( policy, std::memory_order_relaxed );
+        mWakeFillPermille.store( static_cast<std::uint32_t>( std::max( fill, 0.001f ) * 1000.0f + 0.5f ),
+                                 std::memory_order_relaxed );
+    }
+
+    void DisableEarlyWake()
+    {
+        mWakeFillPermille.store( 0, std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Wakes the consumer waiting in WaitForWork right away, as described by the policy given to
+     * EnableEarlyWake. REALTIME SAFE, as far as that policy is.
+     */
+    void WakeConsumer()
+    {
+        mWakeupTarget->Notify( mWakePolicy.load( std::memory_order_relaxed ) );
+    }
+
+    /**
+     * @brief Waits for timeout, or less if a producer wakes the consumer early. See EnableEarlyWake.
+     *
+     * NOT REALTIME SAFE - call it from the thread that calls PrintAndClearLogQueue
+     *
+     * When several threads wait, one of them is woken early; the others wait until their timeout.
+     *
+     * @return true if woken early, false if timed out.
+     */
+    bool WaitForWork( std::chrono::milliseconds timeout )
+    {
+        return mWakeupTarget->Wait( timeout, mWakePolicy.load( std::memory_order_relaxed ) );
+    }
+
+    /**
+     * @brief Makes WakeConsumer and WaitForWork go through wakeup rather than the logger's own, so that one consumer
+     * can wait on several loggers (PriorityLogger does). wakeup must outlive the logger.
+     *
+     * NOT REALTIME SAFE - call it before any thread logs or waits
+     */
+    void UseConsumerWakeup( ConsumerWakeup& wakeup )
+    {
+        mWakeupTarget = &wakeup;
+    }
+
+    /**
+     * @brief Returns the number of messages the queue holds, see MaxNumMessages.
+     */
+    static constexpr size_t QueueCapacity()
+    {
+        return MaxNumMessages;
+    }
+
     /**
      * @brief Processes and prints all queued log data.
      *
      * ONLY REALTIME SAFE IF printLogFn IS REALTIME SAFE! - not generally the case
      *
      * This function processes and prints all queued log data. It takes a PrintLogFn object as input, which is used to
-     * print the log data.
+     * print the log data. It is called as printLogFn( logData, sequenceNumber, "%s", message ), or, if it accepts one,
+     * with a `const LogRecord<LogData>&` which carries a few more details about the message.
      *
      * See tests and examples for some ideas on how to use this function. Using ctad you often don't need to specify the
      * template parameter.
@@ -168,10 +453,55 @@ public:
     {
         int numProcessed = 0;
 
-        InternalLogData value;
-        while ( mQueue.pop( value ) ) {
-            printLogFn( value.mLogData, value.mSequenceNumber, "%s", value.mMessage.data() );
-            numProcessed++;
+        if constexpr ( QPolicy == QueuePolicy::SingleProducerSingleConsumer ) {
+            InternalLogData value;
+            while ( mQueue.pop( value ) ) {
+                Print( printLogFn, value );
+                numProcessed++;
+            }
+        }
+        else if constexpr ( QPolicy == QueuePolicy::PerThreadSingleProducerSingleConsumer ) {
+            numProcessed = mQueue->DrainLanes( [&printLogFn]( const std::vector<ThreadLane*>& lanes ) {
+                int numDrained = 0;
+                while ( true ) {
+                    ThreadLane* oldest = nullptr;
+                    for ( auto* lane : lanes ) {
+                        if ( lane->mQueue.read_available() > 0
+                             && ( oldest == nullptr
+                                  || lane->mQueue.front().mSequenceNumber
+                                         < oldest->mQueue.front().mSequenceNumber ) ) {
+                            oldest = lane;
+                        }
+                    }
+                    if ( oldest == nullptr ) {
+                        return numDrained;
+                    }
+
+                    const auto& value = oldest->mQueue.front();
+                    Print( printLogFn, value );
+                    oldest->mQueue.pop();
+                    numDrained++;
+                }
+            } );
+        }
+        else {
+            InternalLogData value;
+            auto            readFn = [&]( const void* data, size_t numBytes ) {
+                Deserialize( value, data, numBytes );
+                Print( printLogFn, value );
+            };
+
+            if constexpr ( QPolicy == QueuePolicy::MultipleProducerSingleConsumer ) {
+                numProcessed = static_cast<int>( mQueue->ReadAll( readFn ) );
+            }
+            else if constexpr ( QPolicy == QueuePolicy::MultipleProducerMultipleConsumer ) {
+                while ( const auto numRead = mQueue->ReadChunk( RTLOG_RECORDS_PER_CLAIM, readFn ) ) {
+                    numProcessed += static_cast<int>( numRead );
+                }
+            }
+            else {
+                numProcessed = static_cast<int>( mQueue->ReadAll( &SequenceNumberOf, readFn ) );
+            }
         }
 
         return numProcessed;
@@ -180,12 +510,172 @@ public:
 private:
     struct InternalLogData
     {
-        LogData                            mLogData{};
-        size_t                             mSequenceNumber{};
-        std::array<char, MaxMessageLength> mMessage{};
+        LogData                                   mLogData{};
+        size_t                                    mSequenceNumber{};
+        std::uint32_t                             mThreadId{};
+        std::uint32_t                             mMessageLength{};
+        std::uint32_t                             mNumStackFrames{};
+        std::array<void*, RTLOG_MAX_STACK_FRAMES> mStackFrames{};
+        std::array<char, MaxMessageLength>        mMessage{};
+    };
+
+    template <typename PrintLogFn>
+    static void Print( PrintLogFn& printLogFn, const InternalLogData& value )
+    {
+        const LogRecord<LogData> record{ value.mLogData,
+                                         value.mSequenceNumber,
+                                         value.mMessage.data(),
+                                         value.mMessageLength,
+                                         value.mThreadId,
+                                         value.mStackFrames.data(),
+                                         value.mNumStackFrames };
+        PrintLogRecord( printLogFn, record );
+    }
+
+    // In the byte ring a record is everything up to the stack frames, followed by only the stack frames that were
+    // captured and the characters that were printed
+    static constexpr size_t kRecordHeaderBytes = offsetof( InternalLogData, mStackFrames );
+
+    struct QueueUsage
+    {
+        size_t mUsed{};
+        size_t mCapacity{};
     };
 
-    boost::lockfree::spsc_queue<InternalLogData> mQueue{ MaxNumMessages };
+    // How full the queue the calling thread writes to is, as cheaply as the queue can tell
+    QueueUsage ProducerQueueUsage()
+    {
+        if constexpr ( QPolicy == QueuePolicy::SingleProducerSingleConsumer ) {
+            return { MaxNumMessages - mQueue.write_available(), MaxNumMessages };
+        }
+        else if constexpr ( QPolicy == QueuePolicy::PerThreadSingleProducerSingleConsumer ) {
+            auto* lane = mQueue->CurrentThreadLane();
+            return { lane != nullptr ? MaxNumMessages - lane->mQueue.write_available() : 0, MaxNumMessages };
+        }
+        else if constexpr ( QPolicy == QueuePolicy::MultipleProducerSingleConsumer
+                            || QPolicy == QueuePolicy::MultipleProducerMultipleConsumer ) {
+            return { mQueue->SizeApprox(), MpscQueue::Capacity() };
+        }
+        else {
+            return { mQueue->CurrentLaneSizeApprox(), PerCpuQueue::Capacity() };
+        }
+    }
+
+    bool ShedUnderLoad( const LogData& data )
+    {
+        if ( !mLoadShedder.IsEnabled() ) {
+            return false;
+        }
+        const auto usage = ProducerQueueUsage();
+        return mLoadShedder.ShouldShed( LogDataTraits<LogData>::Level( data ), usage.mUsed, usage.mCapacity );
+    }
+
+    void WakeConsumerIfFilling()
+    {
+        const auto wakeFill = mWakeFillPermille.load( std::memory_order_relaxed );
+        if ( wakeFill == 0 ) {
+            return;
+        }
+        const auto usage = ProducerQueueUsage();
+        if ( usage.mUsed * 1000 >= usage.mCapacity * wakeFill ) {
+            WakeConsumer();
+        }
+    }
+
+    bool Enqueue( InternalLogData& dataToQueue, size_t messageLength )
+    {
+        dataToQueue.mMessageLength = static_cast<std::uint32_t>( messageLength );
+
+        if constexpr ( QPolicy == QueuePolicy::SingleProducerSingleConsumer ) {
+            (void) messageLength;
+            return mQueue.push( dataToQueue );
+        }
+        else if constexpr ( QPolicy == QueuePolicy::PerThreadSingleProducerSingleConsumer ) {
+            (void) messageLength;
+            auto* lane = mQueue->CurrentThreadLane();
+            return lane != nullptr && lane->mQueue.push( dataToQueue );
+        }
+        else {
+            return mQueue->TryWrite(
+                { { &dataToQueue, kRecordHeaderBytes },
+                  { dataToQueue.mStackFrames.data(), dataToQueue.mNumStackFrames * sizeof( void* ) },
+                  { dataToQueue.mMessage.data(), messageLength } } );
+        }
+    }
+
+    static void Deserialize( InternalLogData& value, const void* data, size_t numBytes )
+    {
+        const auto* bytes = static_cast<const char*>( data );
+        std::memcpy( static_cast<void*>( &value ), bytes, kRecordHeaderBytes );
+
+        const auto stackBytes = value.mNumStackFrames * sizeof( void* );
+#if RTLOG_MAX_STACK_FRAMES > 0
+        std::memcpy( value.mStackFrames.data(), bytes + kRecordHeaderBytes, stackBytes );
+#endif
+
+        const auto messageLength = numBytes - kRecordHeaderBytes - stackBytes;
+        std::memcpy( value.mMessage.data(), bytes + kRecordHeaderBytes + stackBytes, messageLength );
+        value.mMessage[messageLength] = '\0';
+    }
+
+    static std::uint64_t SequenceNumberOf( const void* data, size_t )
+    {
+        size_t sequenceNumber{};
+        std::memcpy( &sequenceNumber,
+                     static_cast<const char*>( data ) + offsetof( InternalLogData, mSequenceNumber ),
+                     sizeof( sequenceNumber ) );
+        return sequenceNumber;
+    }
+
+    using MpscQueue   = MpscByteRing<MaxNumMessages * sizeof( InternalLogData ), sizeof( InternalLogData )>;
+    using PerCpuQueue = PerCpuLanes<MaxNumMessages * sizeof( InternalLogData ), sizeof( InternalLogData )>;
+
+    struct ThreadLane
+    {
+        bool IsEmpty() const
+        {
+            return mQueue.read_available() == 0;
+        }
+
+        boost::lockfree::spsc_queue<InternalLogData> mQueue{ MaxNumMessages };
+    };
+
+    using PerThreadQueue = ThreadLaneRegistry<ThreadLane, RTLOG_MAX_NUM_THREAD_LANES>;
+
+    static_assert( QPolicy == QueuePolicy::SingleProducerSingleConsumer
+                       || QPolicy == QueuePolicy::PerThreadSingleProducerSingleConsumer
+                       || ( std::is_trivially_copyable<LogData>::value
+                            && std::is_standard_layout<InternalLogData>::value ),
+                   "The byte ring based queue policies copy LogData as bytes" );
+
+    using Queue = typename std::conditional<
+        QPolicy == QueuePolicy::SingleProducerSingleConsumer,
+        boost::lockfree::spsc_queue<InternalLogData>,
+        typename std::conditional<
+            QPolicy == QueuePolicy::MultipleProducerSingleConsumer
+                || QPolicy == QueuePolicy::MultipleProducerMultipleConsumer,
+            std::unique_ptr<MpscQueue>,
+            typename std::conditional<QPolicy == QueuePolicy::PerCpuMultipleProducerSingleConsumer,
+                                      std::unique_ptr<PerCpuQueue>,
+                                      std::unique_ptr<PerThreadQueue>>::type>::type>::type;
+
+    Queue                      mQueue = MakeQueue();
+    std::atomic<int>           mStackCaptureLevel{ INT_MAX };
+    LoadShedder                mLoadShedder{};
+    ConsumerWakeup             mWakeup{};
+    ConsumerWakeup*            mWakeupTarget{ &mWakeup };
+    std::atomic<std::uint32_t> mWakeFillPermille{};
+    std::atomic<WakePolicy>    mWakePolicy{ WakePolicy::Futex };
+
+    static Queue MakeQueue()
+    {
+        if constexpr ( QPolicy == QueuePolicy::SingleProducerSingleConsumer ) {
+            return Queue{ MaxNumMessages };
+        }
+        else {
+            return std::make_unique<typename Queue::element_type>();
+        }
+    }
 };
 
 } // namespace rtlog
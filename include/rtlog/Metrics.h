@@ -0,0 +1,402 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "LogRecord.h"
+#include "ThreadLaneRegistry.h"
+
+namespace rtlog
+{
+
+enum class MetricType
+{
+    Counter,   // a running total, only ever increases
+    Gauge,     // the last value set, from any thread
+    Histogram, // the distribution of recorded values, in power of two buckets
+};
+
+/**
+ * @brief A handle to a metric, returned when it is added to a MetricsRegistry.
+ */
+struct MetricId
+{
+    size_t mIndex{};
+};
+
+/**
+ * @brief The aggregated state of one metric, as handed out by MetricsRegistry::Collect.
+ */
+struct MetricSnapshot
+{
+    static constexpr size_t kNumHistogramBuckets = 64;
+
+    const char*   mName{};
+    MetricType    mType{};
+    std::uint64_t mCount{}; // Counter: the total. Histogram: the number of values recorded
+    std::uint64_t mSum{};   // Histogram: the sum of all values recorded
+    double        mValue{}; // Gauge: the last value set
+
+    // Histogram: mBuckets[0] counts zeros, mBuckets[i] counts values in [2^(i-1), 2^i)
+    const std::array<std::uint64_t, kNumHistogramBuckets>* mBuckets{};
+};
+
+/**
+ * @brief Counters, gauges and histograms that real-time threads can update far more cheaply than logging a message.
+ *
+ * Counters and histograms are accumulated per thread, in lanes handed out by a ThreadLaneRegistry, so an update is a
+ * load and a store to memory only that thread writes to: no read-modify-write, no contention. Gauges are a single
+ * relaxed store. Collect, called from a non real-time thread, sums everything up; totals of threads that have exited
+ * are kept. Use MetricsReporter to have a LogProcessingThread emit the metrics periodically.
+ *
+ * Add all metrics before updating any of them. A thread can update at most RTLOG_MAX_NUM_REGISTRIES_PER_THREAD
+ * registries (counting per-thread Loggers) that exist at the same time; registries destroyed since don't count.
+ *
+ * @tparam MaxNumMetrics The number of metrics that can be added.
+ * @tparam MaxNumThreads The number of threads that can update counters and histograms at the same time. Updates from
+ * further threads are dropped and counted in NumDroppedUpdates.
+ */
+template <size_t MaxNumMetrics, size_t MaxNumThreads = RTLOG_MAX_NUM_THREAD_LANES>
+class MetricsRegistry
+{
+public:
+    /**
+     * @brief Adds a metric. NOT REALTIME SAFE.
+     *
+     * @param name The name of the metric. Must outlive the registry.
+     * @return MetricId The handle to update the metric with.
+     */
+    MetricId Add( const char* name, MetricType type )
+    {
+        const auto index = mNumMetrics.load( std::memory_order_relaxed );
+        if ( index == MaxNumMetrics ) {
+            return MetricId{ MaxNumMetrics };
+        }
+        mDefinitions[index] = { name, type };
+        mNumMetrics.store( index + 1, std::memory_order_release );
+        return MetricId{ index };
+    }
+
+    MetricId AddCounter( const char* name )
+    {
+        return Add( name, MetricType::Counter );
+    }
+
+    MetricId AddGauge( const char* name )
+    {
+        return Add( name, MetricType::Gauge );
+    }
+
+    MetricId AddHistogram( const char* name )
+    {
+        return Add( name, MetricType::Histogram );
+    }
+
+    /**
+     * @brief Claims the calling thread's accumulators ahead of time. NOT REALTIME SAFE. See ThreadLaneRegistry.
+     */
+    bool WarmUpCurrentThread()
+    {
+        return mLanes.WarmUpCurrentThread();
+    }
+
+    /**
+     * @brief Adds delta to a counter. REALTIME SAFE - wait-free, after WarmUpCurrentThread.
+     */
+    void Increment( MetricId counter, std::uint64_t delta = 1 )
+    {
+        if ( auto* cell = CellFor( counter ) ) {
+            Accumulate( cell->mCount, delta );
+        }
+    }
+
+    /**
+     * @brief Sets a gauge. REALTIME SAFE - wait-free.
+     */
+    void Set( MetricId gauge, double value )
+    {
+        if ( gauge.mIndex < MaxNumMetrics ) {
+            mGauges[gauge.mIndex].store( value, std::memory_order_relaxed );
+        }
+    }
+
+    /**
+     * @brief Records a value into a histogram. REALTIME SAFE - wait-free, after WarmUpCurrentThread.
+     */
+    void Record( MetricId histogram, std::uint64_t value )
+    {
+        if ( auto* cell = CellFor( histogram ) ) {
+            Accumulate( cell->mCount, 1 );
+            Accumulate( cell->mSum, value );
+            Accumulate( cell->mBuckets[BucketFor( value )], 1 );
+        }
+    }
+
+    /**
+     * @brief Sums up every metric and hands each one to collectFn.
+     *
+     * NOT REALTIME SAFE unless collectFn is. Must only be called from one thread at a time.
+     *
+     * @tparam CollectFn Callable as collectFn( const MetricSnapshot& snapshot )
+     * @return size_t The number of metrics collected.
+     */
+    template <typename CollectFn>
+    size_t Collect( CollectFn&& collectFn )
+    {
+        const auto numMetrics = mNumMetrics.load( std::memory_order_acquire );
+
+        mLanes.DrainLanes(
+            [&]( const auto& lanes ) {
+                for ( size_t i = 0; i < numMetrics; i++ ) {
+                    auto& total = mTotals[i];
+                    total       = mRetired[i];
+                    for ( const auto* lane : lanes ) {
+                        AddInto( total, lane->mCells[i] );
+                    }
+                }
+                return 0;
+            },
+            [&]( Lane& lane ) {
+                for ( size_t i = 0; i < MaxNumMetrics; i++ ) {
+                    AddInto( mRetired[i], lane.mCells[i] );
+                    Reset( lane.mCells[i] );
+                }
+            } );
+
+        for ( size_t i = 0; i < numMetrics; i++ ) {
+            MetricSnapshot snapshot;
+            snapshot.mName    = mDefinitions[i].mName;
+            snapshot.mType    = mDefinitions[i].mType;
+            snapshot.mCount   = mTotals[i].mCount;
+            snapshot.mSum     = mTotals[i].mSum;
+            snapshot.mValue   = mGauges[i].load( std::memory_order_relaxed );
+            snapshot.mBuckets = &mTotals[i].mBuckets;
+            collectFn( static_cast<const MetricSnapshot&>( snapshot ) );
+        }
+        return numMetrics;
+    }
+
+    /**
+     * @brief Returns the number of counter and histogram updates dropped because no per-thread lane was free.
+     */
+    std::uint64_t NumDroppedUpdates() const
+    {
+        return mNumDroppedUpdates.load( std::memory_order_relaxed );
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::uint64_t>                                                    mCount{};
+        std::atomic<std::uint64_t>                                                    mSum{};
+        std::array<std::atomic<std::uint64_t>, MetricSnapshot::kNumHistogramBuckets> mBuckets{};
+    };
+
+    struct Lane
+    {
+        // Nothing is ever queued, the consumer reads the cells in place
+        bool IsEmpty() const
+        {
+            return true;
+        }
+
+        std::array<Cell, MaxNumMetrics> mCells{};
+    };
+
+    struct Totals
+    {
+        std::uint64_t                                                    mCount{};
+        std::uint64_t                                                    mSum{};
+        std::array<std::uint64_t, MetricSnapshot::kNumHistogramBuckets> mBuckets{};
+    };
+
+    struct Definition
+    {
+        const char* mName{};
+        MetricType  mType{};
+    };
+
+    Cell* CellFor( MetricId metric )
+    {
+        if ( metric.mIndex >= MaxNumMetrics ) {
+            return nullptr;
+        }
+        auto* lane = mLanes.CurrentThreadLane();
+        if ( lane == nullptr ) {
+            mNumDroppedUpdates.fetch_add( 1, std::memory_order_relaxed );
+            return nullptr;
+        }
+        return &lane->mCells[metric.mIndex];
+    }
+
+    // Only the owning thread writes a cell, so a load and a store is enough
+    static void Accumulate( std::atomic<std::uint64_t>& value, std::uint64_t delta )
+    {
+        value.store( value.load( std::memory_order_relaxed ) + delta, std::memory_order_relaxed );
+    }
+
+    static size_t BucketFor( std::uint64_t value )
+    {
+        return value == 0 ? 0
+                          : std::min<size_t>( static_cast<size_t>( 64 - __builtin_clzll( value ) ),
+                                              MetricSnapshot::kNumHistogramBuckets - 1 );
+    }
+
+    template <typename Target>
+    static void AddInto( Target& total, const Cell& cell )
+    {
+        total.mCount += cell.mCount.load( std::memory_order_relaxed );
+        total.mSum += cell.mSum.load( std::memory_order_relaxed );
+        for ( size_t i = 0; i < total.mBuckets.size(); i++ ) {
+            total.mBuckets[i] += cell.mBuckets[i].load( std::memory_order_relaxed );
+        }
+    }
+
+    static void Reset( Cell& cell )
+    {
+        cell.mCount.store( 0, std::memory_order_relaxed );
+        cell.mSum.store( 0, std::memory_order_relaxed );
+        for ( auto& bucket : cell.mBuckets ) {
+            bucket.store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    ThreadLaneRegistry<Lane, MaxNumThreads>        mLanes{};
+    std::array<Definition, MaxNumMetrics>          mDefinitions{};
+    std::array<std::atomic<double>, MaxNumMetrics> mGauges{};
+    std::array<Totals, MaxNumMetrics>              mRetired{};
+    std::array<Totals, MaxNumMetrics>              mTotals{};
+    std::atomic<size_t>                            mNumMetrics{};
+    std::atomic<std::uint64_t>                     mNumDroppedUpdates{};
+};
+
+/**
+ * @brief Lets a LogProcessingThread emit the metrics of a MetricsRegistry alongside the messages of a Logger.
+ *
+ * Has the same PrintAndClearLogQueue as Logger, so it can be handed to a LogProcessingThread in its place, and forwards
+ * WaitForWork and WakeConsumer to the logger where it has them, so producers still wake the thread early. Every call
+ * processes the logger's messages, and once every reportInterval also collects the metrics. Each metric is handed to
+ * the print log function as a MetricSnapshot if it accepts one (a dedicated metrics sink), and otherwise as a compact
+ * message such as "xruns=3" or "callback_us count=1000 sum=52311", logged with metricsLogData.
+ *
+ * @tparam LoggerType The logger whose messages to process, generally some specialization of rtlog::Logger.
+ * @tparam RegistryType Some specialization of MetricsRegistry.
+ * @tparam LogData The LogData of the logger.
+ */
+template <typename LoggerType, typename RegistryType, typename LogData>
+class MetricsReporter
+{
+public:
+    MetricsReporter( LoggerType&               logger,
+                     RegistryType&             registry,
+                     std::chrono::milliseconds reportInterval,
+                     const LogData&            metricsLogData,
+                     std::atomic<std::size_t>& sequenceNumber )
+    : mLogger( logger )
+    , mRegistry( registry )
+    , mReportInterval( reportInterval )
+    , mMetricsLogData( metricsLogData )
+    , mSequenceNumber( sequenceNumber )
+    {
+    }
+
+    template <typename PrintLogFn>
+    int PrintAndClearLogQueue( PrintLogFn& printLogFn )
+    {
+        auto numProcessed = mLogger.PrintAndClearLogQueue( printLogFn );
+
+        const auto now = std::chrono::steady_clock::now();
+        if ( now >= mNextReport ) {
+            mNextReport = now + mReportInterval;
+            numProcessed += static_cast<int>( ReportNow( printLogFn ) );
+        }
+        return numProcessed;
+    }
+
+    static constexpr size_t QueueCapacity()
+    {
+        return LoggerType::QueueCapacity();
+    }
+
+    /**
+     * @brief See Logger::WakeConsumer.
+     */
+    template <typename L = LoggerType>
+    auto WakeConsumer() -> decltype( std::declval<L&>().WakeConsumer() )
+    {
+        return mLogger.WakeConsumer();
+    }
+
+    /**
+     * @brief See Logger::WaitForWork. The wait is not cut short for the next report, which is only collected once the
+     * logger's messages are processed.
+     */
+    template <typename L = LoggerType>
+    auto WaitForWork( std::chrono::milliseconds timeout ) -> decltype( std::declval<L&>().WaitForWork( timeout ) )
+    {
+        return mLogger.WaitForWork( timeout );
+    }
+
+    /**
+     * @brief Collects and emits the metrics right away.
+     */
+    template <typename PrintLogFn>
+    size_t ReportNow( PrintLogFn& printLogFn )
+    {
+        return mRegistry.Collect( [&]( const MetricSnapshot& snapshot ) {
+            if constexpr ( std::is_invocable<PrintLogFn&, const MetricSnapshot&>::value ) {
+                printLogFn( snapshot );
+            }
+            else {
+                std::array<char, 128> message{};
+                int                   length = 0;
+                switch ( snapshot.mType ) {
+                    case MetricType::Counter:
+                        length = std::snprintf( message.data(),
+                                                message.size(),
+                                                "%s=%llu",
+                                                snapshot.mName,
+                                                static_cast<unsigned long long>( snapshot.mCount ) );
+                        break;
+                    case MetricType::Gauge:
+                        length = std::snprintf( message.data(), message.size(), "%s=%g", snapshot.mName, snapshot.mValue );
+                        break;
+                    case MetricType::Histogram:
+                        length = std::snprintf( message.data(),
+                                                message.size(),
+                                                "%s count=%llu sum=%llu",
+                                                snapshot.mName,
+                                                static_cast<unsigned long long>( snapshot.mCount ),
+                                                static_cast<unsigned long long>( snapshot.mSum ) );
+                        break;
+                }
+
+                const LogRecord<LogData> record{ mMetricsLogData,
+                                                 ++mSequenceNumber,
+                                                 message.data(),
+                                                 std::min( static_cast<size_t>( std::max( length, 0 ) ),
+                                                           message.size() - 1 ),
+                                                 CurrentThreadId() };
+                PrintLogRecord( printLogFn, record );
+            }
+        } );
+    }
+
+private:
+    LoggerType&                           mLogger;
+    RegistryType&                         mRegistry;
+    std::chrono::milliseconds             mReportInterval{};
+    LogData                               mMetricsLogData{};
+    std::atomic<std::size_t>&             mSequenceNumber;
+    std::chrono::steady_clock::time_point mNextReport{ std::chrono::steady_clock::now() };
+};
+
+} // namespace rtlog
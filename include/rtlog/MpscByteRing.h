@@ -0,0 +1,527 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+/**
+ * The number of producers that may be inside MpscByteRing::TryWrite at the same time without any of them having to
+ * wait. See MpscByteRing for details.
+ */
+#ifndef RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS
+#define RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS 32
+#endif // RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS
+
+namespace rtlog
+{
+
+/**
+ * @brief A bounded multiple producer, single consumer ring of variable length byte records.
+ *
+ * Producers claim space with a single fetch_add on a reservation cursor, copy their record in, and publish it by
+ * storing a non-zero commit word at the start of the record. The consumer walks committed records in reservation
+ * order, zeroes the bytes it consumed and advances the read cursor, so a zero commit word always means "not published
+ * yet". Neither TryWrite nor ReadAll has a CAS loop.
+ *
+ * Before claiming, a producer compares the reservation cursor against the read cursor and fails without claiming if
+ * the record would not fit, so a full ring never loses space. Producers that pass this check at the same time can
+ * overshoot the capacity by at most one record each, which is what the headroom of RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS
+ * records past CapacityBytes is for. As long as no more than that many threads write at once, TryWrite is wait-free.
+ * Past that bound a producer whose claim landed on unread bytes waits for the consumer to free them.
+ *
+ * Snapshot lets any number of other threads, or other processes, copy out the records waiting in the ring without
+ * taking them from the consumer.
+ *
+ * Instead of ReadAll, any number of consumer threads can share the work with ReadChunk. Each claims the next run of
+ * committed records with a CAS on a claim cursor, reads them while the others read theirs, then marks its run done.
+ * Whichever thread finds the run at the read cursor done moves the read cursor past it, and past any done runs after
+ * it, so space is still freed in reservation order and producers work as before. Don't mix ReadChunk with ReadAll,
+ * ReadOne or Peek on the same ring.
+ *
+ * All storage is inline, so the ring can live in static memory, on the heap, or in memory shared between processes.
+ *
+ * @tparam CapacityBytes The number of bytes of records the ring accepts before reporting it is full.
+ * @tparam MaxRecordBytes The largest record (sum of both parts passed to TryWrite) that will be written.
+ */
+template <size_t CapacityBytes, size_t MaxRecordBytes>
+class MpscByteRing
+{
+    static constexpr size_t kCommitWordBytes = sizeof( std::uint64_t );
+
+    static constexpr size_t AlignedRecordBytes( size_t payloadBytes )
+    {
+        return ( kCommitWordBytes + payloadBytes + kCommitWordBytes - 1 ) & ~( kCommitWordBytes - 1 );
+    }
+
+public:
+    static constexpr size_t kMaxAlignedRecordBytes = AlignedRecordBytes( MaxRecordBytes );
+    static constexpr size_t kPhysicalBytes =
+        AlignedRecordBytes( CapacityBytes ) + kMaxAlignedRecordBytes * RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS;
+
+    /**
+     * @brief A contiguous run of bytes to be copied into the ring as part of a record.
+     */
+    struct ByteSpan
+    {
+        const void* mData{};
+        size_t      mSize{};
+    };
+
+    /**
+     * @brief What came of TryWriteExclusive.
+     */
+    enum class ExclusiveWriteResult
+    {
+        Written,
+        Full,        // or the record is larger than MaxRecordBytes
+        Interrupted, // storeCursor didn't store, try again
+    };
+
+    /**
+     * @brief Copies a record made of one or more contiguous parts into the ring.
+     *
+     * REALTIME SAFE - wait-free while at most RTLOG_MPSC_MAX_CONCURRENT_PRODUCERS threads call it concurrently
+     *
+     * @param parts The parts of the record, which the consumer will see as one contiguous run of bytes.
+     * @return true if the record was published, false if the ring did not have room for it.
+     */
+    bool TryWrite( std::initializer_list<ByteSpan> parts )
+    {
+        size_t recordBytes = 0;
+        for ( const auto& part : parts ) {
+            recordBytes += part.mSize;
+        }
+        if ( recordBytes > MaxRecordBytes ) {
+            return false;
+        }
+
+        const auto alignedBytes = AlignedRecordBytes( recordBytes );
+
+        // Read cursor first: the reservation cursor loaded after it can never be behind it
+        const auto read     = mReadCursor.load( std::memory_order_acquire );
+        const auto reserved = mReserveCursor.load( std::memory_order_relaxed );
+        if ( reserved + alignedBytes - read > CapacityBytes ) {
+            return false;
+        }
+
+        const auto start = mReserveCursor.fetch_add( alignedBytes, std::memory_order_relaxed );
+
+        // Only reachable when more producers than the headroom accounts for raced past the check above
+        while ( start + alignedBytes - mReadCursor.load( std::memory_order_acquire ) > kPhysicalBytes ) {
+            std::this_thread::yield();
+        }
+
+        Publish( start, parts, recordBytes, alignedBytes );
+        return true;
+    }
+
+    /**
+     * @brief Copies a record into the ring like TryWrite, but claims its space with storeCursor instead of a
+     * fetch_add, for producers that have a cheaper way to claim it without racing each other, such as the restartable
+     * sequences of PerCpuLanes.
+     *
+     * REALTIME SAFE if storeCursor is. Don't mix it with TryWrite on the same ring.
+     *
+     * storeCursor( std::atomic<std::uint64_t>& cursor, std::uint64_t expected, std::uint64_t desired ) -> bool must
+     * store desired to cursor if it still holds expected, in one step as far as the other producers are concerned, and
+     * return whether it did; cursor.compare_exchange_strong( expected, desired ) would do. As the check for room and
+     * the claim then can't be split by another producer, the ring is never overshot.
+     */
+    template <typename StoreCursorFn>
+    ExclusiveWriteResult TryWriteExclusive( std::initializer_list<ByteSpan> parts, StoreCursorFn&& storeCursor )
+    {
+        size_t recordBytes = 0;
+        for ( const auto& part : parts ) {
+            recordBytes += part.mSize;
+        }
+        if ( recordBytes > MaxRecordBytes ) {
+            return ExclusiveWriteResult::Full;
+        }
+
+        const auto alignedBytes = AlignedRecordBytes( recordBytes );
+        const auto read         = mReadCursor.load( std::memory_order_acquire );
+        const auto start        = mReserveCursor.load( std::memory_order_relaxed );
+        if ( start + alignedBytes - read > CapacityBytes ) {
+            return ExclusiveWriteResult::Full;
+        }
+        if ( !storeCursor( mReserveCursor, start, start + alignedBytes ) ) {
+            return ExclusiveWriteResult::Interrupted;
+        }
+
+        Publish( start, parts, recordBytes, alignedBytes );
+        return ExclusiveWriteResult::Written;
+    }
+
+    /**
+     * @brief Copies a record made of two contiguous parts into the ring. Same rules as above.
+     */
+    bool TryWrite( const void* header, size_t headerBytes, const void* payload, size_t payloadBytes )
+    {
+        return TryWrite( { ByteSpan{ header, headerBytes }, ByteSpan{ payload, payloadBytes } } );
+    }
+
+    /**
+     * @brief Hands every committed record, in reservation order, to readFn and frees it.
+     *
+     * NOT REALTIME SAFE unless readFn is. Must only be called from one thread at a time.
+     *
+     * Stops at the first record that has been reserved but not committed yet, so a slow producer holds back the
+     * records reserved after it until it commits.
+     *
+     * @tparam ReadFn Callable as readFn( const void* data, size_t numBytes ). data is only valid during the call.
+     * @return size_t The number of records read.
+     */
+    template <typename ReadFn>
+    size_t ReadAll( ReadFn&& readFn )
+    {
+        size_t numRead = 0;
+        while ( ReadOne( readFn ) ) {
+            numRead++;
+        }
+        return numRead;
+    }
+
+    /**
+     * @brief Reads and frees the oldest record if it has been committed.
+     *
+     * Same rules as ReadAll.
+     *
+     * @return true if a record was read
+     */
+    template <typename ReadFn>
+    bool ReadOne( ReadFn&& readFn )
+    {
+        const auto read         = mReadCursor.load( std::memory_order_relaxed );
+        const auto alignedBytes = VisitOldest( read, readFn );
+        if ( alignedBytes == 0 ) {
+            return false;
+        }
+
+        // Unpublish the record before wiping the rest of it, so Snapshot can tell when it copied a record being freed
+        __atomic_store_n( CommitWordAt( read ), std::uint64_t{ 0 }, __ATOMIC_RELAXED );
+        std::atomic_thread_fence( std::memory_order_release );
+        Zero( read + kCommitWordBytes, alignedBytes - kCommitWordBytes );
+        mReadCursor.store( read + alignedBytes, std::memory_order_release );
+        return true;
+    }
+
+    /**
+     * @brief Claims up to maxRecords of the oldest committed records that no other consumer has claimed, hands them to
+     * readFn in reservation order, and frees them.
+     *
+     * NOT REALTIME SAFE unless readFn is. Can be called from any number of threads at the same time.
+     *
+     * The records are freed once every run claimed before them has been freed as well, so a consumer that takes long
+     * over its run holds back the space of the runs claimed after it, but not their reading.
+     *
+     * @tparam ReadFn Callable as readFn( const void* data, size_t numBytes ). data is only valid during the call.
+     * @return size_t The number of records read, 0 if there were none to claim.
+     */
+    template <typename ReadFn>
+    size_t ReadChunk( size_t maxRecords, ReadFn&& readFn )
+    {
+        auto   start      = mClaimCursor.load( std::memory_order_acquire );
+        auto   end        = start;
+        size_t numClaimed = 0;
+        do {
+            // Records can't be found past one ring length from the read cursor: those bytes are still in use by the
+            // runs claimed before start. A stale start only makes the CAS below fail.
+            const auto limit = mReadCursor.load( std::memory_order_acquire ) + kPhysicalBytes - kMaxAlignedRecordBytes;
+            end              = start;
+            numClaimed       = 0;
+            while ( numClaimed < maxRecords && end <= limit ) {
+                const auto commitWord = __atomic_load_n( CommitWordAt( end ), __ATOMIC_ACQUIRE );
+                if ( !IsCommitWord( commitWord ) ) {
+                    break;
+                }
+                end += commitWord & 0xFFFFFFFFu;
+                numClaimed++;
+            }
+            if ( numClaimed == 0 ) {
+                return 0;
+            }
+        } while ( !mClaimCursor.compare_exchange_weak(
+            start, end, std::memory_order_acq_rel, std::memory_order_acquire ) );
+
+        std::array<std::uint8_t, MaxRecordBytes> scratch;
+        for ( auto position = start; position < end; ) {
+            const auto commitWord   = __atomic_load_n( CommitWordAt( position ), __ATOMIC_ACQUIRE );
+            const auto recordBytes  = static_cast<size_t>( commitWord >> 32 );
+            const auto payloadStart = position + kCommitWordBytes;
+            const auto offset       = payloadStart % kPhysicalBytes;
+            if ( offset + recordBytes <= kPhysicalBytes ) {
+                readFn( static_cast<const void*>( Bytes() + offset ), recordBytes );
+            }
+            else {
+                CopyOut( scratch.data(), payloadStart, recordBytes );
+                readFn( static_cast<const void*>( scratch.data() ), recordBytes );
+            }
+            position += commitWord & 0xFFFFFFFFu;
+        }
+
+        // As in ReadOne, unpublish the records before wiping them. The first commit word becomes the run's done mark.
+        for ( auto position = start; position < end; ) {
+            const auto alignedBytes = __atomic_load_n( CommitWordAt( position ), __ATOMIC_RELAXED ) & 0xFFFFFFFFu;
+            __atomic_store_n( CommitWordAt( position ), std::uint64_t{ 0 }, __ATOMIC_RELAXED );
+            position += alignedBytes;
+        }
+        std::atomic_thread_fence( std::memory_order_release );
+        Zero( start + kCommitWordBytes, static_cast<size_t>( end - start ) - kCommitWordBytes );
+        __atomic_store_n( CommitWordAt( start ), kDoneMark | ( end - start ), __ATOMIC_SEQ_CST );
+
+        AdvanceReadCursor();
+        return numClaimed;
+    }
+
+    /**
+     * @brief Hands the oldest record to peekFn, if it has been committed, without freeing it.
+     *
+     * Same rules as ReadAll.
+     *
+     * @return true if there was a committed record to look at
+     */
+    template <typename PeekFn>
+    bool Peek( PeekFn&& peekFn )
+    {
+        return VisitOldest( mReadCursor.load( std::memory_order_relaxed ), peekFn ) != 0;
+    }
+
+    /**
+     * @brief Hands copies of the newest maxRecords committed records that haven't been read yet to visitFn, oldest
+     * first, without freeing them.
+     *
+     * NOT REALTIME SAFE - allocates. Can be called from any thread, or from another process that maps the ring read
+     * only, while producers write and the consumer reads, without holding either of them up: it only reads.
+     *
+     * It works like the reader of a seqlock. The records are found by following commit words from the read cursor,
+     * then each is copied out and kept only if its commit word is still the same and the read cursor is still not
+     * past it; the consumer clears a record's commit word before wiping the rest of it, and advances the read cursor
+     * after. Records the consumer frees during the snapshot are left out. As with ReadAll, records reserved after one
+     * that isn't committed yet are not seen.
+     *
+     * @tparam VisitFn Callable as visitFn( const void* data, size_t numBytes ). data is only valid during the call.
+     * @return size_t The number of records handed to visitFn.
+     */
+    template <typename VisitFn>
+    size_t Snapshot( size_t maxRecords, VisitFn&& visitFn ) const
+    {
+        if ( maxRecords == 0 ) {
+            return 0;
+        }
+
+        // Find where the newest records start, keeping the last maxRecords of them
+        std::vector<std::uint64_t> starts( maxRecords );
+        size_t                     numFound = 0;
+        const auto                 end      = mReserveCursor.load( std::memory_order_acquire );
+        auto                       position = mReadCursor.load( std::memory_order_acquire );
+        while ( position < end ) {
+            const auto commitWord = __atomic_load_n( CommitWordAt( position ), __ATOMIC_ACQUIRE );
+            const auto read       = mReadCursor.load( std::memory_order_acquire );
+            if ( read > position ) {
+                // Freed while we looked, so the commit word may be anything; pick up from the consumer
+                position = read;
+                numFound = 0;
+                continue;
+            }
+            if ( ( commitWord & kDoneMark ) != 0 ) {
+                // A run read with ReadChunk, waiting for the runs before it to be freed
+                position += commitWord & ~kDoneMark;
+                continue;
+            }
+            if ( !IsCommitWord( commitWord ) ) {
+                break;
+            }
+            starts[numFound++ % maxRecords] = position;
+            position += commitWord & 0xFFFFFFFFu;
+        }
+
+        std::vector<std::uint8_t> record( MaxRecordBytes );
+        size_t                    numVisited = 0;
+        for ( auto i = numFound - std::min( numFound, maxRecords ); i < numFound; i++ ) {
+            const auto start      = starts[i % maxRecords];
+            const auto commitWord = __atomic_load_n( CommitWordAt( start ), __ATOMIC_ACQUIRE );
+            if ( !IsCommitWord( commitWord ) ) {
+                continue;
+            }
+            const auto recordBytes = static_cast<size_t>( commitWord >> 32 );
+            CopyOut( record.data(), start + kCommitWordBytes, recordBytes );
+
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( __atomic_load_n( CommitWordAt( start ), __ATOMIC_RELAXED ) != commitWord
+                 || mReadCursor.load( std::memory_order_relaxed ) > start ) {
+                continue;
+            }
+            visitFn( static_cast<const void*>( record.data() ), recordBytes );
+            numVisited++;
+        }
+        return numVisited;
+    }
+
+    /**
+     * @brief Returns true if the cursors, or the commit word of the oldest record, hold values TryWrite and the read
+     * functions never write. That can only happen to a ring in memory others can write to, such as a shared memory
+     * file, and such a ring should not be read any further; the read functions already refuse a bad commit word.
+     *
+     * Same rules as ReadAll.
+     */
+    bool IsCorrupt() const
+    {
+        const auto read     = mReadCursor.load( std::memory_order_acquire );
+        const auto reserved = mReserveCursor.load( std::memory_order_acquire );
+        if ( read % kCommitWordBytes != 0 || reserved % kCommitWordBytes != 0 || reserved < read ) {
+            return true;
+        }
+        const auto commitWord = __atomic_load_n( CommitWordAt( read ), __ATOMIC_ACQUIRE );
+        return commitWord != 0 && !IsCommitWord( commitWord );
+    }
+
+    /**
+     * @brief Returns the number of bytes currently reserved and not yet read. May be stale by the time it returns.
+     */
+    size_t SizeApprox() const
+    {
+        const auto read     = mReadCursor.load( std::memory_order_acquire );
+        const auto reserved = mReserveCursor.load( std::memory_order_relaxed );
+        return reserved > read ? static_cast<size_t>( reserved - read ) : 0;
+    }
+
+    static constexpr size_t Capacity()
+    {
+        return CapacityBytes;
+    }
+
+private:
+    // Marks the first commit word of a run read with ReadChunk, with the run's length in bytes below it. Never a
+    // valid commit word, as no record is that long.
+    static constexpr std::uint64_t kDoneMark = std::uint64_t{ 1 } << 63;
+
+    // Moves the read cursor past every done run at it. The thread that marks a run done calls this afterwards, so
+    // when runs are done out of order the one done last frees them all. All accesses here are sequentially
+    // consistent, so either the thread that marked a run done sees the read cursor reach it, or the thread that moved
+    // the read cursor there sees its mark.
+    void AdvanceReadCursor()
+    {
+        while ( true ) {
+            auto       read     = mReadCursor.load( std::memory_order_seq_cst );
+            auto*      doneMark = CommitWordAt( read );
+            const auto mark     = __atomic_load_n( doneMark, __ATOMIC_SEQ_CST );
+            if ( ( mark & kDoneMark ) == 0 ) {
+                return;
+            }
+
+            // Whoever clears the mark moves the read cursor on, so a thread that loses this race can leave
+            auto expected = mark;
+            if ( !__atomic_compare_exchange_n( doneMark, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ) {
+                return;
+            }
+            const auto next = read + ( mark & ~kDoneMark );
+            if ( !mReadCursor.compare_exchange_strong( read, next, std::memory_order_seq_cst ) ) {
+                // The read cursor had already moved on, and the mark is that of a later run in the same place
+                __atomic_store_n( doneMark, mark, __ATOMIC_SEQ_CST );
+            }
+        }
+    }
+
+    // Copies the record into the space claimed at start, then commits it
+    void Publish( std::uint64_t start, std::initializer_list<ByteSpan> parts, size_t recordBytes, size_t alignedBytes )
+    {
+        auto position = start + kCommitWordBytes;
+        for ( const auto& part : parts ) {
+            CopyIn( position, part.mData, part.mSize );
+            position += part.mSize;
+        }
+
+        const std::uint64_t commitWord = ( static_cast<std::uint64_t>( recordBytes ) << 32 ) | alignedBytes;
+        __atomic_store_n( CommitWordAt( start ), commitWord, __ATOMIC_RELEASE );
+    }
+
+    static constexpr bool IsCommitWord( std::uint64_t commitWord )
+    {
+        const auto recordBytes = static_cast<size_t>( commitWord >> 32 );
+        return commitWord != 0 && recordBytes <= MaxRecordBytes
+            && ( commitWord & 0xFFFFFFFFu ) == AlignedRecordBytes( recordBytes );
+    }
+
+    template <typename VisitFn>
+    size_t VisitOldest( std::uint64_t read, VisitFn& visitFn )
+    {
+        const auto commitWord = __atomic_load_n( CommitWordAt( read ), __ATOMIC_ACQUIRE );
+        if ( read % kCommitWordBytes != 0 || !IsCommitWord( commitWord ) ) {
+            return 0;
+        }
+
+        const auto recordBytes  = static_cast<size_t>( commitWord >> 32 );
+        const auto alignedBytes = static_cast<size_t>( commitWord & 0xFFFFFFFFu );
+
+        const auto payloadOffset = ( read + kCommitWordBytes ) % kPhysicalBytes;
+        if ( payloadOffset + recordBytes <= kPhysicalBytes ) {
+            visitFn( static_cast<const void*>( Bytes() + payloadOffset ), recordBytes );
+        }
+        else {
+            CopyOut( mScratch.data(), read + kCommitWordBytes, recordBytes );
+            visitFn( static_cast<const void*>( mScratch.data() ), recordBytes );
+        }
+        return alignedBytes;
+    }
+
+    std::uint8_t* Bytes()
+    {
+        return reinterpret_cast<std::uint8_t*>( mStorage.data() );
+    }
+
+    const std::uint8_t* Bytes() const
+    {
+        return reinterpret_cast<const std::uint8_t*>( mStorage.data() );
+    }
+
+    std::uint64_t* CommitWordAt( std::uint64_t position )
+    {
+        return &mStorage[( position % kPhysicalBytes ) / kCommitWordBytes];
+    }
+
+    const std::uint64_t* CommitWordAt( std::uint64_t position ) const
+    {
+        return &mStorage[( position % kPhysicalBytes ) / kCommitWordBytes];
+    }
+
+    void CopyIn( std::uint64_t position, const void* src, size_t numBytes )
+    {
+        if ( numBytes == 0 ) {
+            return;
+        }
+        const auto offset = position % kPhysicalBytes;
+        const auto first  = std::min<size_t>( numBytes, kPhysicalBytes - offset );
+        std::memcpy( Bytes() + offset, src, first );
+        std::memcpy( Bytes(), static_cast<const std::uint8_t*>( src ) + first, numBytes - first );
+    }
+
+    void CopyOut( void* dst, std::uint64_t position, size_t numBytes ) const
+    {
+        const auto offset = position % kPhysicalBytes;
+        const auto first  = std::min<size_t>( numBytes, kPhysicalBytes - offset );
+        std::memcpy( dst, Bytes() + offset, first );
+        std::memcpy( static_cast<std::uint8_t*>( dst ) + first, Bytes(), numBytes - first );
+    }
+
+    void Zero( std::uint64_t position, size_t numBytes )
+    {
+        const auto offset = position % kPhysicalBytes;
+        const auto first  = std::min<size_t>( numBytes, kPhysicalBytes - offset );
+        std::memset( Bytes() + offset, 0, first );
+        std::memset( Bytes(), 0, numBytes - first );
+    }
+
+    alignas( 64 ) std::atomic<std::uint64_t> mReserveCursor{ 0 };
+    alignas( 64 ) std::atomic<std::uint64_t> mReadCursor{ 0 };
+    alignas( 64 ) std::atomic<std::uint64_t> mClaimCursor{ 0 }; // where ReadChunk claims from
+    alignas( 64 ) std::array<std::uint64_t, kPhysicalBytes / kCommitWordBytes> mStorage{};
+    std::array<std::uint8_t, MaxRecordBytes> mScratch{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace rtlog
+{
+
+/**
+ * @brief A tiny local stream listener that collects everything sent to it, for testing and benchmarking NetworkSink
+ * on one host.
+ *
+ * NOT REALTIME SAFE
+ *
+ * Listens on a Unix domain socket path, or on a free TCP port of 127.0.0.1, and accepts and reads any number of
+ * connections on a thread of its own. The bytes of all connections are appended to one buffer, in the order they
+ * arrive.
+ */
+class NetworkLogListener
+{
+public:
+    /**
+     * @param unixPath Listen on this Unix domain socket path, replacing any file there. If empty, listen on TCP
+     * instead, see Port.
+     */
+    explicit NetworkLogListener( const std::string& unixPath = {} )
+    : mUnixPath( unixPath )
+    {
+        if ( ::pipe( mWakeFds ) != 0 ) {
+            mWakeFds[0] = mWakeFds[1] = -1;
+            return;
+        }
+        if ( !Listen() ) {
+            return;
+        }
+        mThread = std::thread( [this] { Run(); } );
+    }
+
+    ~NetworkLogListener()
+    {
+        Stop();
+        for ( const int fd : { mListenFd, mWakeFds[0], mWakeFds[1] } ) {
+            if ( fd >= 0 ) {
+                ::close( fd );
+            }
+        }
+        if ( !mUnixPath.empty() ) {
+            ::unlink( mUnixPath.c_str() );
+        }
+    }
+
+    NetworkLogListener( const NetworkLogListener& )            = delete;
+    NetworkLogListener& operator=( const NetworkLogListener& ) = delete;
+
+    bool IsListening() const
+    {
+        return mThread.joinable();
+    }
+
+    /**
+     * @brief Returns the TCP port listened on, or 0 when listening on a Unix domain socket.
+     */
+    std::uint16_t Port() const
+    {
+        return mPort;
+    }
+
+    /**
+     * @brief Returns a copy of everything received so far.
+     */
+    std::string Received() const
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        return mReceived;
+    }
+
+    /**
+     * @brief Waits until at least numBytes have been received in all.
+     *
+     * @return false if they haven't been by the timeout.
+     */
+    bool WaitForBytes( size_t numBytes, std::chrono::milliseconds timeout ) const
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+        return mChanged.wait_for( lock, timeout, [&] { return mReceived.size() >= numBytes; } );
+    }
+
+    size_t NumAccepted() const
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        return mNumAccepted;
+    }
+
+    /**
+     * @brief Closes all connections accepted so far, keeping on listening for new ones. Returns once they are closed.
+     */
+    void DropConnections()
+    {
+        std::unique_lock<std::mutex> lock( mMutex );
+        if ( !IsListening() ) {
+            return;
+        }
+        const auto request = ++mDropRequests;
+        Wake();
+        mChanged.wait( lock, [&] { return mDropsDone >= request; } );
+    }
+
+    /**
+     * @brief Closes all connections and stops listening.
+     */
+    void Stop()
+    {
+        if ( mThread.joinable() ) {
+            {
+                std::lock_guard<std::mutex> lock( mMutex );
+                mStopping = true;
+            }
+            Wake();
+            mThread.join();
+        }
+    }
+
+private:
+    bool Listen()
+    {
+        if ( !mUnixPath.empty() ) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if ( mUnixPath.size() >= sizeof( address.sun_path ) ) {
+                return false;
+            }
+            mUnixPath.copy( address.sun_path, sizeof( address.sun_path ) - 1 );
+            ::unlink( mUnixPath.c_str() );
+            mListenFd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+            return mListenFd >= 0
+                   && ::bind( mListenFd, reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) ) == 0
+                   && ::listen( mListenFd, 16 ) == 0;
+        }
+
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        address.sin_port        = 0;
+        mListenFd               = ::socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+        if ( mListenFd < 0 || ::bind( mListenFd, reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) ) != 0
+             || ::listen( mListenFd, 16 ) != 0 ) {
+            return false;
+        }
+        socklen_t addressBytes = sizeof( address );
+        if ( ::getsockname( mListenFd, reinterpret_cast<sockaddr*>( &address ), &addressBytes ) != 0 ) {
+            return false;
+        }
+        mPort = ntohs( address.sin_port );
+        return true;
+    }
+
+    void Wake()
+    {
+        const char byte = 0;
+        while ( ::write( mWakeFds[1], &byte, 1 ) < 0 && errno == EINTR ) {
+        }
+    }
+
+    void Run()
+    {
+        std::vector<int> connections;
+        auto             closeConnections = [&] {
+            for ( const int fd : connections ) {
+                ::close( fd );
+            }
+            connections.clear();
+        };
+
+        std::vector<pollfd> fds;
+        char                buffer[64 * 1024];
+        while ( true ) {
+            fds.clear();
+            fds.push_back( { mWakeFds[0], POLLIN, 0 } );
+            fds.push_back( { mListenFd, POLLIN, 0 } );
+            for ( const int fd : connections ) {
+                fds.push_back( { fd, POLLIN, 0 } );
+            }
+            if ( ::poll( fds.data(), fds.size(), -1 ) < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                break;
+            }
+
+            if ( fds[0].revents != 0 ) {
+                while ( ::read( mWakeFds[0], buffer, 1 ) < 0 && errno == EINTR ) {
+                }
+                std::lock_guard<std::mutex> lock( mMutex );
+                if ( mStopping ) {
+                    break;
+                }
+                if ( mDropsDone < mDropRequests ) {
+                    closeConnections();
+                    mDropsDone = mDropRequests;
+                    mChanged.notify_all();
+                }
+                continue;
+            }
+
+            if ( fds[1].revents != 0 ) {
+                const int fd = ::accept( mListenFd, nullptr, nullptr );
+                if ( fd >= 0 ) {
+                    ::fcntl( fd, F_SETFD, FD_CLOEXEC );
+                    connections.push_back( fd );
+                    std::lock_guard<std::mutex> lock( mMutex );
+                    mNumAccepted++;
+                }
+            }
+
+            for ( size_t i = 2; i < fds.size(); i++ ) {
+                if ( fds[i].revents == 0 ) {
+                    continue;
+                }
+                const auto numRead = ::read( fds[i].fd, buffer, sizeof( buffer ) );
+                if ( numRead > 0 ) {
+                    std::lock_guard<std::mutex> lock( mMutex );
+                    mReceived.append( buffer, static_cast<size_t>( numRead ) );
+                    mChanged.notify_all();
+                }
+                else if ( numRead == 0 || errno != EINTR ) {
+                    ::close( fds[i].fd );
+                    connections.erase( std::find( connections.begin(), connections.end(), fds[i].fd ) );
+                }
+            }
+        }
+
+        closeConnections();
+        std::lock_guard<std::mutex> lock( mMutex );
+        mDropsDone = mDropRequests;
+        mChanged.notify_all();
+    }
+
+    std::string   mUnixPath{};
+    std::uint16_t mPort{};
+    int           mListenFd{ -1 };
+    int           mWakeFds[2]{ -1, -1 };
+    std::thread   mThread{};
+
+    mutable std::mutex              mMutex{};
+    mutable std::condition_variable mChanged{};
+    std::string                     mReceived{};
+    size_t                          mNumAccepted{};
+    std::uint64_t                   mDropRequests{};
+    std::uint64_t                   mDropsDone{};
+    bool                            mStopping{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "BinaryLog.h"
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "TextLineFormat.h"
+
+namespace rtlog
+{
+
+enum class NetworkSinkFormat
+{
+    Text,   // lines as written by FormatTextLine
+    Binary, // records as in a binary log, see NetworkSink
+};
+
+struct NetworkSinkOptions
+{
+    std::string   mUnixPath{};            // connect to this Unix domain stream socket, if set
+    std::string   mHost{ "127.0.0.1" };   // otherwise to this host and port over TCP, resolved once
+    std::uint16_t mPort{};
+    bool          mNoDelay = true;        // turn off Nagle's algorithm; the sink makes its writes large itself
+
+    NetworkSinkFormat mFormat = NetworkSinkFormat::Text;
+
+    size_t mSendBytes  = 64 * 1024;       // send as soon as this much is waiting
+    size_t mSpillBytes = 4 * 1024 * 1024; // kept while disconnected or the peer is slow; newer records are dropped
+
+    std::chrono::microseconds mTimeBudget{ 2000 }; // the longest a Flush waits for the socket
+    std::chrono::milliseconds mMinReconnectDelay{ 100 };
+    std::chrono::milliseconds mMaxReconnectDelay{ 10000 };
+};
+
+/**
+ * @brief A print log function that streams records to a Unix domain socket or over TCP.
+ *
+ * NOT REALTIME SAFE - use it on the thread that processes the log queue, e.g. with a LogProcessingThread.
+ *
+ * Records are gathered in a buffer and sent with large writes, once mSendBytes are waiting or on Flush, which
+ * LogProcessingThread calls after each batch. The socket is non-blocking: neither call waits on the network for
+ * longer than mTimeBudget, so a slow or unreachable peer never holds up the processing of the log queue. What could
+ * not be sent stays in the buffer, up to mSpillBytes, past which new records are dropped and counted.
+ *
+ * When the connection fails, the sink connects again, first after mMinReconnectDelay and then after twice as long
+ * each time it fails, up to mMaxReconnectDelay. A connection the peer has closed is noticed before sending on it, and
+ * a record that was partly sent when the connection broke is sent again from its start, so the peer of each
+ * connection sees whole records only, apart from the last one of a broken connection. Records the kernel had already
+ * taken when the connection broke are lost with it.
+ *
+ * With NetworkSinkFormat::Binary each record is BinaryLogRecordHeader encoded with EncodeBinaryLogRecordHeader against
+ * an empty previous header (so the stream can be decoded from any record), then the LogData packed with LogDataTraits,
+ * then the message. The timestamp is the time the record was handed to the sink.
+ *
+ * Messages are sent whole in either format, however long; the buffer they are encoded into grows to fit the longest.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ */
+template <typename LogData>
+class NetworkSink
+{
+public:
+    explicit NetworkSink( const NetworkSinkOptions& options )
+    : mOptions( options )
+    , mReconnectDelay( options.mMinReconnectDelay )
+    {
+        mLine.resize( kMaxTextLineOverhead + 4096 );
+        ResolveAddress();
+        Connect();
+    }
+
+    ~NetworkSink()
+    {
+        Flush();
+        Disconnect();
+    }
+
+    NetworkSink( const NetworkSink& )            = delete;
+    NetworkSink& operator=( const NetworkSink& ) = delete;
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        const auto recordBytes =
+            mOptions.mFormat == NetworkSinkFormat::Text ? EncodeText( record ) : EncodeBinary( record );
+        if ( NumPendingBytes() + recordBytes > mOptions.mSpillBytes ) {
+            mNumDropped++;
+            return;
+        }
+
+        mPending.insert( mPending.end(), mLine.data(), mLine.data() + recordBytes );
+        mRecordBytes.push_back( recordBytes );
+        if ( NumPendingBytes() >= mOptions.mSendBytes ) {
+            Send( Clock::now() );
+        }
+    }
+
+    /**
+     * @brief Sends what is waiting, waiting at most mTimeBudget for the socket.
+     *
+     * @return true if everything was sent.
+     */
+    bool Flush()
+    {
+        const auto deadline = Clock::now() + mOptions.mTimeBudget;
+        while ( true ) {
+            const auto now       = Clock::now();
+            const bool connected = Send( now );
+            if ( !HasPending() ) {
+                return true;
+            }
+            // Wait for the socket to take more, or for the connection being made
+            const auto timeLeft = std::chrono::ceil<std::chrono::milliseconds>( deadline - now );
+            if ( ( !connected && !mConnecting ) || timeLeft.count() <= 0
+                 || !WaitUntilWritable( static_cast<int>( timeLeft.count() ) ) ) {
+                return false;
+            }
+        }
+    }
+
+    bool IsConnected() const
+    {
+        return mFd >= 0 && !mConnecting;
+    }
+
+    size_t NumBytesSent() const
+    {
+        return mNumBytesSent;
+    }
+
+    /**
+     * @brief Returns the number of records dropped because the spill buffer was full.
+     */
+    size_t NumDropped() const
+    {
+        return mNumDropped;
+    }
+
+    size_t NumConnects() const
+    {
+        return mNumConnects;
+    }
+
+    /**
+     * @brief Returns the number of bytes waiting to be sent.
+     */
+    size_t NumPendingBytes() const
+    {
+        return mPending.size() - mPendingStart;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    size_t EncodeText( const LogRecord<LogData>& record )
+    {
+        const auto lineBytes = kMaxTextLineOverhead + record.mMessageLength;
+        if ( mLine.size() < lineBytes ) {
+            mLine.resize( lineBytes );
+        }
+        return FormatTextLine( record, mLine.data(), mLine.size() );
+    }
+
+    size_t EncodeBinary( const LogRecord<LogData>& record )
+    {
+        unsigned char packedLogData[sizeof( LogData )];
+        const auto    packedLogDataBytes = detail::PackLogData( record.mLogData, packedLogData );
+        const auto    messageLength      = record.mMessageLength;
+
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+
+        BinaryLogRecordHeader header;
+        header.mSequenceNumber = record.mSequenceNumber;
+        header.mTimestamp      = std::chrono::duration_cast<std::chrono::nanoseconds>( now ).count();
+        header.mLevel          = LogDataTraits<LogData>::Level( record.mLogData );
+        header.mRegion         = detail::RegionOf( record.mLogData );
+        header.mThreadId       = record.mThreadId;
+        header.mLogDataBytes   = static_cast<std::uint32_t>( packedLogDataBytes );
+        header.mMessageLength  = static_cast<std::uint32_t>( messageLength );
+
+        const auto recordBytes = kMaxEncodedBinaryLogRecordHeaderBytes + packedLogDataBytes + messageLength;
+        if ( mLine.size() < recordBytes ) {
+            mLine.resize( recordBytes );
+        }
+        auto* out = reinterpret_cast<unsigned char*>( mLine.data() );
+        out       = EncodeBinaryLogRecordHeader( header, BinaryLogRecordHeader{}, out );
+        std::memcpy( out, packedLogData, packedLogDataBytes );
+        std::memcpy( out + packedLogDataBytes, record.mMessage, messageLength );
+        return static_cast<size_t>( out + packedLogDataBytes + messageLength
+                                    - reinterpret_cast<unsigned char*>( mLine.data() ) );
+    }
+
+    bool HasPending() const
+    {
+        return mPending.size() > mPendingStart;
+    }
+
+    // Sends until the socket would block. Returns false if there is no connection to send on.
+    bool Send( Clock::time_point now )
+    {
+        if ( !IsConnected() && !FinishConnecting( now ) ) {
+            return false;
+        }
+        if ( HasPending() && PeerClosed() ) {
+            Disconnect();
+            return false;
+        }
+
+        while ( HasPending() ) {
+            int flags = 0;
+#if defined( MSG_NOSIGNAL )
+            flags |= MSG_NOSIGNAL;
+#endif
+            const auto* data    = mPending.data() + mPendingStart + mFrontSentBytes;
+            const auto  numSent = ::send( mFd, data, NumPendingBytes() - mFrontSentBytes, flags );
+            if ( numSent < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                    if ( mPendingStart >= mPending.size() / 2 ) {
+                        const auto sentEnd = mPending.begin() + static_cast<std::ptrdiff_t>( mPendingStart );
+                        mPending.erase( mPending.begin(), sentEnd );
+                        mPendingStart = 0;
+                    }
+                    return true;
+                }
+                Disconnect();
+                return false;
+            }
+
+            mNumBytesSent += static_cast<size_t>( numSent );
+            mFrontSentBytes += static_cast<size_t>( numSent );
+            while ( !mRecordBytes.empty() && mFrontSentBytes >= mRecordBytes.front() ) {
+                mFrontSentBytes -= mRecordBytes.front();
+                mPendingStart += mRecordBytes.front();
+                mRecordBytes.pop_front();
+            }
+        }
+
+        mPending.clear();
+        mPendingStart = 0;
+        return true;
+    }
+
+    // The peer never sends anything, so the socket only turns readable once it has been closed
+    bool PeerClosed()
+    {
+        pollfd fd{ mFd, POLLIN, 0 };
+        if ( ::poll( &fd, 1, 0 ) <= 0 ) {
+            return false;
+        }
+        char       byte;
+        const auto numRead = ::recv( mFd, &byte, 1, MSG_PEEK | MSG_DONTWAIT );
+        return numRead == 0 || ( numRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR );
+    }
+
+    bool WaitUntilWritable( int timeoutMilliseconds )
+    {
+        pollfd fd{ mFd, POLLOUT, 0 };
+        return ::poll( &fd, 1, timeoutMilliseconds ) > 0;
+    }
+
+    void ResolveAddress()
+    {
+        if ( !mOptions.mUnixPath.empty() ) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            mOptions.mUnixPath.copy( address.sun_path, sizeof( address.sun_path ) - 1 );
+            std::memcpy( &mAddress, &address, sizeof( address ) );
+            mAddressBytes = sizeof( address );
+            mFamily       = AF_UNIX;
+            return;
+        }
+
+        addrinfo  hints{};
+        addrinfo* result = nullptr;
+        hints.ai_socktype = SOCK_STREAM;
+        const auto port   = std::to_string( mOptions.mPort );
+        if ( ::getaddrinfo( mOptions.mHost.c_str(), port.c_str(), &hints, &result ) == 0 && result != nullptr ) {
+            std::memcpy( &mAddress, result->ai_addr, result->ai_addrlen );
+            mAddressBytes = result->ai_addrlen;
+            mFamily       = result->ai_family;
+        }
+        ::freeaddrinfo( result );
+    }
+
+    void Connect()
+    {
+        if ( mAddressBytes == 0 ) {
+            ScheduleReconnect();
+            return;
+        }
+
+        mFd = ::socket( mFamily, SOCK_STREAM, 0 );
+        if ( mFd < 0 ) {
+            ScheduleReconnect();
+            return;
+        }
+        ::fcntl( mFd, F_SETFD, FD_CLOEXEC );
+        ::fcntl( mFd, F_SETFL, ::fcntl( mFd, F_GETFL ) | O_NONBLOCK );
+#if defined( SO_NOSIGPIPE )
+        const int noSigPipe = 1;
+        ::setsockopt( mFd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof( noSigPipe ) );
+#endif
+        if ( mFamily != AF_UNIX && mOptions.mNoDelay ) {
+            const int noDelay = 1;
+            ::setsockopt( mFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+        }
+
+        if ( ::connect( mFd, reinterpret_cast<const sockaddr*>( &mAddress ), mAddressBytes ) == 0 ) {
+            Connected();
+        }
+        else if ( errno == EINPROGRESS ) {
+            mConnecting = true;
+        }
+        else {
+            Disconnect();
+        }
+    }
+
+    // Checks on a connection being made, or starts a new one when it's time to
+    bool FinishConnecting( Clock::time_point now )
+    {
+        if ( mFd < 0 ) {
+            if ( now < mNextConnectAttempt ) {
+                return false;
+            }
+            Connect();
+            if ( IsConnected() ) {
+                return true;
+            }
+        }
+        if ( mFd >= 0 && mConnecting && WaitUntilWritable( 0 ) ) {
+            int       error       = 0;
+            socklen_t errorLength = sizeof( error );
+            if ( ::getsockopt( mFd, SOL_SOCKET, SO_ERROR, &error, &errorLength ) == 0 && error == 0 ) {
+                Connected();
+                return true;
+            }
+            Disconnect();
+        }
+        return false;
+    }
+
+    void Connected()
+    {
+        mConnecting     = false;
+        mReconnectDelay = mOptions.mMinReconnectDelay;
+        mNumConnects++;
+    }
+
+    void Disconnect()
+    {
+        if ( mFd >= 0 ) {
+            ::close( mFd );
+        }
+        mFd             = -1;
+        mConnecting     = false;
+        mFrontSentBytes = 0; // send the record that was cut off again, from its start
+        ScheduleReconnect();
+    }
+
+    void ScheduleReconnect()
+    {
+        mNextConnectAttempt = Clock::now() + mReconnectDelay;
+        mReconnectDelay     = std::min( mReconnectDelay * 2, mOptions.mMaxReconnectDelay );
+    }
+
+    NetworkSinkOptions        mOptions{};
+    sockaddr_storage          mAddress{};
+    socklen_t                 mAddressBytes{};
+    int                       mFamily{};
+    int                       mFd{ -1 };
+    bool                      mConnecting{};
+    Clock::time_point         mNextConnectAttempt{};
+    std::chrono::milliseconds mReconnectDelay{};
+    std::vector<char>         mLine{};
+    std::vector<char>         mPending{};
+    size_t                    mPendingStart{};   // where the first record not completely sent starts in mPending
+    size_t                    mFrontSentBytes{}; // of that record
+    std::deque<size_t>        mRecordBytes{};    // of the records waiting, so a broken connection can resend whole ones
+    size_t                    mNumBytesSent{};
+    size_t                    mNumDropped{};
+    size_t                    mNumConnects{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "MpscByteRing.h"
+
+#if defined( __linux__ )
+#include <sched.h>
+#include <unistd.h>
+#if __has_include( <sys/rseq.h> )
+#include <sys/rseq.h>
+#define RTLOG_HAS_RSEQ 1
+#endif
+#endif
+
+// Where PerCpuLanes can claim space with a restartable sequence rather than an atomic read-modify-write
+#if defined( RTLOG_HAS_RSEQ ) && ( defined( __x86_64__ ) || ( defined( __aarch64__ ) && defined( __AARCH64EL__ ) ) )
+#define RTLOG_HAS_RSEQ_COMMIT 1
+#define RTLOG_RSEQ_STRINGIFY_( x ) #x
+#define RTLOG_RSEQ_STRINGIFY( x ) RTLOG_RSEQ_STRINGIFY_( x )
+#endif
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+/**
+ * @brief Returns the CPU the calling thread is running on, or 0 if that can't be determined.
+ *
+ * REALTIME SAFE
+ *
+ * On Linux with a glibc that registers restartable sequences (2.35+), this is a plain load of the cpu_id the kernel
+ * keeps up to date in the thread's rseq area. Otherwise it falls back to sched_getcpu, which is served from the vDSO on
+ * common architectures. The answer can be stale as soon as it is returned; callers must only use it as a hint.
+ */
+inline unsigned int CurrentCpu()
+{
+#if defined( RTLOG_HAS_RSEQ )
+    if ( __rseq_size > 0 ) {
+        const auto* area = reinterpret_cast<const volatile struct rseq*>(
+            static_cast<const char*>( __builtin_thread_pointer() ) + __rseq_offset );
+        const auto cpu = static_cast<int>( area->cpu_id );
+        if ( cpu >= 0 ) {
+            return static_cast<unsigned int>( cpu );
+        }
+    }
+#endif
+#if defined( __linux__ )
+    const auto cpu = sched_getcpu();
+    return cpu >= 0 ? static_cast<unsigned int>( cpu ) : 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Returns the number of CPUs the system is configured with, online or not, at least 1.
+ */
+inline size_t NumConfiguredCpus()
+{
+#if defined( __linux__ )
+    const auto numCpus = ::sysconf( _SC_NPROCESSORS_CONF );
+    if ( numCpus > 0 ) {
+        return static_cast<size_t>( numCpus );
+    }
+#endif
+    return std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+}
+
+#if defined( RTLOG_HAS_RSEQ_COMMIT )
+
+inline struct rseq* RseqArea()
+{
+    return reinterpret_cast<struct rseq*>( static_cast<char*>( __builtin_thread_pointer() ) + __rseq_offset );
+}
+
+/**
+ * @brief Stores desired to word if word holds expected and the calling thread is still running on cpu, as a
+ * restartable sequence: if the thread is preempted, migrated or signalled before the store, the kernel moves it to the
+ * abort handler instead and nothing is stored. Returns whether desired was stored.
+ *
+ * REALTIME SAFE - plain loads and stores, no locked instruction. The thread must have rseq registered.
+ *
+ * The sequence's descriptor is filled in on the stack with the addresses of the code around it, and the abort handler
+ * follows the code, rather than both going in sections of their own: those would point into code that the linker may
+ * drop as a duplicate of another translation unit's. As the stack is reused, the descriptor is unregistered afterwards.
+ */
+inline bool
+RseqCompareAndStore( std::atomic<std::uint64_t>& atomicWord, std::uint64_t expected, std::uint64_t desired, int cpu )
+{
+    static_assert( sizeof( std::atomic<std::uint64_t> ) == sizeof( std::uint64_t )
+                       && std::atomic<std::uint64_t>::is_always_lock_free,
+                   "the restartable sequence stores to the atomic's value directly" );
+    auto*                        word = reinterpret_cast<std::uint64_t*>( &atomicWord );
+    auto*                        area = RseqArea();
+    alignas( 32 ) struct rseq_cs descriptor {};
+    bool                         stored = false;
+
+    // 1: start, 2: post commit, 4: abort handler, preceded by the signature glibc registered rseq with
+#if defined( __x86_64__ )
+    __asm__ __volatile__ goto( "leaq 1f(%%rip), %%rax\n\t"
+                               "movq %%rax, 8(%[descriptor])\n\t"
+                               "leaq 2f(%%rip), %%rcx\n\t"
+                               "subq %%rax, %%rcx\n\t"
+                               "movq %%rcx, 16(%[descriptor])\n\t"
+                               "leaq 4f(%%rip), %%rax\n\t"
+                               "movq %%rax, 24(%[descriptor])\n\t"
+                               "movq %[descriptor], %[rseqCs]\n\t"
+                               "1:\n\t"
+                               "cmpl %[cpu], %[currentCpu]\n\t"
+                               "jnz 4f\n\t"
+                               "cmpq %[word], %[expected]\n\t"
+                               "jnz %l[failed]\n\t"
+                               "movq %[desired], %[word]\n\t"
+                               "2:\n\t"
+                               "jmp 5f\n\t"
+                               ".byte 0x0f, 0xb9, 0x3d\n\t"
+                               ".long " RTLOG_RSEQ_STRINGIFY( RSEQ_SIG ) "\n\t"
+                               "4:\n\t"
+                               "jmp %l[failed]\n\t"
+                               "5:\n\t"
+                               :
+                               : [descriptor] "r"( &descriptor ),
+                                 [cpu] "r"( cpu ),
+                                 [currentCpu] "m"( area->cpu_id ),
+                                 [rseqCs] "m"( area->rseq_cs ),
+                                 [word] "m"( *word ),
+                                 [expected] "r"( expected ),
+                                 [desired] "r"( desired )
+                               : "memory", "cc", "rax", "rcx"
+                               : failed );
+#else
+    __asm__ __volatile__ goto( "adr x15, 1f\n\t"
+                               "str x15, [%[descriptor], #8]\n\t"
+                               "adr x14, 2f\n\t"
+                               "sub x14, x14, x15\n\t"
+                               "str x14, [%[descriptor], #16]\n\t"
+                               "adr x15, 4f\n\t"
+                               "str x15, [%[descriptor], #24]\n\t"
+                               "str %[descriptor], %[rseqCs]\n\t"
+                               "1:\n\t"
+                               "ldr w15, %[currentCpu]\n\t"
+                               "cmp w15, %w[cpu]\n\t"
+                               "bne 4f\n\t"
+                               "ldr x15, %[word]\n\t"
+                               "cmp x15, %[expected]\n\t"
+                               "bne %l[failed]\n\t"
+                               "str %[desired], %[word]\n\t"
+                               "2:\n\t"
+                               "b 5f\n\t"
+                               ".inst " RTLOG_RSEQ_STRINGIFY( RSEQ_SIG_CODE ) "\n\t"
+                               "4:\n\t"
+                               "b %l[failed]\n\t"
+                               "5:\n\t"
+                               :
+                               : [descriptor] "r"( &descriptor ),
+                                 [cpu] "r"( cpu ),
+                                 [currentCpu] "Qo"( area->cpu_id ),
+                                 [rseqCs] "m"( area->rseq_cs ),
+                                 [word] "Qo"( *word ),
+                                 [expected] "r"( expected ),
+                                 [desired] "r"( desired )
+                               : "memory", "cc", "x14", "x15"
+                               : failed );
+#endif
+    stored = true;
+failed:
+    __atomic_store_n( &area->rseq_cs, std::uint64_t{ 0 }, __ATOMIC_RELAXED );
+    return stored;
+}
+
+#endif // RTLOG_HAS_RSEQ_COMMIT
+
+} // namespace detail
+
+/**
+ * @brief One MpscByteRing per CPU, written to by whichever thread is currently running on that CPU.
+ *
+ * On Linux x86-64 and aarch64, where glibc has registered restartable sequences (rseq, glibc 2.35+) and there is a lane
+ * for every configured CPU, a producer claims space in its CPU's lane with a restartable sequence: it checks it is
+ * still on that CPU and that the lane's cursor is unchanged, then moves the cursor on with a plain store. If it is
+ * preempted, migrated or signalled in between, the kernel aborts the sequence and it tries again, so no two producers
+ * ever claim at once and no atomic read-modify-write is needed; the record is then copied in and committed with a
+ * plain release store. Elsewhere, producers pick the lane of the CPU they are on and claim space with the lane's
+ * fetch_add, which stays uncontended as a lane is almost only ever touched by one CPU, and a thread that is migrated
+ * or preempted mid-write still ends up correct because the lanes are multiple producer safe. See
+ * UsesRestartableSequences. Either way memory scales with the number of CPUs rather than the number of threads.
+ *
+ * The consumer drains all lanes with a k-way merge on a caller supplied ordering key (the Logger uses its sequence
+ * number), so the records committed by the time a drain runs come out of it in order across lanes. A record committed
+ * late, by a producer preempted mid-write, comes out of a later drain, after records with higher keys.
+ *
+ * @tparam CapacityBytesPerLane The capacity of each lane, see MpscByteRing.
+ * @tparam MaxRecordBytes The largest record that will be written, see MpscByteRing.
+ */
+template <size_t CapacityBytesPerLane, size_t MaxRecordBytes>
+class PerCpuLanes
+{
+public:
+    using Lane = MpscByteRing<CapacityBytesPerLane, MaxRecordBytes>;
+
+    /**
+     * @brief Allocates one lane per CPU. NOT REALTIME SAFE.
+     *
+     * @param numLanes The number of lanes, defaults to the number of configured CPUs. With fewer lanes than that,
+     * lanes are shared between CPUs, and claimed with fetch_add.
+     */
+    explicit PerCpuLanes( size_t numLanes = detail::NumConfiguredCpus() )
+    {
+        numLanes = std::max<size_t>( numLanes, 1 );
+        mLanes.reserve( numLanes );
+        for ( size_t i = 0; i < numLanes; i++ ) {
+            mLanes.push_back( std::make_unique<Lane>() );
+        }
+        mHeadKeys.resize( numLanes );
+#if defined( RTLOG_HAS_RSEQ_COMMIT )
+        // A lane written with restartable sequences must only ever be written from its own CPU
+        mUsesRseq = __rseq_size > 0 && numLanes >= detail::NumConfiguredCpus();
+#endif
+    }
+
+    /**
+     * @brief Writes the record into the current CPU's lane. Same rules as MpscByteRing::TryWrite.
+     */
+    bool TryWrite( std::initializer_list<typename Lane::ByteSpan> parts )
+    {
+#if defined( RTLOG_HAS_RSEQ_COMMIT )
+        if ( mUsesRseq ) {
+            return TryWriteRseq( parts );
+        }
+#endif
+        auto& lane = *mLanes[detail::CurrentCpu() % mLanes.size()];
+        return lane.TryWrite( parts );
+    }
+
+    bool TryWrite( const void* header, size_t headerBytes, const void* payload, size_t payloadBytes )
+    {
+        using ByteSpan = typename Lane::ByteSpan;
+        return TryWrite( { ByteSpan{ header, headerBytes }, ByteSpan{ payload, payloadBytes } } );
+    }
+
+    /**
+     * @brief Returns true if producers claim space with restartable sequences rather than with fetch_add.
+     */
+    bool UsesRestartableSequences() const
+    {
+        return mUsesRseq;
+    }
+
+    /**
+     * @brief Hands every committed record of every lane to readFn, smallest key first, and frees them.
+     *
+     * NOT REALTIME SAFE unless readFn and keyFn are. Must only be called from one thread at a time.
+     *
+     * Records within one lane are always handed out in the order they were written to it.
+     *
+     * @tparam KeyFn Callable as keyFn( const void* data, size_t numBytes ) -> std::uint64_t
+     * @tparam ReadFn Callable as readFn( const void* data, size_t numBytes )
+     * @return size_t The number of records read.
+     */
+    template <typename KeyFn, typename ReadFn>
+    size_t ReadAll( KeyFn&& keyFn, ReadFn&& readFn )
+    {
+        constexpr auto kEmpty = std::numeric_limits<std::uint64_t>::max();
+
+        for ( size_t i = 0; i < mLanes.size(); i++ ) {
+            mHeadKeys[i] = PeekKey( *mLanes[i], keyFn, kEmpty );
+        }
+
+        size_t numRead = 0;
+        while ( true ) {
+            const auto oldest = std::min_element( mHeadKeys.begin(), mHeadKeys.end() );
+            if ( *oldest == kEmpty ) {
+                break;
+            }
+
+            auto& lane = *mLanes[static_cast<size_t>( oldest - mHeadKeys.begin() )];
+            lane.ReadOne( readFn );
+            numRead++;
+
+            *oldest = PeekKey( lane, keyFn, kEmpty );
+        }
+        return numRead;
+    }
+
+    /**
+     * @brief Returns the number of bytes in the fullest lane. May be stale by the time it returns.
+     */
+    size_t SizeApprox() const
+    {
+        size_t fullest = 0;
+        for ( const auto& lane : mLanes ) {
+            fullest = std::max( fullest, lane->SizeApprox() );
+        }
+        return fullest;
+    }
+
+    /**
+     * @brief Returns the number of bytes in the lane of the CPU the caller is running on. May be stale by the time it
+     * returns.
+     */
+    size_t CurrentLaneSizeApprox() const
+    {
+        return mLanes[detail::CurrentCpu() % mLanes.size()]->SizeApprox();
+    }
+
+    static constexpr size_t Capacity()
+    {
+        return CapacityBytesPerLane;
+    }
+
+    size_t NumLanes() const
+    {
+        return mLanes.size();
+    }
+
+private:
+#if defined( RTLOG_HAS_RSEQ_COMMIT )
+    // Only retries when the thread was preempted, migrated or signalled between looking at the lane and claiming
+    bool TryWriteRseq( std::initializer_list<typename Lane::ByteSpan> parts )
+    {
+        while ( true ) {
+            // A thread glibc couldn't register rseq for can't take part, and mustn't race the ones that do
+            const auto cpu = static_cast<int>( detail::RseqArea()->cpu_id );
+            if ( cpu < 0 || static_cast<size_t>( cpu ) >= mLanes.size() ) {
+                return false;
+            }
+
+            const auto result = mLanes[static_cast<size_t>( cpu )]->TryWriteExclusive(
+                parts, [cpu]( std::atomic<std::uint64_t>& cursor, std::uint64_t expected, std::uint64_t desired ) {
+                    return detail::RseqCompareAndStore( cursor, expected, desired, cpu );
+                } );
+            if ( result != Lane::ExclusiveWriteResult::Interrupted ) {
+                return result == Lane::ExclusiveWriteResult::Written;
+            }
+        }
+    }
+#endif
+
+    template <typename KeyFn>
+    static std::uint64_t PeekKey( Lane& lane, KeyFn& keyFn, std::uint64_t emptyKey )
+    {
+        auto key = emptyKey;
+        lane.Peek( [&]( const void* data, size_t numBytes ) { key = keyFn( data, numBytes ); } );
+        return key;
+    }
+
+    std::vector<std::unique_ptr<Lane>> mLanes{};
+    std::vector<std::uint64_t>         mHeadKeys{};
+    bool                               mUsesRseq{};
+};
+
+} // namespace rtlog
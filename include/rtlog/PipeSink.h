@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "LogRecord.h"
+#include "TextLineFormat.h"
+
+namespace rtlog
+{
+
+struct PipeSinkOptions
+{
+    size_t mPipeBytes    = 0;  // resize the pipe to this with F_SETPIPE_SZ; 0 leaves it as it is
+    size_t mMaxLineBytes = 4096; // longer lines are cut short
+
+    bool          mTimestamps    = false; // start lines with the time they are written, see TimestampFormatter
+    TimestampZone mTimestampZone = TimestampZone::Utc;
+};
+
+/**
+ * @brief A print log function that hands text lines to another process through a pipe without copying them.
+ *
+ * NOT REALTIME SAFE - use it on the thread that processes the log queue, e.g. with a LogProcessingThread.
+ *
+ * Each record is formatted with FormatTextLine into a page aligned ring buffer, and the lines gathered since the last
+ * time are handed to the pipe with a single vmsplice on Flush, or whenever half the pipe's worth is waiting. vmsplice
+ * makes the pipe point at the ring's pages rather than copying them, so the kernel never copies the log bytes on the
+ * way in, and the reader gets them with its one read.
+ *
+ * Since the pipe refers to the ring's pages until they are read, the ring is over twice as large as the pipe and is
+ * only spliced in pieces of up to half the pipe: vmsplice blocks while the pipe is full, so by the time the ring comes
+ * round to a page again, everything spliced before it has been read out of the pipe. That relies on the reader
+ * reading the pipe, with read or with splice into a file; splicing it into a socket can keep the pages referenced after
+ * they leave the pipe. Pages are not gifted (SPLICE_F_GIFT), as they are reused and current kernels don't move them.
+ *
+ * Where vmsplice isn't available, or the file descriptor is not a pipe, the lines are written with write instead.
+ *
+ * @tparam LogData The LogData of the logger this is used with.
+ */
+template <typename LogData>
+class PipeSink
+{
+public:
+    /**
+     * @param pipeFd The write end of a pipe, which is not closed by the sink. Leave it blocking.
+     * @param options Pipe and line sizes.
+     */
+    explicit PipeSink( int pipeFd, const PipeSinkOptions& options = {} )
+    : mFd( pipeFd )
+    , mMaxLineBytes( std::max( options.mMaxLineBytes, kMaxTextLineOverhead ) )
+    , mLine( mMaxLineBytes )
+    {
+        if ( options.mTimestamps ) {
+            mTimestamps.emplace( 6, options.mTimestampZone );
+        }
+        const auto pageBytes = static_cast<size_t>( ::sysconf( _SC_PAGESIZE ) );
+        size_t     pipeBytes = 64 * 1024;
+#if defined( __linux__ )
+        if ( options.mPipeBytes > 0 ) {
+            ::fcntl( mFd, F_SETPIPE_SZ, static_cast<int>( options.mPipeBytes ) );
+        }
+        const int currentPipeBytes = ::fcntl( mFd, F_GETPIPE_SZ );
+        mUsesVmsplice              = currentPipeBytes > 0;
+        pipeBytes                  = currentPipeBytes > 0 ? static_cast<size_t>( currentPipeBytes ) : pipeBytes;
+#endif
+        mSpliceThreshold = std::max( pipeBytes / 2, pageBytes );
+        mRingBytes = ( 2 * pipeBytes + mSpliceThreshold + mMaxLineBytes + pageBytes - 1 ) / pageBytes * pageBytes;
+
+        void* ring = ::mmap( nullptr, mRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( ring == MAP_FAILED ) {
+            mRingBytes = 0;
+            return;
+        }
+        mRing = static_cast<char*>( ring );
+    }
+
+    ~PipeSink()
+    {
+        Flush();
+        if ( mRing != nullptr ) {
+            ::munmap( mRing, mRingBytes );
+        }
+    }
+
+    PipeSink( const PipeSink& )            = delete;
+    PipeSink& operator=( const PipeSink& ) = delete;
+
+    void operator()( const LogRecord<LogData>& record )
+    {
+        if ( mRing == nullptr ) {
+            mNumWriteErrors++;
+            return;
+        }
+
+        auto*      timestamps = mTimestamps ? &*mTimestamps : nullptr;
+        const auto length     = FormatTextLine( record, mLine.data(), mLine.size(), timestamps );
+        if ( mNumPending + length > mSpliceThreshold ) {
+            Flush();
+        }
+
+        // A line may wrap around the end of the ring; the splice then takes two pieces
+        const auto start      = ( mPendingStart + mNumPending ) % mRingBytes;
+        const auto firstBytes = std::min( length, mRingBytes - start );
+        std::memcpy( mRing + start, mLine.data(), firstBytes );
+        std::memcpy( mRing, mLine.data() + firstBytes, length - firstBytes );
+        mNumPending += length;
+    }
+
+    /**
+     * @brief Hands the lines gathered so far to the pipe, blocking while the pipe is full.
+     *
+     * @return false if they could not be written. They are dropped either way.
+     */
+    bool Flush()
+    {
+        bool written = true;
+        while ( mNumPending > 0 ) {
+            const auto firstBytes = std::min( mNumPending, mRingBytes - mPendingStart );
+            struct iovec pieces[2] = { { mRing + mPendingStart, firstBytes }, { mRing, mNumPending - firstBytes } };
+
+            const auto numWritten = Write( pieces, firstBytes == mNumPending ? 1 : 2 );
+            if ( numWritten < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                written = false;
+                mNumWriteErrors++;
+                mPendingStart = ( mPendingStart + mNumPending ) % mRingBytes;
+                mNumPending   = 0;
+                break;
+            }
+            mPendingStart = ( mPendingStart + static_cast<size_t>( numWritten ) ) % mRingBytes;
+            mNumPending -= static_cast<size_t>( numWritten );
+            mNumBytesWritten += static_cast<size_t>( numWritten );
+        }
+        return written;
+    }
+
+    /**
+     * @brief Returns whether lines are handed over with vmsplice, rather than copied with write.
+     */
+    bool UsesVmsplice() const
+    {
+        return mUsesVmsplice;
+    }
+
+    size_t NumBytesWritten() const
+    {
+        return mNumBytesWritten;
+    }
+
+    /**
+     * @brief Returns the number of times lines were dropped, because the pipe could not be written.
+     */
+    size_t NumWriteErrors() const
+    {
+        return mNumWriteErrors;
+    }
+
+private:
+    ssize_t Write( const struct iovec* pieces, int numPieces )
+    {
+#if defined( __linux__ )
+        if ( mUsesVmsplice ) {
+            const auto numWritten = ::vmsplice( mFd, pieces, static_cast<size_t>( numPieces ), 0 );
+            if ( numWritten >= 0 || ( errno != EINVAL && errno != ENOSYS ) ) {
+                return numWritten;
+            }
+            mUsesVmsplice = false;
+        }
+#endif
+        return ::writev( mFd, pieces, numPieces );
+    }
+
+    int                               mFd{ -1 };
+    size_t                            mMaxLineBytes{};
+    std::vector<char>                 mLine{};
+    std::optional<TimestampFormatter> mTimestamps{};
+    char*                             mRing{};
+    size_t                            mRingBytes{};
+    size_t                            mSpliceThreshold{}; // splice once this much is waiting, at most half the pipe
+    size_t                            mPendingStart{};    // of the lines not handed to the pipe yet, in the ring
+    size_t                            mNumPending{};
+    bool                              mUsesVmsplice{};
+    size_t                            mNumBytesWritten{};
+    size_t                            mNumWriteErrors{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "ConsumerWakeup.h"
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "Logger.h"
+
+namespace rtlog
+{
+
+/**
+ * @brief The order in which PriorityLogger::PrintAndClearLogQueue hands out messages.
+ */
+enum class DrainOrder
+{
+    /** All queued messages of the highest priority first, then the next priority down, and so on. */
+    HighestPriorityFirst,
+
+    /**
+     * All queued messages in sequence number order, as if they had gone through a single queue. Messages are staged
+     * on the processing thread to merge them, in memory allocated on construction for MaxNumMessages per priority; if
+     * more than that are queued, they come out in batches sorted within themselves. A flood of low priority messages
+     * still can't push out the high priority ones, since each priority has its own queue.
+     */
+    SequenceNumber,
+};
+
+/**
+ * @brief A logger with a separate queue per priority, so a backlog of low level messages never delays or crowds out a
+ * severe one.
+ *
+ * Each message is routed by its level (read with LogDataTraits) into one of NumPriorities Loggers. Priority i takes
+ * levels from priorityLevels[i - 1] up to, but not including, priorityLevels[i]; by default priority i takes level i,
+ * and the highest priority takes every level above too. Each priority has room for MaxNumMessages messages.
+ *
+ * Has the same Log, LogFmt, PrintAndClearLogQueue, WaitForWork and WakeConsumer as Logger, so it can be used with
+ * LogProcessingThread. The queues share one ConsumerWakeup, so a producer filling up any of them wakes the consumer.
+ *
+ * @tparam NumPriorities The number of queues.
+ * @tparam QPolicy The QueuePolicy of each of the queues.
+ */
+template <typename LogData,
+          size_t                    MaxNumMessages,
+          size_t                    MaxMessageLength,
+          std::atomic<std::size_t>& SequenceNumber,
+          size_t                    NumPriorities,
+          QueuePolicy               QPolicy = QueuePolicy::SingleProducerSingleConsumer>
+class PriorityLogger
+{
+    static_assert( NumPriorities > 0, "A PriorityLogger needs at least one priority" );
+
+public:
+    using LoggerType = Logger<LogData, MaxNumMessages, MaxMessageLength, SequenceNumber, QPolicy>;
+
+    /**
+     * @brief NOT REALTIME SAFE
+     *
+     * @param drainOrder See DrainOrder.
+     * @param priorityLevels The lowest level of each priority above the first, in increasing order.
+     */
+    explicit PriorityLogger( DrainOrder                                drainOrder     = DrainOrder::HighestPriorityFirst,
+                             const std::array<int, NumPriorities - 1>& priorityLevels = DefaultPriorityLevels() )
+    : mDrainOrder( drainOrder )
+    , mPriorityLevels( priorityLevels )
+    {
+        for ( auto& logger : mLoggers ) {
+            logger.UseConsumerWakeup( mWakeup );
+        }
+        if ( mDrainOrder == DrainOrder::SequenceNumber ) {
+            mStaged.resize( NumPriorities * MaxNumMessages );
+            mStagedOrder.reserve( NumPriorities * MaxNumMessages );
+        }
+    }
+
+    /**
+     * @brief Logs a message into the queue of its priority. See Logger::Log.
+     *
+     * REALTIME SAFE - except on systems where va_args allocates
+     */
+    Status Log( LogData&& inputData, const char* format, ... ) __attribute__( ( format( printf, 3, 4 ) ) )
+    {
+        auto& logger = mLoggers[PriorityOf( inputData )];
+
+        va_list args;
+        va_start( args, format );
+        const auto retVal = logger.LogV( std::forward<LogData>( inputData ), format, args );
+        va_end( args );
+        return retVal;
+    }
+
+#ifdef RTLOG_USE_FMTLIB
+
+    /**
+     * @brief Logs a message into the queue of its priority. See Logger::LogFmt.
+     *
+     * REALTIME SAFE ON ALL SYSTEMS!
+     */
+    template <typename... T>
+    Status LogFmt( LogData&& inputData, fmt::format_string<T...> fmtString, T&&... args )
+    {
+        auto& logger = mLoggers[PriorityOf( inputData )];
+        return logger.LogFmt( std::forward<LogData>( inputData ), fmtString, std::forward<T>( args )... );
+    }
+
+#endif // RTLOG_USE_FMTLIB
+
+    /**
+     * @brief See Logger::WarmUpCurrentThread. NOT REALTIME SAFE
+     */
+    bool WarmUpCurrentThread()
+    {
+        bool ready = true;
+        for ( auto& logger : mLoggers ) {
+            ready = logger.WarmUpCurrentThread() && ready;
+        }
+        return ready;
+    }
+
+    /**
+     * @brief See Logger::SetStackCaptureLevel. REALTIME SAFE
+     */
+    void SetStackCaptureLevel( int level )
+    {
+        for ( auto& logger : mLoggers ) {
+            logger.SetStackCaptureLevel( level );
+        }
+    }
+
+    /**
+     * @brief See Logger::EnableEarlyWake. The consumer is woken once the queue of any priority fills up to fill.
+     *
+     * REALTIME SAFE
+     */
+    void EnableEarlyWake( float fill = 0.5f, WakePolicy policy = WakePolicy::Futex )
+    {
+        for ( auto& logger : mLoggers ) {
+            logger.EnableEarlyWake( fill, policy );
+        }
+    }
+
+    void DisableEarlyWake()
+    {
+        for ( auto& logger : mLoggers ) {
+            logger.DisableEarlyWake();
+        }
+    }
+
+    /**
+     * @brief See Logger::WakeConsumer. REALTIME SAFE, as far as the WakePolicy is.
+     */
+    void WakeConsumer()
+    {
+        mLoggers[0].WakeConsumer();
+    }
+
+    /**
+     * @brief See Logger::WaitForWork. NOT REALTIME SAFE - call it from the thread that calls PrintAndClearLogQueue
+     */
+    bool WaitForWork( std::chrono::milliseconds timeout )
+    {
+        return mLoggers[0].WaitForWork( timeout );
+    }
+
+    /**
+     * @brief Processes and prints all queued log data, in the DrainOrder given on construction.
+     *
+     * ONLY REALTIME SAFE IF printLogFn IS REALTIME SAFE! - not generally the case
+     *
+     * @return int The number of log messages that were processed and printed.
+     */
+    template <typename PrintLogFn>
+    int PrintAndClearLogQueue( PrintLogFn& printLogFn )
+    {
+        int numProcessed = 0;
+
+        if ( mDrainOrder == DrainOrder::HighestPriorityFirst ) {
+            for ( size_t i = NumPriorities; i-- > 0; ) {
+                numProcessed += mLoggers[i].PrintAndClearLogQueue( printLogFn );
+            }
+            return numProcessed;
+        }
+
+        auto stageFn = [this, &printLogFn]( const LogRecord<LogData>& record ) {
+            if ( mStagedOrder.size() == mStaged.size() ) {
+                PrintStaged( printLogFn );
+            }
+            Stage( record );
+        };
+        for ( auto& logger : mLoggers ) {
+            numProcessed += logger.PrintAndClearLogQueue( stageFn );
+        }
+        PrintStaged( printLogFn );
+        return numProcessed;
+    }
+
+    /**
+     * @brief Returns the number of messages the queue of each priority holds.
+     */
+    static constexpr size_t QueueCapacity()
+    {
+        return MaxNumMessages;
+    }
+
+    /**
+     * @brief Returns the priority messages with this LogData are logged at.
+     */
+    size_t PriorityOf( const LogData& data ) const
+    {
+        const auto level = LogDataTraits<LogData>::Level( data );
+        return static_cast<size_t>(
+            std::upper_bound( mPriorityLevels.begin(), mPriorityLevels.end(), level ) - mPriorityLevels.begin() );
+    }
+
+    /**
+     * @brief Returns the logger holding the messages of one priority, for instance to enable load shedding on it.
+     */
+    LoggerType& GetLogger( size_t priority )
+    {
+        return mLoggers[priority];
+    }
+
+private:
+    struct StagedRecord
+    {
+        LogData                                   mLogData{};
+        size_t                                    mSequenceNumber{};
+        size_t                                    mMessageLength{};
+        std::uint32_t                             mThreadId{};
+        size_t                                    mNumStackFrames{};
+        std::array<void*, RTLOG_MAX_STACK_FRAMES> mStackFrames{};
+        std::array<char, MaxMessageLength>        mMessage{};
+    };
+
+    static std::array<int, NumPriorities - 1> DefaultPriorityLevels()
+    {
+        std::array<int, NumPriorities - 1> levels{};
+        for ( size_t i = 0; i < levels.size(); i++ ) {
+            levels[i] = static_cast<int>( i + 1 );
+        }
+        return levels;
+    }
+
+    template <typename PrintLogFn>
+    void PrintStaged( PrintLogFn& printLogFn )
+    {
+        std::sort( mStagedOrder.begin(), mStagedOrder.end(), [this]( size_t a, size_t b ) {
+            return mStaged[a].mSequenceNumber < mStaged[b].mSequenceNumber;
+        } );
+        for ( const auto index : mStagedOrder ) {
+            const auto&              staged = mStaged[index];
+            const LogRecord<LogData> record{ staged.mLogData,
+                                             staged.mSequenceNumber,
+                                             staged.mMessage.data(),
+                                             staged.mMessageLength,
+                                             staged.mThreadId,
+                                             staged.mStackFrames.data(),
+                                             staged.mNumStackFrames };
+            PrintLogRecord( printLogFn, record );
+        }
+        mStagedOrder.clear();
+    }
+
+    void Stage( const LogRecord<LogData>& record )
+    {
+        const auto index  = mStagedOrder.size();
+        auto&      staged = mStaged[index];
+
+        staged.mLogData        = record.mLogData;
+        staged.mSequenceNumber = record.mSequenceNumber;
+        staged.mThreadId       = record.mThreadId;
+        staged.mMessageLength  = std::min( record.mMessageLength, MaxMessageLength - 1 );
+        std::memcpy( staged.mMessage.data(), record.mMessage, staged.mMessageLength );
+        staged.mMessage[staged.mMessageLength] = '\0';
+#if RTLOG_MAX_STACK_FRAMES > 0
+        staged.mNumStackFrames = std::min( record.mNumStackFrames, staged.mStackFrames.size() );
+        std::copy_n( record.mStackFrames, staged.mNumStackFrames, staged.mStackFrames.begin() );
+#endif
+
+        mStagedOrder.push_back( index );
+    }
+
+    ConsumerWakeup                        mWakeup{};
+    std::array<LoggerType, NumPriorities> mLoggers{};
+    DrainOrder                            mDrainOrder{};
+    std::array<int, NumPriorities - 1>    mPriorityLevels{};
+    std::vector<StagedRecord>             mStaged{};
+    std::vector<size_t>                   mStagedOrder{};
+};
+
+} // namespace rtlog
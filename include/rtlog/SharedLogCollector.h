@@ -0,0 +1,395 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "SharedLogRing.h"
+
+namespace rtlog
+{
+
+/**
+ * @brief The LogData of the records a SharedLogCollector hands on: where and when each one was logged.
+ */
+struct SharedLogData
+{
+    int           level{};
+    int           region{};
+    std::uint32_t processId{};
+    std::int64_t  timestamp{}; // nanoseconds since the epoch, taken by the producer
+    char          processName[kSharedLogMaxNameLength + 1]{};
+};
+
+template <>
+struct LogDataTraits<SharedLogData>
+{
+    static int Level( const SharedLogData& data )
+    {
+        return data.level;
+    }
+
+    static int Region( const SharedLogData& data )
+    {
+        return data.region;
+    }
+
+    // Binary logs store level and region anyway, so only the process and time are packed, and the name's characters
+    static size_t Pack( const SharedLogData& data, unsigned char* out )
+    {
+        const auto nameLength = static_cast<unsigned char>( ::strnlen( data.processName, kSharedLogMaxNameLength ) );
+        std::memcpy( out, &data.processId, sizeof( data.processId ) );
+        std::memcpy( out + 4, &data.timestamp, sizeof( data.timestamp ) );
+        out[12] = nameLength;
+        std::memcpy( out + 13, data.processName, nameLength );
+        return 13 + size_t{ nameLength };
+    }
+
+    static bool Unpack( const unsigned char* packed, size_t numBytes, SharedLogData& data )
+    {
+        if ( numBytes < 13 || packed[12] > kSharedLogMaxNameLength || numBytes != 13 + size_t{ packed[12] } ) {
+            return false;
+        }
+        std::memcpy( &data.processId, packed, sizeof( data.processId ) );
+        std::memcpy( &data.timestamp, packed + 4, sizeof( data.timestamp ) );
+        std::memcpy( data.processName, packed + 13, packed[12] );
+        data.processName[packed[12]] = '\0';
+        return true;
+    }
+};
+
+namespace detail
+{
+
+// Maps the ring file at path if it is a shared log ring of these sizes, or returns nullptr. Sets inode to the file's.
+template <size_t CapacityBytes, size_t MaxMessageLength>
+SharedLogRingLayout<CapacityBytes, MaxMessageLength>* MapSharedLogRing( const std::string& path,
+                                                                        bool               writable,
+                                                                        ino_t&             inode )
+{
+    using Layout = SharedLogRingLayout<CapacityBytes, MaxMessageLength>;
+
+    const int fd = ::open( path.c_str(), ( writable ? O_RDWR : O_RDONLY ) | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return nullptr;
+    }
+    struct stat status
+    {
+    };
+    void*      mapping    = MAP_FAILED;
+    const auto protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    if ( ::fstat( fd, &status ) == 0 && static_cast<size_t>( status.st_size ) == sizeof( Layout ) ) {
+        mapping = ::mmap( nullptr, sizeof( Layout ), protection, MAP_SHARED, fd, 0 );
+    }
+    ::close( fd );
+    if ( mapping == MAP_FAILED ) {
+        return nullptr;
+    }
+
+    auto*       layout = static_cast<Layout*>( mapping );
+    const auto& header = layout->mHeader;
+    if ( header.mMagic.load( std::memory_order_acquire ) != kSharedLogRingMagic
+         || header.mVersion != kSharedLogRingVersion || header.mCapacityBytes != CapacityBytes
+         || header.mMaxMessageLength != MaxMessageLength ) {
+        ::munmap( mapping, sizeof( Layout ) );
+        return nullptr;
+    }
+    inode = status.st_ino;
+    return layout;
+}
+
+// Turns a record of a shared log ring into a LogRecord, copying the message into message, null terminated.
+// data carries the process, the rest of it is filled in from the record.
+template <size_t MaxMessageLength>
+LogRecord<SharedLogData> ToSharedLogRecord( const char*                             bytes,
+                                            size_t                                  numBytes,
+                                            size_t                                  sequenceNumber,
+                                            SharedLogData&                          data,
+                                            std::array<char, MaxMessageLength + 1>& message )
+{
+    // Records too short for a header only turn up in damaged rings
+    SharedLogRecordHeader header{};
+    std::memcpy( &header, bytes, std::min( numBytes, sizeof( header ) ) );
+    const auto messageLength = std::min<size_t>(
+        { header.mMessageLength, numBytes - std::min( numBytes, sizeof( header ) ), MaxMessageLength } );
+    std::memcpy( message.data(), bytes + sizeof( header ), messageLength );
+    message[messageLength] = '\0';
+
+    data.level     = header.mLevel;
+    data.region    = header.mRegion;
+    data.timestamp = header.mTimestamp;
+    return { data, sequenceNumber, message.data(), messageLength, header.mThreadId };
+}
+
+} // namespace detail
+
+struct SharedLogCollectorOptions
+{
+    // Records are held back until they are this old, so that records from slower rings can still be merged in ahead
+    // of them
+    std::chrono::nanoseconds mMergeDelay{ std::chrono::milliseconds( 5 ) };
+};
+
+/**
+ * @brief Drains the shared log rings of many processes (see SharedLogger) into one stream, ordered by the time the
+ * records were logged.
+ *
+ * NOT REALTIME SAFE - meant for one collector process per host, see the rtlogd example.
+ *
+ * Rescan looks for ring files in the directory, maps the ones it doesn't know yet, and removes the ones whose
+ * producer has closed them or died once they have been drained. Rings holding anything a SharedLogger can't have
+ * written there, which any user who can write to the directory could plant, are detached as corrupt and left alone
+ * from then on, see NumCorruptRings. Drain merges the heads of all rings by their
+ * producer timestamp and hands each record to a print log function as a LogRecord<SharedLogData>, numbered with the
+ * collector's own sequence numbers. Any print log function works, e.g. ConsoleSink or BinaryLogSink.
+ *
+ * Must be used from one thread, and be the only collector of the directory.
+ *
+ * @tparam CapacityBytes, MaxMessageLength Those of the SharedLoggers; rings of other sizes are ignored.
+ */
+template <size_t CapacityBytes    = kDefaultSharedLogRingBytes,
+          size_t MaxMessageLength = kDefaultSharedLogMaxMessageLength>
+class SharedLogCollector
+{
+public:
+    using Layout = SharedLogRingLayout<CapacityBytes, MaxMessageLength>;
+
+    explicit SharedLogCollector( std::string directory, const SharedLogCollectorOptions& options = {} )
+    : mDirectory( std::move( directory ) )
+    , mOptions( options )
+    {
+    }
+
+    ~SharedLogCollector()
+    {
+        for ( const auto& ring : mRings ) {
+            ::munmap( ring->mLayout, sizeof( Layout ) );
+        }
+    }
+
+    SharedLogCollector( const SharedLogCollector& )            = delete;
+    SharedLogCollector& operator=( const SharedLogCollector& ) = delete;
+
+    /**
+     * @brief Attaches to new rings in the directory, and detaches from and removes finished ones.
+     *
+     * @return The number of rings attached to.
+     */
+    size_t Rescan()
+    {
+        RemoveFinishedRings();
+
+        DIR* directory = ::opendir( mDirectory.c_str() );
+        if ( directory == nullptr ) {
+            return mRings.size();
+        }
+        constexpr size_t kExtensionLength = sizeof( kSharedLogRingExtension ) - 1;
+        while ( const dirent* entry = ::readdir( directory ) ) {
+            const std::string name = entry->d_name;
+            if ( name.size() > kExtensionLength
+                 && name.compare( name.size() - kExtensionLength, kExtensionLength, kSharedLogRingExtension ) == 0 ) {
+                Attach( mDirectory + "/" + name );
+            }
+        }
+        ::closedir( directory );
+        return mRings.size();
+    }
+
+    /**
+     * @brief Hands the records of all rings to printLogFn, oldest first.
+     *
+     * @param drainAll Also hand on records younger than mMergeDelay, e.g. before shutting down.
+     * @return The number of records handed on.
+     */
+    template <typename PrintLogFn>
+    int Drain( PrintLogFn& printLogFn, bool drainAll = false )
+    {
+        const auto mergeDelay = std::chrono::duration_cast<std::chrono::nanoseconds>( mOptions.mMergeDelay ).count();
+        const auto horizon    = drainAll ? INT64_MAX : detail::SharedLogTimestamp() - mergeDelay;
+
+        int numDrained = 0;
+        while ( true ) {
+            AttachedRing* oldest = nullptr;
+            for ( const auto& ring : mRings ) {
+                if ( HasHead( *ring )
+                     && ( oldest == nullptr || ring->mHeadTimestamp < oldest->mHeadTimestamp
+                          || ( ring->mHeadTimestamp == oldest->mHeadTimestamp
+                               && ring->mData.processId < oldest->mData.processId ) ) ) {
+                    oldest = ring.get();
+                }
+            }
+            if ( oldest == nullptr || oldest->mHeadTimestamp > horizon ) {
+                return numDrained;
+            }
+
+            oldest->mHasHead = false;
+            if ( !oldest->mLayout->mRing.ReadOne( [&]( const void* data, size_t numBytes ) {
+                     Print( printLogFn, *oldest, static_cast<const char*>( data ), numBytes );
+                 } ) ) {
+                // The head changed under us, which no SharedLogger does
+                oldest->mIsCorrupt = true;
+                continue;
+            }
+            numDrained++;
+        }
+    }
+
+    size_t NumRings() const
+    {
+        return mRings.size();
+    }
+
+    /**
+     * @brief Returns the number of rings detached because they were corrupt.
+     */
+    size_t NumCorruptRings() const
+    {
+        return mCorruptRings.size();
+    }
+
+private:
+    struct AttachedRing
+    {
+        std::string   mPath{};
+        ino_t         mInode{};
+        Layout*       mLayout{};
+        SharedLogData mData{}; // the process and its name, filled in per record with the rest
+        bool          mHasHead{};
+        bool          mIsCorrupt{};
+        std::int64_t  mHeadTimestamp{};
+    };
+
+    struct RingFile
+    {
+        std::string mPath{};
+        ino_t       mInode{};
+    };
+
+    void Attach( const std::string& path )
+    {
+        struct stat status
+        {
+        };
+        if ( ::stat( path.c_str(), &status ) != 0 ) {
+            return;
+        }
+        for ( const auto& ring : mRings ) {
+            if ( ring->mPath == path && ring->mInode == status.st_ino ) {
+                return;
+            }
+        }
+        for ( const auto& corrupt : mCorruptRings ) {
+            if ( corrupt.mPath == path && corrupt.mInode == status.st_ino ) {
+                return;
+            }
+        }
+
+        ino_t inode  = 0;
+        auto* layout = detail::MapSharedLogRing<CapacityBytes, MaxMessageLength>( path, true, inode );
+        if ( layout == nullptr ) {
+            return;
+        }
+
+        auto ring             = std::make_unique<AttachedRing>();
+        ring->mPath           = path;
+        ring->mInode          = inode;
+        ring->mLayout         = layout;
+        ring->mData.processId = layout->mHeader.mProcessId;
+        std::memcpy( ring->mData.processName, layout->mHeader.mName, kSharedLogMaxNameLength );
+        mRings.push_back( std::move( ring ) );
+    }
+
+    void RemoveFinishedRings()
+    {
+        auto finished = [this]( const std::unique_ptr<AttachedRing>& ring ) {
+            HasHead( *ring );
+            if ( ring->mIsCorrupt ) {
+                // Left in place: whoever planted it may not be a SharedLogger, and it may not be ours to remove
+                mCorruptRings.push_back( { ring->mPath, ring->mInode } );
+                ::munmap( ring->mLayout, sizeof( Layout ) );
+                return true;
+            }
+
+            const auto& header = ring->mLayout->mHeader;
+            const bool  done   = header.mClosed.load( std::memory_order_acquire ) != 0 || !IsAlive( header.mProcessId );
+            if ( !done || HasHead( *ring ) ) {
+                return false;
+            }
+
+            // The name may have been taken by a new ring of the same process since; leave that one be
+            struct stat status
+            {
+            };
+            if ( ::stat( ring->mPath.c_str(), &status ) == 0 && status.st_ino == ring->mInode ) {
+                ::unlink( ring->mPath.c_str() );
+            }
+            ::munmap( ring->mLayout, sizeof( Layout ) );
+            return true;
+        };
+        mRings.erase( std::remove_if( mRings.begin(), mRings.end(), finished ), mRings.end() );
+    }
+
+    static bool IsAlive( std::uint32_t processId )
+    {
+        return ::kill( static_cast<pid_t>( processId ), 0 ) == 0 || errno == EPERM;
+    }
+
+    bool HasHead( AttachedRing& ring )
+    {
+        if ( ring.mIsCorrupt ) {
+            return false;
+        }
+        if ( !ring.mHasHead ) {
+            if ( ring.mLayout->mRing.IsCorrupt() ) {
+                ring.mIsCorrupt = true;
+                return false;
+            }
+            ring.mHasHead = ring.mLayout->mRing.Peek( [&]( const void* data, size_t numBytes ) {
+                if ( numBytes < sizeof( SharedLogRecordHeader ) ) {
+                    ring.mIsCorrupt = true;
+                    return;
+                }
+                std::memcpy( &ring.mHeadTimestamp,
+                             static_cast<const char*>( data ) + offsetof( SharedLogRecordHeader, mTimestamp ),
+                             sizeof( ring.mHeadTimestamp ) );
+            } );
+            ring.mHasHead = ring.mHasHead && !ring.mIsCorrupt;
+        }
+        return ring.mHasHead;
+    }
+
+    template <typename PrintLogFn>
+    void Print( PrintLogFn& printLogFn, AttachedRing& ring, const char* data, size_t numBytes )
+    {
+        const auto record =
+            detail::ToSharedLogRecord<MaxMessageLength>( data, numBytes, ++mSequenceNumber, ring.mData, mMessage );
+        PrintLogRecord( printLogFn, record );
+    }
+
+    std::string                                mDirectory{};
+    SharedLogCollectorOptions                  mOptions{};
+    std::vector<std::unique_ptr<AttachedRing>> mRings{};
+    std::vector<RingFile>                      mCorruptRings{};
+    std::array<char, MaxMessageLength + 1>     mMessage{};
+    size_t                                     mSequenceNumber{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stb_sprintf.h>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "Logger.h"
+#include "MpscByteRing.h"
+
+#ifdef RTLOG_USE_FMTLIB
+#include <fmt/format.h>
+#endif // RTLOG_USE_FMTLIB
+
+namespace rtlog
+{
+
+constexpr std::uint32_t kSharedLogRingMagic   = 0x52544c52; // "RTLR"
+constexpr std::uint32_t kSharedLogRingVersion = 1;
+
+constexpr size_t kDefaultSharedLogRingBytes        = 1024 * 1024;
+constexpr size_t kDefaultSharedLogMaxMessageLength = 512;
+constexpr size_t kSharedLogMaxNameLength           = 31;
+
+/**
+ * @brief Shared log ring files are named "<name>.<process id>.rtring" and found by their extension.
+ */
+constexpr char kSharedLogRingExtension[] = ".rtring";
+
+/**
+ * @brief The fixed part of a record in a shared log ring, followed by the message (not null terminated).
+ */
+struct SharedLogRecordHeader
+{
+    std::int64_t  mTimestamp{};      // nanoseconds since the epoch, taken by the producer
+    std::uint64_t mSequenceNumber{}; // counted by each SharedLogger
+    std::int32_t  mLevel{};
+    std::int32_t  mRegion{};
+    std::uint32_t mThreadId{};
+    std::uint32_t mMessageLength{};
+};
+
+/**
+ * @brief The start of a shared log ring file, describing the ring that follows it.
+ */
+struct SharedLogRingHeader
+{
+    std::atomic<std::uint32_t> mMagic{};      // stored last by the producer, once the rest is set up
+    std::uint32_t              mVersion{};
+    std::uint64_t              mCapacityBytes{};
+    std::uint64_t              mMaxMessageLength{};
+    std::uint32_t              mProcessId{};
+    std::atomic<std::uint32_t> mClosed{};     // set when the producer is done with the ring
+    char                       mName[kSharedLogMaxNameLength + 1]{};
+};
+
+/**
+ * @brief How a shared log ring file is laid out. Producer and collector must agree on both sizes.
+ */
+template <size_t CapacityBytes, size_t MaxMessageLength>
+struct SharedLogRingLayout
+{
+    using Ring = MpscByteRing<CapacityBytes, sizeof( SharedLogRecordHeader ) + MaxMessageLength>;
+
+    SharedLogRingHeader mHeader{};
+    alignas( 64 ) Ring mRing{};
+};
+
+namespace detail
+{
+
+inline std::int64_t SharedLogTimestamp()
+{
+    timespec now{};
+    clock_gettime( CLOCK_REALTIME, &now );
+    return static_cast<std::int64_t>( now.tv_sec ) * 1000000000 + now.tv_nsec;
+}
+
+} // namespace detail
+
+/**
+ * @brief Logs into a ring in shared memory, drained by a collector in another process (see SharedLogCollector).
+ *
+ * With many real-time processes on a host, each one running its own LogProcessingThread and writing its own files
+ * costs a thread and a core's worth of wake-ups per process. A SharedLogger instead maps a file, normally on a tmpfs
+ * such as /dev/shm, holding an MpscByteRing, and a single collector per host (see the rtlogd example) drains the
+ * rings of every process into one merged stream.
+ *
+ * The ring file is created under a temporary name and renamed into place once it is set up, so collectors scanning
+ * the directory never see it half made. It is left behind when the logger is destroyed, for the collector to drain
+ * and remove.
+ *
+ * Records carry what any process can read: the time they were logged, which collectors use to merge rings, the level
+ * and region (read with LogDataTraits), the thread id and the message. The rest of LogData stays in the process.
+ *
+ * Log can be called from any number of threads.
+ *
+ * @tparam LogData The data logged with each message.
+ * @tparam CapacityBytes Bytes of records the ring holds before Log reports Error_QueueFull.
+ * @tparam MaxMessageLength Longer messages are truncated.
+ */
+template <typename LogData,
+          size_t CapacityBytes    = kDefaultSharedLogRingBytes,
+          size_t MaxMessageLength = kDefaultSharedLogMaxMessageLength>
+class SharedLogger
+{
+public:
+    using Layout = SharedLogRingLayout<CapacityBytes, MaxMessageLength>;
+
+    /**
+     * @brief Creates the ring file "<directory>/<name>.<process id>.rtring".
+     *
+     * NOT REALTIME SAFE
+     *
+     * @param name Names the process to collectors, at most kSharedLogMaxNameLength characters are kept.
+     */
+    SharedLogger( const std::string& directory, const std::string& name )
+    {
+        const auto processId = static_cast<std::uint32_t>( ::getpid() );
+        mPath = directory + "/" + name + "." + std::to_string( processId ) + kSharedLogRingExtension;
+
+        const auto temporaryPath = mPath + ".tmp";
+        const int  fd            = ::open( temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+        if ( fd < 0 ) {
+            return;
+        }
+        void* mapping = MAP_FAILED;
+        if ( ::ftruncate( fd, static_cast<off_t>( sizeof( Layout ) ) ) == 0 ) {
+            mapping = ::mmap( nullptr, sizeof( Layout ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        }
+        ::close( fd );
+        if ( mapping == MAP_FAILED ) {
+            ::unlink( temporaryPath.c_str() );
+            return;
+        }
+
+        mLayout                            = new ( mapping ) Layout();
+        mLayout->mHeader.mVersion          = kSharedLogRingVersion;
+        mLayout->mHeader.mCapacityBytes    = CapacityBytes;
+        mLayout->mHeader.mMaxMessageLength = MaxMessageLength;
+        mLayout->mHeader.mProcessId        = processId;
+        name.copy( mLayout->mHeader.mName, kSharedLogMaxNameLength );
+        mLayout->mHeader.mMagic.store( kSharedLogRingMagic, std::memory_order_release );
+
+        if ( ::rename( temporaryPath.c_str(), mPath.c_str() ) != 0 ) {
+            ::munmap( mLayout, sizeof( Layout ) );
+            ::unlink( temporaryPath.c_str() );
+            mLayout = nullptr;
+        }
+    }
+
+    ~SharedLogger()
+    {
+        if ( mLayout != nullptr ) {
+            mLayout->mHeader.mClosed.store( 1, std::memory_order_release );
+            ::munmap( mLayout, sizeof( Layout ) );
+        }
+    }
+
+    SharedLogger( const SharedLogger& )            = delete;
+    SharedLogger& operator=( const SharedLogger& ) = delete;
+
+    bool IsOpen() const
+    {
+        return mLayout != nullptr;
+    }
+
+    const std::string& Path() const
+    {
+        return mPath;
+    }
+
+    /**
+     * @brief Logs a message into the shared ring. REALTIME SAFE - except on systems where va_args allocates
+     *
+     * @return Status The same as Logger::Log. Error_QueueFull if the ring is full, or could not be created.
+     */
+    Status Log( LogData&& inputData, const char* format, ... ) __attribute__( ( format( printf, 3, 4 ) ) )
+    {
+        va_list args;
+        va_start( args, format );
+        const auto retVal = LogV( std::forward<LogData>( inputData ), format, args );
+        va_end( args );
+        return retVal;
+    }
+
+    /**
+     * @brief The same as Log, taking a va_list. REALTIME SAFE - except on systems where va_args allocates
+     */
+    Status LogV( LogData&& inputData, const char* format, va_list args ) __attribute__( ( format( printf, 3, 0 ) ) )
+    {
+        char       message[MaxMessageLength + 1];
+        const auto charsPrinted = stbsp_vsnprintf( message, static_cast<int>( sizeof( message ) ), format, args );
+
+        auto retVal        = Status::Success;
+        auto messageLength = static_cast<size_t>( charsPrinted );
+        if ( charsPrinted < 0 || messageLength > MaxMessageLength ) {
+            retVal        = Status::Error_MessageTruncated;
+            messageLength = charsPrinted < 0 ? 0 : MaxMessageLength;
+        }
+        return Write( inputData, message, messageLength ) ? retVal : Status::Error_QueueFull;
+    }
+
+#ifdef RTLOG_USE_FMTLIB
+
+    /**
+     * @brief Logs a message with a {fmt} format string into the shared ring. REALTIME SAFE ON ALL SYSTEMS!
+     */
+    template <typename... T>
+    Status LogFmt( LogData&& inputData, fmt::format_string<T...> fmtString, T&&... args )
+    {
+        char       message[MaxMessageLength];
+        const auto result = fmt::format_to_n( message, MaxMessageLength, fmtString, args... );
+
+        auto retVal        = Status::Success;
+        auto messageLength = result.size;
+        if ( messageLength > MaxMessageLength ) {
+            retVal        = Status::Error_MessageTruncated;
+            messageLength = MaxMessageLength;
+        }
+        return Write( inputData, message, messageLength ) ? retVal : Status::Error_QueueFull;
+    }
+
+#endif // RTLOG_USE_FMTLIB
+
+private:
+    bool Write( const LogData& data, const char* message, size_t messageLength )
+    {
+        if ( mLayout == nullptr ) {
+            return false;
+        }
+        SharedLogRecordHeader header;
+        header.mTimestamp      = detail::SharedLogTimestamp();
+        header.mSequenceNumber = mSequenceNumber.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        header.mLevel          = LogDataTraits<LogData>::Level( data );
+        header.mRegion         = detail::RegionOf( data );
+        header.mThreadId       = CurrentThreadId();
+        header.mMessageLength  = static_cast<std::uint32_t>( messageLength );
+        return mLayout->mRing.TryWrite( &header, sizeof( header ), message, messageLength );
+    }
+
+    std::string                mPath{};
+    Layout*                    mLayout{};
+    std::atomic<std::uint64_t> mSequenceNumber{ 0 };
+};
+
+} // namespace rtlog
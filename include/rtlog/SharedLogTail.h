@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+
+#include "LogRecord.h"
+#include "SharedLogCollector.h"
+#include "SharedLogRing.h"
+
+namespace rtlog
+{
+
+/**
+ * @brief Looks at the records waiting in a SharedLogger's ring without taking them from the collector.
+ *
+ * NOT REALTIME SAFE - meant for debugging tools, see rtlog-tail.
+ *
+ * Maps the ring file read only, and copies the newest records out of it with MpscByteRing::Snapshot, so neither the
+ * producers nor the collector draining the ring notice it. Only records the collector hasn't drained yet can be seen:
+ * with a collector keeping up that is the last few milliseconds' worth, without one it is everything that fit in the
+ * ring.
+ *
+ * @tparam CapacityBytes, MaxMessageLength Those of the SharedLogger; rings of other sizes don't open.
+ */
+template <size_t CapacityBytes    = kDefaultSharedLogRingBytes,
+          size_t MaxMessageLength = kDefaultSharedLogMaxMessageLength>
+class SharedLogTail
+{
+public:
+    using Layout = SharedLogRingLayout<CapacityBytes, MaxMessageLength>;
+
+    explicit SharedLogTail( const std::string& path )
+    {
+        ino_t inode = 0;
+        mLayout     = detail::MapSharedLogRing<CapacityBytes, MaxMessageLength>( path, false, inode );
+        if ( mLayout != nullptr ) {
+            mData.processId = mLayout->mHeader.mProcessId;
+            std::memcpy( mData.processName, mLayout->mHeader.mName, kSharedLogMaxNameLength );
+        }
+    }
+
+    ~SharedLogTail()
+    {
+        if ( mLayout != nullptr ) {
+            ::munmap( mLayout, sizeof( Layout ) );
+        }
+    }
+
+    SharedLogTail( const SharedLogTail& )            = delete;
+    SharedLogTail& operator=( const SharedLogTail& ) = delete;
+
+    bool IsOpen() const
+    {
+        return mLayout != nullptr;
+    }
+
+    std::uint32_t ProcessId() const
+    {
+        return mData.processId;
+    }
+
+    const char* ProcessName() const
+    {
+        return mData.processName;
+    }
+
+    /**
+     * @brief Returns true once the SharedLogger has been destroyed.
+     */
+    bool IsClosed() const
+    {
+        return mLayout == nullptr || mLayout->mHeader.mClosed.load( std::memory_order_acquire ) != 0;
+    }
+
+    /**
+     * @brief Hands the newest maxRecords records waiting in the ring to printLogFn, oldest first, as
+     * LogRecord<SharedLogData>, numbered with the SharedLogger's own sequence numbers.
+     *
+     * @return The number of records handed on.
+     */
+    template <typename PrintLogFn>
+    size_t Snapshot( PrintLogFn& printLogFn, size_t maxRecords )
+    {
+        if ( mLayout == nullptr ) {
+            return 0;
+        }
+        return mLayout->mRing.Snapshot( maxRecords, [&]( const void* data, size_t numBytes ) {
+            const auto*   bytes = static_cast<const char*>( data );
+            std::uint64_t sequenceNumber;
+            std::memcpy( &sequenceNumber,
+                         bytes + offsetof( SharedLogRecordHeader, mSequenceNumber ),
+                         sizeof( sequenceNumber ) );
+            const auto record = detail::ToSharedLogRecord<MaxMessageLength>(
+                bytes, numBytes, static_cast<size_t>( sequenceNumber ), mData, mMessage );
+            PrintLogRecord( printLogFn, record );
+        } );
+    }
+
+private:
+    Layout*                                mLayout{};
+    SharedLogData                          mData{};
+    std::array<char, MaxMessageLength + 1> mMessage{};
+};
+
+} // namespace rtlog
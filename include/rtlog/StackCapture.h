@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined( __linux__ )
+#include <pthread.h>
+#endif
+
+/**
+ * The deepest stack a Logger records for messages at or above its stack capture level. Every queued message carries
+ * storage for this many frames, whether stack capture is enabled or not, so it is 0 (compiled out) by default; set it
+ * to e.g. 16 to use Logger::SetStackCaptureLevel.
+ */
+#ifndef RTLOG_MAX_STACK_FRAMES
+#define RTLOG_MAX_STACK_FRAMES 0
+#endif // RTLOG_MAX_STACK_FRAMES
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+struct StackBounds
+{
+    std::uintptr_t mLow{};
+    std::uintptr_t mHigh{};
+};
+
+inline StackBounds& CurrentThreadStackBounds()
+{
+    static thread_local StackBounds bounds{};
+    return bounds;
+}
+
+} // namespace detail
+
+/**
+ * @brief Looks up and remembers the calling thread's stack bounds, which CaptureStackFrames needs to capture anything.
+ *
+ * NOT REALTIME SAFE - may take locks and allocate (it reads /proc/self/maps for the main thread)
+ *
+ * Logger::WarmUpCurrentThread calls this for you.
+ */
+inline void WarmUpStackCapture()
+{
+#if defined( __linux__ )
+    pthread_attr_t attr;
+    if ( pthread_getattr_np( pthread_self(), &attr ) != 0 ) {
+        return;
+    }
+
+    void*  stackAddress = nullptr;
+    size_t stackSize    = 0;
+    if ( pthread_attr_getstack( &attr, &stackAddress, &stackSize ) == 0 ) {
+        auto& bounds = detail::CurrentThreadStackBounds();
+        bounds.mLow  = reinterpret_cast<std::uintptr_t>( stackAddress );
+        bounds.mHigh = bounds.mLow + stackSize;
+    }
+    pthread_attr_destroy( &attr );
+#endif
+}
+
+/**
+ * @brief Records the return addresses of the calling function's callers by walking the frame pointer chain.
+ *
+ * REALTIME SAFE - no allocation, no locks, no system calls. Costs a couple of loads per frame.
+ *
+ * The first frame recorded is the return address of the function this is inlined into, i.e. its caller. The result
+ * is only complete if the code on the stack keeps frame pointers (-fno-omit-frame-pointer); the walk stops at the first
+ * frame that does not look like a valid frame record, at the end of the chain, or after maxFrames frames. The walk
+ * never leaves the part of the thread's stack above the calling frame, so it captures nothing on threads that haven't
+ * called WarmUpStackCapture: without the bounds, code built without frame pointers could send it anywhere.
+ *
+ * Turn the addresses into names on a non real-time thread with Symbolizer.
+ *
+ * @param frames Where to store the return addresses.
+ * @param maxFrames The number of entries in frames.
+ * @return size_t The number of frames stored.
+ */
+__attribute__( ( always_inline ) ) inline size_t CaptureStackFrames( void** frames, size_t maxFrames )
+{
+    // Frames bigger than this are assumed to mean we walked off the end of a frame pointer chain
+    constexpr std::uintptr_t kMaxFrameBytes = 1024 * 1024;
+
+    const auto& bounds = detail::CurrentThreadStackBounds();
+    if ( bounds.mHigh == 0 ) {
+        return 0;
+    }
+
+    const auto start     = reinterpret_cast<std::uintptr_t>( __builtin_frame_address( 0 ) );
+    auto       frame     = start;
+    size_t     numFrames = 0;
+    while ( numFrames < maxFrames ) {
+        if ( frame < start || frame < bounds.mLow || frame % sizeof( void* ) != 0
+             || frame + 2 * sizeof( void* ) > bounds.mHigh ) {
+            break;
+        }
+
+        const auto* record        = reinterpret_cast<const std::uintptr_t*>( frame );
+        const auto  next          = record[0];
+        const auto  returnAddress = record[1];
+        if ( returnAddress == 0 ) {
+            break;
+        }
+
+        frames[numFrames++] = reinterpret_cast<void*>( returnAddress );
+
+        if ( next <= frame || next - frame > kMaxFrameBytes ) {
+            break;
+        }
+        frame = next;
+    }
+    return numFrames;
+}
+
+} // namespace rtlog
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined( __linux__ )
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rtlog
+{
+
+/**
+ * @brief Turns return addresses recorded by CaptureStackFrames into "function+0xoffset (module)" strings.
+ *
+ * NOT REALTIME SAFE - reads files, allocates and demangles. Use it on the thread that processes the log queue.
+ *
+ * The executable mappings of the process are read from /proc/self/maps the first time an address can't be placed,
+ * and each module's ELF symbol table (.symtab, or .dynsym if the module is stripped) is loaded the first time an
+ * address inside it is looked up. Results are cached per address, so symbolizing the same stacks over and over is a
+ * hash lookup. Addresses that can't be resolved come out as "0x... (module)" or "0x...".
+ */
+class Symbolizer
+{
+public:
+    /**
+     * @brief Returns a human readable description of address. The reference stays valid until the Symbolizer dies.
+     */
+    const std::string& Symbolize( const void* address )
+    {
+        const auto key = reinterpret_cast<std::uintptr_t>( address );
+        auto       it  = mCache.find( key );
+        if ( it == mCache.end() ) {
+            it = mCache.emplace( key, Describe( key ) ).first;
+        }
+        return it->second;
+    }
+
+private:
+    struct Symbol
+    {
+        std::uintptr_t mAddress{};
+        std::uintptr_t mSize{};
+        std::string    mName{};
+    };
+
+    struct Module
+    {
+        std::uintptr_t      mStart{};
+        std::uintptr_t      mEnd{};
+        std::uintptr_t      mFileOffset{};
+        std::string         mPath{};
+        bool                mLoaded{};
+        std::intptr_t       mBias{};
+        std::vector<Symbol> mSymbols{};
+    };
+
+    std::string Describe( std::uintptr_t address )
+    {
+        auto* module = FindModule( address );
+        if ( module == nullptr ) {
+            ReadMappings();
+            module = FindModule( address );
+        }
+
+        char hex[32];
+        std::snprintf( hex, sizeof( hex ), "0x%llx", static_cast<unsigned long long>( address ) );
+        if ( module == nullptr ) {
+            return hex;
+        }
+
+        if ( !module->mLoaded ) {
+            LoadSymbols( *module );
+        }
+
+        // Return addresses point just past the call, which may be the first byte of the next function
+        const auto elfAddress = static_cast<std::uintptr_t>( static_cast<std::intptr_t>( address ) - module->mBias );
+        const auto lookup     = elfAddress - 1;
+
+        auto symbol =
+            std::upper_bound( module->mSymbols.begin(),
+                              module->mSymbols.end(),
+                              lookup,
+                              []( std::uintptr_t value, const Symbol& candidate ) { return value < candidate.mAddress; } );
+
+        const auto moduleName = module->mPath.substr( module->mPath.find_last_of( '/' ) + 1 );
+        if ( symbol == module->mSymbols.begin() ) {
+            return std::string( hex ) + " (" + moduleName + ")";
+        }
+        --symbol;
+        if ( symbol->mSize != 0 && lookup >= symbol->mAddress + symbol->mSize ) {
+            return std::string( hex ) + " (" + moduleName + ")";
+        }
+
+        char offset[32];
+        std::snprintf( offset, sizeof( offset ), "+0x%llx", static_cast<unsigned long long>( elfAddress - symbol->mAddress ) );
+        return symbol->mName + offset + " (" + moduleName + ")";
+    }
+
+    Module* FindModule( std::uintptr_t address )
+    {
+        for ( auto& module : mModules ) {
+            if ( address >= module.mStart && address < module.mEnd ) {
+                return &module;
+            }
+        }
+        return nullptr;
+    }
+
+    void ReadMappings()
+    {
+#if defined( __linux__ )
+        std::unique_ptr<FILE, int ( * )( FILE* )> maps( std::fopen( "/proc/self/maps", "r" ), &std::fclose );
+        if ( !maps ) {
+            return;
+        }
+
+        char line[4096];
+        while ( std::fgets( line, sizeof( line ), maps.get() ) != nullptr ) {
+            unsigned long long start = 0, end = 0, offset = 0;
+            char               permissions[8] = {};
+            int                pathStart      = 0;
+            if ( std::sscanf( line, "%llx-%llx %7s %llx %*s %*s %n", &start, &end, permissions, &offset, &pathStart ) < 4
+                 || permissions[2] != 'x' || pathStart == 0 || line[pathStart] != '/' ) {
+                continue;
+            }
+            if ( FindModule( static_cast<std::uintptr_t>( start ) ) != nullptr ) {
+                continue;
+            }
+
+            std::string path( line + pathStart );
+            path.erase( path.find_last_not_of( "\n" ) + 1 );
+
+            Module module;
+            module.mStart      = static_cast<std::uintptr_t>( start );
+            module.mEnd        = static_cast<std::uintptr_t>( end );
+            module.mFileOffset = static_cast<std::uintptr_t>( offset );
+            module.mPath       = std::move( path );
+            mModules.push_back( std::move( module ) );
+        }
+#endif
+    }
+
+    static void LoadSymbols( Module& module )
+    {
+        module.mLoaded = true;
+#if defined( __linux__ )
+        const int fd = open( module.mPath.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 ) {
+            return;
+        }
+        struct stat status;
+        if ( fstat( fd, &status ) != 0 || static_cast<size_t>( status.st_size ) < sizeof( ElfW( Ehdr ) ) ) {
+            close( fd );
+            return;
+        }
+        const auto fileSize = static_cast<size_t>( status.st_size );
+        void*      mapped   = mmap( nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+        if ( mapped == MAP_FAILED ) {
+            return;
+        }
+
+        const auto* base   = static_cast<const std::uint8_t*>( mapped );
+        const auto* header = reinterpret_cast<const ElfW( Ehdr )*>( base );
+        const bool  valid  = std::memcmp( header->e_ident, ELFMAG, SELFMAG ) == 0
+                         && header->e_phoff + header->e_phnum * sizeof( ElfW( Phdr ) ) <= fileSize
+                         && header->e_shoff + header->e_shnum * sizeof( ElfW( Shdr ) ) <= fileSize;
+        if ( valid ) {
+            // The mapping covers file offset mFileOffset; find the segment it belongs to for the load bias
+            const auto* programHeaders = reinterpret_cast<const ElfW( Phdr )*>( base + header->e_phoff );
+            for ( size_t i = 0; i < header->e_phnum; i++ ) {
+                const auto& segment = programHeaders[i];
+                if ( segment.p_type == PT_LOAD && module.mFileOffset >= ( segment.p_offset & ~std::uintptr_t( 4095 ) )
+                     && module.mFileOffset < segment.p_offset + segment.p_filesz ) {
+                    module.mBias = static_cast<std::intptr_t>( module.mStart - module.mFileOffset + segment.p_offset
+                                                               - segment.p_vaddr );
+                    break;
+                }
+            }
+
+            const auto* sections = reinterpret_cast<const ElfW( Shdr )*>( base + header->e_shoff );
+            for ( const ElfW( Word ) wantedType : { SHT_SYMTAB, SHT_DYNSYM } ) {
+                for ( size_t i = 0; i < header->e_shnum && module.mSymbols.empty(); i++ ) {
+                    if ( sections[i].sh_type == wantedType && sections[i].sh_link < header->e_shnum ) {
+                        ReadSymbolTable( module, base, fileSize, sections[i], sections[sections[i].sh_link] );
+                    }
+                }
+            }
+            std::sort( module.mSymbols.begin(), module.mSymbols.end(), []( const Symbol& a, const Symbol& b ) {
+                return a.mAddress < b.mAddress;
+            } );
+        }
+
+        munmap( mapped, fileSize );
+#endif
+    }
+
+#if defined( __linux__ )
+    static void ReadSymbolTable( Module&             module,
+                                 const std::uint8_t* base,
+                                 size_t              fileSize,
+                                 const ElfW( Shdr ) & symbolSection,
+                                 const ElfW( Shdr ) & stringSection )
+    {
+        if ( symbolSection.sh_offset + symbolSection.sh_size > fileSize
+             || stringSection.sh_offset + stringSection.sh_size > fileSize ) {
+            return;
+        }
+
+        const auto* symbols    = reinterpret_cast<const ElfW( Sym )*>( base + symbolSection.sh_offset );
+        const auto  numSymbols = symbolSection.sh_size / sizeof( ElfW( Sym ) );
+        const auto* strings    = reinterpret_cast<const char*>( base + stringSection.sh_offset );
+
+        for ( size_t i = 0; i < numSymbols; i++ ) {
+            const auto& symbol = symbols[i];
+            if ( ELF64_ST_TYPE( symbol.st_info ) != STT_FUNC || symbol.st_value == 0
+                 || symbol.st_name >= stringSection.sh_size ) {
+                continue;
+            }
+            module.mSymbols.push_back( { static_cast<std::uintptr_t>( symbol.st_value ),
+                                         static_cast<std::uintptr_t>( symbol.st_size ),
+                                         Demangle( strings + symbol.st_name ) } );
+        }
+    }
+#endif
+
+    static std::string Demangle( const char* name )
+    {
+#if defined( __linux__ )
+        int   status    = 0;
+        char* demangled = abi::__cxa_demangle( name, nullptr, nullptr, &status );
+        if ( status == 0 && demangled != nullptr ) {
+            std::string result( demangled );
+            std::free( demangled );
+            return result;
+        }
+#endif
+        return name;
+    }
+
+    std::vector<Module>                             mModules{};
+    std::unordered_map<std::uintptr_t, std::string> mCache{};
+};
+
+} // namespace rtlog
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stb_sprintf.h>
+
+#include "LogDataTraits.h"
+#include "LogRecord.h"
+#include "TimestampFormatter.h"
+
+namespace rtlog
+{
+
+/**
+ * @brief The most a text line adds to the message: timestamp, sequence number, level, region and thread id, and the
+ * newline.
+ */
+constexpr size_t kMaxTextLineOverhead = 128;
+
+/**
+ * @brief Writes record as one line of text, "[<timestamp> ]<sequence number> L<level> R<region> T<thread id>
+ * <message>\n", and returns its length. REALTIME SAFE without timestamps
+ *
+ * The level and region are read with LogDataTraits. If the line doesn't fit in capacity bytes, the message is cut
+ * short, but the line still ends in a newline. Nothing is written if capacity is less than kMaxTextLineOverhead.
+ *
+ * @param timestamps If not null, the line starts with the current time, which is when the line is formatted rather
+ * than when the message was logged.
+ */
+template <typename LogData>
+size_t FormatTextLine( const LogRecord<LogData>& record,
+                       char*                     out,
+                       size_t                    capacity,
+                       TimestampFormatter*       timestamps = nullptr )
+{
+    if ( capacity < kMaxTextLineOverhead ) {
+        return 0;
+    }
+    size_t length = 0;
+    if ( timestamps != nullptr ) {
+        length        = timestamps->FormatNow( out );
+        out[length++] = ' ';
+    }
+    const int prefixLength = stbsp_snprintf( out + length,
+                                             static_cast<int>( kMaxTextLineOverhead - length ),
+                                             "%zu L%d R%d T%u ",
+                                             record.mSequenceNumber,
+                                             LogDataTraits<LogData>::Level( record.mLogData ),
+                                             detail::RegionOf( record.mLogData ),
+                                             static_cast<unsigned int>( record.mThreadId ) );
+    length += static_cast<size_t>( std::max( prefixLength, 0 ) );
+    const auto messageLength = std::min( record.mMessageLength, capacity - length - 1 );
+    std::memcpy( out + length, record.mMessage, messageLength );
+    length += messageLength;
+    out[length++] = '\n';
+    return length;
+}
+
+} // namespace rtlog
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * The number of lanes a ThreadLaneRegistry hands out, which is the number of threads that may log through a
+ * QueuePolicy::PerThreadSingleProducerSingleConsumer Logger at the same time.
+ */
+#ifndef RTLOG_MAX_NUM_THREAD_LANES
+#define RTLOG_MAX_NUM_THREAD_LANES 16
+#endif // RTLOG_MAX_NUM_THREAD_LANES
+
+/**
+ * The number of ThreadLaneRegistry objects (one per per-thread Logger) a single thread can hold a lane in at the same
+ * time. Lanes in registries that have been destroyed don't count.
+ */
+#ifndef RTLOG_MAX_NUM_REGISTRIES_PER_THREAD
+#define RTLOG_MAX_NUM_REGISTRIES_PER_THREAD 8
+#endif // RTLOG_MAX_NUM_REGISTRIES_PER_THREAD
+
+namespace rtlog
+{
+
+namespace detail
+{
+
+class ThreadLaneRegistryBase
+{
+public:
+    virtual ~ThreadLaneRegistryBase() = default;
+
+    // Called with the directory mutex held when a thread holding lane laneIndex exits
+    virtual void ReleaseLane( size_t laneIndex ) = 0;
+};
+
+// Every registry that is currently alive, so exiting threads don't release lanes into a destroyed registry
+struct ThreadLaneRegistryDirectory
+{
+    std::mutex                                                     mMutex{};
+    std::vector<std::pair<std::uint64_t, ThreadLaneRegistryBase*>> mRegistries{};
+    std::uint64_t                                                  mNextId{ 1 };
+
+    static ThreadLaneRegistryDirectory& Get()
+    {
+        static ThreadLaneRegistryDirectory directory;
+        return directory;
+    }
+};
+
+// The lanes the current thread holds, released when the thread exits
+class ThreadLaneHandles
+{
+public:
+    struct Handle
+    {
+        std::uint64_t mRegistryId{};
+        size_t        mLaneIndex{};
+    };
+
+    ~ThreadLaneHandles()
+    {
+        auto&                       directory = ThreadLaneRegistryDirectory::Get();
+        std::lock_guard<std::mutex> lock( directory.mMutex );
+        for ( size_t i = 0; i < mNumHandles; i++ ) {
+            for ( auto& registry : directory.mRegistries ) {
+                if ( registry.first == mHandles[i].mRegistryId ) {
+                    registry.second->ReleaseLane( mHandles[i].mLaneIndex );
+                }
+            }
+        }
+    }
+
+    const Handle* Find( std::uint64_t registryId ) const
+    {
+        for ( size_t i = 0; i < mNumHandles; i++ ) {
+            if ( mHandles[i].mRegistryId == registryId ) {
+                return &mHandles[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool Add( std::uint64_t registryId, size_t laneIndex )
+    {
+        if ( mNumHandles == mHandles.size() && !RemoveDestroyedRegistries() ) {
+            return false;
+        }
+        mHandles[mNumHandles++] = { registryId, laneIndex };
+        return true;
+    }
+
+    // The first call on a thread registers the thread_local destructor, which may allocate
+    static ThreadLaneHandles& ForCurrentThread()
+    {
+        static thread_local ThreadLaneHandles handles;
+        return handles;
+    }
+
+private:
+    // Drops the handles of registries that have been destroyed since, making room for new ones. Doesn't wait for the
+    // directory mutex, so it may find no room even though there is some; the next claim tries again.
+    bool RemoveDestroyedRegistries()
+    {
+        auto&                        directory = ThreadLaneRegistryDirectory::Get();
+        std::unique_lock<std::mutex> lock( directory.mMutex, std::try_to_lock );
+        if ( !lock.owns_lock() ) {
+            return false;
+        }
+        const auto isDestroyed = [&directory]( const Handle& handle ) {
+            return std::none_of( directory.mRegistries.begin(),
+                                 directory.mRegistries.end(),
+                                 [&handle]( const auto& registry ) { return registry.first == handle.mRegistryId; } );
+        };
+        const auto end = std::remove_if( mHandles.begin(), mHandles.begin() + mNumHandles, isDestroyed );
+        mNumHandles    = static_cast<size_t>( end - mHandles.begin() );
+        return mNumHandles < mHandles.size();
+    }
+
+    std::array<Handle, RTLOG_MAX_NUM_REGISTRIES_PER_THREAD> mHandles{};
+    size_t                                                  mNumHandles{};
+};
+
+} // namespace detail
+
+/**
+ * @brief Hands each producer thread its own lane from a preallocated pool, and takes it back after the thread exits.
+ *
+ * A thread is given a lane the first time it asks for one, and keeps it for the rest of its life. When the thread
+ * exits its lane is marked orphaned; once the consumer has drained an orphaned lane it goes back into the pool for the
+ * next thread. All lanes are allocated on construction, so claiming one never allocates.
+ *
+ * The only thing that may allocate on a producer thread is the very first call on that thread (to any registry),
+ * which registers a thread_local destructor with the C++ runtime. Call WarmUpCurrentThread from each real-time thread
+ * before it enters its real-time loop to get that out of the way.
+ *
+ * @tparam Lane The per-thread queue. Must be default constructible and provide `bool IsEmpty()`, called only from the
+ * consumer thread.
+ * @tparam MaxNumLanes The number of lanes in the pool.
+ */
+template <typename Lane, size_t MaxNumLanes>
+class ThreadLaneRegistry : private detail::ThreadLaneRegistryBase
+{
+public:
+    /**
+     * @brief Allocates all lanes. NOT REALTIME SAFE.
+     */
+    ThreadLaneRegistry()
+    {
+        for ( auto& slot : mSlots ) {
+            slot.mLane = std::make_unique<Lane>();
+        }
+        mActiveLanes.reserve( MaxNumLanes );
+
+        auto&                       directory = detail::ThreadLaneRegistryDirectory::Get();
+        std::lock_guard<std::mutex> lock( directory.mMutex );
+        mId = directory.mNextId++;
+        directory.mRegistries.emplace_back( mId, static_cast<detail::ThreadLaneRegistryBase*>( this ) );
+    }
+
+    ~ThreadLaneRegistry() override
+    {
+        auto&                       directory = detail::ThreadLaneRegistryDirectory::Get();
+        std::lock_guard<std::mutex> lock( directory.mMutex );
+        auto&                       registries = directory.mRegistries;
+        registries.erase( std::remove_if( registries.begin(),
+                                          registries.end(),
+                                          [this]( const auto& registry ) { return registry.first == mId; } ),
+                          registries.end() );
+    }
+
+    ThreadLaneRegistry( const ThreadLaneRegistry& )            = delete;
+    ThreadLaneRegistry& operator=( const ThreadLaneRegistry& ) = delete;
+    ThreadLaneRegistry( ThreadLaneRegistry&& )                 = delete;
+    ThreadLaneRegistry& operator=( ThreadLaneRegistry&& )      = delete;
+
+    /**
+     * @brief Returns the calling thread's lane, claiming one from the pool on the first call.
+     *
+     * REALTIME SAFE - after WarmUpCurrentThread has been called on this thread
+     *
+     * @return Lane* The thread's lane, or nullptr if the pool is exhausted or the thread already holds lanes in
+     * RTLOG_MAX_NUM_REGISTRIES_PER_THREAD live registries.
+     */
+    Lane* CurrentThreadLane()
+    {
+        auto& handles = detail::ThreadLaneHandles::ForCurrentThread();
+        if ( const auto* handle = handles.Find( mId ) ) {
+            return mSlots[handle->mLaneIndex].mLane.get();
+        }
+
+        for ( size_t i = 0; i < mSlots.size(); i++ ) {
+            auto expected = LaneState::Free;
+            if ( mSlots[i].mState.compare_exchange_strong( expected, LaneState::Owned, std::memory_order_acquire ) ) {
+                if ( handles.Add( mId, i ) ) {
+                    return mSlots[i].mLane.get();
+                }
+                mSlots[i].mState.store( LaneState::Free, std::memory_order_release );
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Claims the calling thread's lane ahead of time. NOT REALTIME SAFE.
+     *
+     * @return true if the thread holds a lane
+     */
+    bool WarmUpCurrentThread()
+    {
+        return CurrentThreadLane() != nullptr;
+    }
+
+    /**
+     * @brief Calls drainFn with every lane that is held by a thread, then recycles the lanes of exited threads that
+     * drainFn left empty.
+     *
+     * Must only be called from the consumer thread.
+     *
+     * @tparam DrainFn Callable as drainFn( const std::vector<Lane*>& lanes )
+     * @return Whatever drainFn returns.
+     */
+    template <typename DrainFn>
+    auto DrainLanes( DrainFn&& drainFn )
+    {
+        return DrainLanes( drainFn, []( Lane& ) {} );
+    }
+
+    /**
+     * @brief As above, and calls recycleFn on each lane right before it goes back into the pool.
+     *
+     * @tparam RecycleFn Callable as recycleFn( Lane& lane )
+     */
+    template <typename DrainFn, typename RecycleFn>
+    auto DrainLanes( DrainFn&& drainFn, RecycleFn&& recycleFn )
+    {
+        mActiveLanes.clear();
+        for ( auto& slot : mSlots ) {
+            // Load the state before draining: an orphaned lane will never see another write, so if it's empty after
+            // the drain it is safe to hand out again
+            const auto state  = slot.mState.load( std::memory_order_acquire );
+            slot.mWasOrphaned = state == LaneState::Orphaned;
+            if ( state != LaneState::Free ) {
+                mActiveLanes.push_back( slot.mLane.get() );
+            }
+        }
+
+        auto result = drainFn( static_cast<const std::vector<Lane*>&>( mActiveLanes ) );
+
+        for ( auto& slot : mSlots ) {
+            if ( slot.mWasOrphaned && slot.mLane->IsEmpty() ) {
+                recycleFn( *slot.mLane );
+                slot.mWasOrphaned = false;
+                slot.mState.store( LaneState::Free, std::memory_order_release );
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Returns the number of lanes currently held by live or not yet drained threads.
+     */
+    size_t NumLanesInUse() const
+    {
+        return static_cast<size_t>( std::count_if( mSlots.begin(), mSlots.end(), []( const Slot& slot ) {
+            return slot.mState.load( std::memory_order_relaxed ) != LaneState::Free;
+        } ) );
+    }
+
+private:
+    enum class LaneState
+    {
+        Free,
+        Owned,
+        Orphaned,
+    };
+
+    struct Slot
+    {
+        std::unique_ptr<Lane>  mLane{};
+        std::atomic<LaneState> mState{ LaneState::Free };
+        bool                   mWasOrphaned{};
+    };
+
+    void ReleaseLane( size_t laneIndex ) override
+    {
+        mSlots[laneIndex].mState.store( LaneState::Orphaned, std::memory_order_release );
+    }
+
+    std::array<Slot, MaxNumLanes> mSlots{};
+    std::vector<Lane*>            mActiveLanes{};
+    std::uint64_t                 mId{};
+};
+
+} // namespace rtlog
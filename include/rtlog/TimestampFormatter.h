@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+namespace rtlog
+{
+
+enum class TimestampZone
+{
+    Utc,
+    Local
+};
+
+namespace detail
+{
+
+constexpr std::array<char, 200> MakeTwoDigitTable()
+{
+    std::array<char, 200> table{};
+    for ( int i = 0; i < 100; i++ ) {
+        table[2 * i]     = static_cast<char>( '0' + i / 10 );
+        table[2 * i + 1] = static_cast<char>( '0' + i % 10 );
+    }
+    return table;
+}
+
+constexpr auto kTwoDigitTable = MakeTwoDigitTable();
+
+// Writes value as exactly numDigits decimal digits, ending at end
+inline void WriteDigits( std::uint64_t value, int numDigits, char* end )
+{
+    for ( ; numDigits >= 2; numDigits -= 2, value /= 100 ) {
+        end -= 2;
+        std::memcpy( end, &kTwoDigitTable[2 * ( value % 100 )], 2 );
+    }
+    if ( numDigits == 1 ) {
+        *--end = static_cast<char>( '0' + value % 10 );
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Formats times as ISO 8601, "2024-05-01T13:45:07.123456Z" or "2024-05-01T15:45:07.123456+02:00".
+ *
+ * NOT REALTIME SAFE - the date and time of day go through gmtime_r / localtime_r, which can take the time zone lock.
+ * They are only worked out when the second changes though, and cached: within a second only the fraction is written,
+ * two digits at a time from a table. Text sinks format many lines a second, and most of them share their second.
+ *
+ * Not thread safe, use one per thread.
+ */
+class TimestampFormatter
+{
+public:
+    /**
+     * @brief The longest timestamp Format writes, with nanoseconds and a time zone offset.
+     */
+    static constexpr size_t kMaxBytes = 35;
+
+    /**
+     * @param fractionDigits Digits of the fraction of a second: 0, 3 for milliseconds, 6, or 9 for nanoseconds.
+     * @param zone Whether to write UTC ("Z") or local time with its offset.
+     */
+    explicit TimestampFormatter( int fractionDigits = 6, TimestampZone zone = TimestampZone::Utc )
+    : mFractionDigits( std::clamp( fractionDigits, 0, 9 ) )
+    , mZone( zone )
+    {
+        for ( int i = mFractionDigits; i < 9; i++ ) {
+            mFractionDivisor *= 10;
+        }
+    }
+
+    /**
+     * @brief Writes the time nanosecondsSinceEpoch to out, which must have room for kMaxBytes, and returns its length.
+     * The timestamp isn't null terminated.
+     */
+    size_t Format( std::int64_t nanosecondsSinceEpoch, char* out )
+    {
+        // Round towards the past, so times before 1970 still have a fraction in [0, 1)
+        auto seconds     = nanosecondsSinceEpoch / 1000000000;
+        auto nanoseconds = nanosecondsSinceEpoch % 1000000000;
+        if ( nanoseconds < 0 ) {
+            seconds--;
+            nanoseconds += 1000000000;
+        }
+        if ( seconds != mCachedSecond ) {
+            CacheSecond( seconds );
+        }
+
+        std::memcpy( out, mDateTime, kDateTimeBytes );
+        size_t length = kDateTimeBytes;
+        if ( mFractionDigits > 0 ) {
+            out[length++] = '.';
+            length += static_cast<size_t>( mFractionDigits );
+            detail::WriteDigits(
+                static_cast<std::uint64_t>( nanoseconds ) / mFractionDivisor, mFractionDigits, out + length );
+        }
+        std::memcpy( out + length, mZoneSuffix, mZoneSuffixBytes );
+        return length + mZoneSuffixBytes;
+    }
+
+    /**
+     * @brief Writes the current time to out, see Format.
+     */
+    size_t FormatNow( char* out )
+    {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        return Format( std::chrono::duration_cast<std::chrono::nanoseconds>( now ).count(), out );
+    }
+
+private:
+    static constexpr size_t kDateTimeBytes = 19; // YYYY-MM-DDTHH:MM:SS
+
+    void CacheSecond( std::int64_t seconds )
+    {
+        const auto time   = static_cast<std::time_t>( seconds );
+        std::tm    fields = {};
+        if ( mZone == TimestampZone::Local ) {
+            localtime_r( &time, &fields );
+        }
+        else {
+            gmtime_r( &time, &fields );
+        }
+
+        const auto year = std::clamp( fields.tm_year + 1900, 0, 9999 );
+        detail::WriteDigits( static_cast<std::uint64_t>( year ), 4, mDateTime + 4 );
+        mDateTime[4] = '-';
+        detail::WriteDigits( static_cast<std::uint64_t>( fields.tm_mon + 1 ), 2, mDateTime + 7 );
+        mDateTime[7] = '-';
+        detail::WriteDigits( static_cast<std::uint64_t>( fields.tm_mday ), 2, mDateTime + 10 );
+        mDateTime[10] = 'T';
+        detail::WriteDigits( static_cast<std::uint64_t>( fields.tm_hour ), 2, mDateTime + 13 );
+        mDateTime[13] = ':';
+        detail::WriteDigits( static_cast<std::uint64_t>( fields.tm_min ), 2, mDateTime + 16 );
+        mDateTime[16] = ':';
+        detail::WriteDigits( static_cast<std::uint64_t>( fields.tm_sec ), 2, mDateTime + 19 );
+
+        if ( mZone == TimestampZone::Local ) {
+            // The offset can change on any second, with daylight saving time
+            const auto offsetMinutes = fields.tm_gmtoff / 60;
+            const auto absMinutes    = static_cast<std::uint64_t>( offsetMinutes < 0 ? -offsetMinutes : offsetMinutes );
+            mZoneSuffix[0]           = offsetMinutes < 0 ? '-' : '+';
+            detail::WriteDigits( absMinutes / 60 % 100, 2, mZoneSuffix + 3 );
+            mZoneSuffix[3] = ':';
+            detail::WriteDigits( absMinutes % 60, 2, mZoneSuffix + 6 );
+            mZoneSuffixBytes = 6;
+        }
+        mCachedSecond = seconds;
+    }
+
+    int           mFractionDigits{ 6 };
+    std::uint64_t mFractionDivisor{ 1 };
+    TimestampZone mZone{ TimestampZone::Utc };
+    std::int64_t  mCachedSecond{ INT64_MIN };
+    char          mDateTime[kDateTimeBytes]{};
+    char          mZoneSuffix[6]{ 'Z' };
+    size_t        mZoneSuffixBytes{ 1 };
+};
+
+} // namespace rtlog
@@ -0,0 +1,809 @@
+#include <doctest/doctest.h>
+#include <rtlog/BacktraceBuffer.h>
+#include <rtlog/BinaryLog.h>
+#include <rtlog/BinaryLogReader.h>
+#include <rtlog/Crc32c.h>
+#include <rtlog/LogProcessingThread.h>
+#include <rtlog/Logger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+
+namespace rtlog::test
+{
+// The number of fdatasync calls still to fail, and the file of the last one that failed until it is synced again
+std::atomic<int> gNumFailingDataSyncs{0};
+std::atomic<ino_t> gUnsyncedInode{0};
+} // namespace rtlog::test
+
+// Takes the place of the C library's, so BinaryLogSink's commits can be made to fail
+extern "C" int fdatasync(int fd)
+{
+    struct stat status{};
+    ::fstat(fd, &status);
+    if (rtlog::test::gNumFailingDataSyncs.load() > 0)
+    {
+        rtlog::test::gNumFailingDataSyncs--;
+        rtlog::test::gUnsyncedInode = status.st_ino;
+        errno = EIO;
+        return -1;
+    }
+    const auto result = static_cast<int>(::syscall(SYS_fdatasync, fd));
+    if (result == 0 && status.st_ino == rtlog::test::gUnsyncedInode.load())
+    {
+        rtlog::test::gUnsyncedInode = 0;
+    }
+    return result;
+}
+#endif
+
+namespace rtlog::test
+{
+
+std::atomic<std::size_t> gSequenceNumber{ 0 };
+
+constexpr auto MAX_LOG_MESSAGE_LENGTH = 256;
+constexpr auto MAX_NUM_LOG_MESSAGES = 100;
+
+enum class ExampleLogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Critical
+};
+
+enum class ExampleLogRegion
+{
+    Engine,
+    Game,
+    Network,
+    Audio
+};
+
+struct ExampleLogData
+{
+    ExampleLogLevel level;
+    ExampleLogRegion region;
+};
+
+using ExampleLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber>;
+
+// LogData with a big field that is usually empty, packed with LogDataTraits
+struct TaggedLogData
+{
+    ExampleLogLevel level;
+    ExampleLogRegion region;
+    std::uint8_t tagLength;
+    char tag[32];
+};
+
+} // namespace rtlog::test
+
+template <>
+struct rtlog::LogDataTraits<rtlog::test::TaggedLogData>
+{
+    static int Level(const rtlog::test::TaggedLogData& data) { return static_cast<int>(data.level); }
+    static int Region(const rtlog::test::TaggedLogData& data) { return static_cast<int>(data.region); }
+
+    // Level and region are stored with every record already, so only the tag is packed
+    static size_t Pack(const rtlog::test::TaggedLogData& data, unsigned char* out)
+    {
+        out[0] = data.tagLength;
+        std::memcpy(out + 1, data.tag, data.tagLength);
+        return 1 + size_t{data.tagLength};
+    }
+
+    static bool Unpack(const unsigned char* packed, size_t numBytes, rtlog::test::TaggedLogData& data)
+    {
+        if (numBytes == 0 || packed[0] > sizeof(data.tag) || numBytes != 1 + size_t{packed[0]})
+        {
+            return false;
+        }
+        data.tagLength = packed[0];
+        std::memcpy(data.tag, packed + 1, data.tagLength);
+        return true;
+    }
+};
+
+namespace rtlog::test
+{
+
+// A directory that is removed, with everything in it, at the end of the test
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory()
+    {
+        char path[] = "/tmp/rtlog_test_XXXXXX";
+        mPath = mkdtemp(path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        const auto command = "rm -rf " + mPath;
+        std::system(command.c_str());
+    }
+
+    std::string Path(const std::string& name) const
+    {
+        return mPath + "/" + name;
+    }
+
+private:
+    std::string mPath;
+};
+
+// Logs numMessages messages "message <i>" through a logger into the sink, flushing after each drain like a
+// LogProcessingThread would, and returns the sequence number of the first one
+template <typename SinkType>
+std::uint64_t WriteMessages(SinkType& sink, int numMessages)
+{
+    ExampleLogger logger;
+    const auto firstSequenceNumber = gSequenceNumber.load() + 1;
+    for (int i = 0; i < numMessages; i++)
+    {
+        const auto level = static_cast<ExampleLogLevel>(i % 4);
+        CHECK(logger.Log({level, ExampleLogRegion::Audio}, "message %d", i) == rtlog::Status::Success);
+        if (i % 50 == 49)
+        {
+            logger.PrintAndClearLogQueue(sink);
+            sink.Flush();
+        }
+    }
+    logger.PrintAndClearLogQueue(sink);
+    sink.Flush();
+    return firstSequenceNumber;
+}
+
+std::string MessageOf(const rtlog::BinaryLogRecordView& record)
+{
+    return std::string(record.mMessage, record.mMessageLength);
+}
+
+} // namespace rtlog::test
+
+using namespace rtlog::test;
+
+TEST_CASE("BinaryLogSink and BinaryLogReader round trip")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 16;
+    options.mMaxSegmentBytes = 1 << 20;
+
+    std::uint64_t firstSequenceNumber = 0;
+    {
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        firstSequenceNumber = WriteMessages(sink, 1000);
+        CHECK(sink.NumWriteErrors() == 0);
+        CHECK(sink.NumSegments() == 1);
+    }
+
+    rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, 0));
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.LogDataBytes() == sizeof(ExampleLogData));
+    CHECK(reader.FirstSequenceNumber() == firstSequenceNumber);
+    CHECK(reader.NumIndexEntries() >= 1000 / 16);
+
+    SUBCASE("Everything is read back in order")
+    {
+        int i = 0;
+        CHECK(reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+            CHECK(record.mSequenceNumber == firstSequenceNumber + i);
+            CHECK(record.mLevel == i % 4);
+            CHECK(record.mRegion == static_cast<int>(ExampleLogRegion::Audio));
+            CHECK(MessageOf(record) == "message " + std::to_string(i));
+
+            ExampleLogData data;
+            CHECK(rtlog::UnpackLogData(record, data));
+            CHECK(data.region == ExampleLogRegion::Audio);
+            i++;
+            return true;
+        }) == 1000);
+    }
+
+    SUBCASE("Seeking to a sequence number")
+    {
+        std::vector<std::string> messages;
+        reader.ReadFromSequenceNumber(firstSequenceNumber + 777, [&](const rtlog::BinaryLogRecordView& record) {
+            messages.push_back(MessageOf(record));
+            return messages.size() < 3;
+        });
+        REQUIRE(messages.size() == 3);
+        CHECK(messages[0] == "message 777");
+        CHECK(messages[2] == "message 779");
+    }
+
+    SUBCASE("Seeking to a time")
+    {
+        std::int64_t timestampOf500 = 0;
+        reader.ReadFromSequenceNumber(firstSequenceNumber + 500, [&](const rtlog::BinaryLogRecordView& record) {
+            timestampOf500 = record.mTimestamp;
+            return false;
+        });
+
+        reader.ReadFromTimestamp(timestampOf500, [&](const rtlog::BinaryLogRecordView& record) {
+            CHECK(record.mTimestamp >= timestampOf500);
+            CHECK(record.mSequenceNumber <= firstSequenceNumber + 500);
+            return false;
+        });
+    }
+
+    SUBCASE("Ranges cut at arbitrary offsets read every record once")
+    {
+        std::vector<int> timesRead(1000, 0);
+        const size_t rangeBytes = 1000;
+        for (size_t offset = 0; offset < reader.Size(); offset += rangeBytes)
+        {
+            reader.ReadRange(offset, offset + rangeBytes, [&](const rtlog::BinaryLogRecordView& record) {
+                timesRead[record.mSequenceNumber - firstSequenceNumber]++;
+                return true;
+            });
+        }
+        CHECK(std::count(timesRead.begin(), timesRead.end(), 1) == 1000);
+    }
+
+    SUBCASE("Without the index, and with a torn last block")
+    {
+        const auto segmentPath = rtlog::BinaryLogSegmentPath(basePath, 0);
+        std::remove(rtlog::BinaryLogIndexPath(segmentPath).c_str());
+
+        FILE* file = std::fopen(segmentPath.c_str(), "r+");
+        REQUIRE(file != nullptr);
+        std::fseek(file, 0, SEEK_END);
+        const auto size = std::ftell(file);
+        std::fclose(file);
+        const auto footerBytes = static_cast<long>(sizeof(rtlog::BinaryLogFooter) + options.mBloomFilterBytes);
+        REQUIRE(truncate(segmentPath.c_str(), size - footerBytes - 10) == 0);
+
+        rtlog::BinaryLogReader unindexed(segmentPath);
+        REQUIRE(unindexed.IsOpen());
+        CHECK(unindexed.NumIndexEntries() == reader.NumIndexEntries() - 1);
+
+        const auto numRead = unindexed.ReadAll([](const rtlog::BinaryLogRecordView&) { return true; });
+        CHECK(numRead < 1000);
+        CHECK(numRead >= 1000 - 16);
+
+        std::vector<std::string> messages;
+        unindexed.ReadFromSequenceNumber(firstSequenceNumber + 321, [&](const rtlog::BinaryLogRecordView& record) {
+            messages.push_back(MessageOf(record));
+            return false;
+        });
+        REQUIRE(messages.size() == 1);
+        CHECK(messages[0] == "message 321");
+    }
+}
+
+TEST_CASE("BinaryLogReader resyncs past a damaged block")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+    const auto segmentPath = rtlog::BinaryLogSegmentPath(basePath, 0);
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 16;
+
+    std::uint64_t firstSequenceNumber = 0;
+    {
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        firstSequenceNumber = WriteMessages(sink, 1000);
+    }
+    std::remove(rtlog::BinaryLogIndexPath(segmentPath).c_str());
+
+    // Overwrite a few blocks in the first tenth of the segment, sync markers included
+    FILE* file = std::fopen(segmentPath.c_str(), "r+");
+    REQUIRE(file != nullptr);
+    std::fseek(file, 0, SEEK_END);
+    const auto size = std::ftell(file);
+    std::fseek(file, size / 20, SEEK_SET);
+    const std::vector<char> garbage(2048, 'x');
+    std::fwrite(garbage.data(), 1, garbage.size(), file);
+    std::fclose(file);
+
+    rtlog::BinaryLogReader reader(segmentPath);
+    REQUIRE(reader.IsOpen());
+    std::uint64_t lastSequenceNumber = 0;
+    const auto numRead = reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        CHECK(record.mSequenceNumber > lastSequenceNumber);
+        lastSequenceNumber = record.mSequenceNumber;
+        return true;
+    });
+    CHECK(numRead < 1000);
+    CHECK(numRead > 900);
+    CHECK(lastSequenceNumber == firstSequenceNumber + 999);
+}
+
+TEST_CASE("Crc32c")
+{
+    const std::string check = "123456789";
+    CHECK(rtlog::Crc32c(check.data(), check.size()) == 0xe3069283);
+    CHECK(rtlog::Crc32c(check.data(), 4, rtlog::Crc32c(check.data(), 0)) == rtlog::Crc32c(check.data(), 4));
+    CHECK(rtlog::Crc32c(check.data() + 4, 5, rtlog::Crc32c(check.data(), 4)) == 0xe3069283);
+
+    // Whatever the implementation, it agrees with the table for every length and alignment
+    std::vector<unsigned char> bytes(100);
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        bytes[i] = static_cast<unsigned char>(i * 37 + 11);
+    }
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t length = 0; offset + length <= bytes.size(); length++)
+        {
+            const auto expected = ~rtlog::detail::Crc32cTable(~0u, bytes.data() + offset, length);
+            CHECK(rtlog::Crc32c(bytes.data() + offset, length) == expected);
+        }
+    }
+}
+
+TEST_CASE("BinaryLogReader skips blocks whose checksum doesn't match")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+    const auto segmentPath = rtlog::BinaryLogSegmentPath(basePath, 0);
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 10;
+
+    std::uint64_t firstSequenceNumber = 0;
+    {
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        firstSequenceNumber = WriteMessages(sink, 100);
+    }
+
+    // Change one character of a message in the block with messages 50 to 59, which leaves its structure intact
+    FILE* file = std::fopen(segmentPath.c_str(), "r+");
+    REQUIRE(file != nullptr);
+    std::vector<char> contents(1 << 16);
+    contents.resize(std::fread(contents.data(), 1, contents.size(), file));
+    const std::string target = "message 55";
+    const auto position = std::search(contents.begin(), contents.end(), target.begin(), target.end());
+    REQUIRE(position != contents.end());
+    std::fseek(file, static_cast<long>(position - contents.begin()), SEEK_SET);
+    std::fputc('M', file);
+    std::fclose(file);
+
+    rtlog::BinaryLogReader reader(segmentPath);
+    REQUIRE(reader.IsOpen());
+    std::vector<std::uint64_t> sequenceNumbers;
+    reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        sequenceNumbers.push_back(record.mSequenceNumber - firstSequenceNumber);
+        return true;
+    });
+    REQUIRE(sequenceNumbers.size() == 90);
+    CHECK(sequenceNumbers[49] == 49);
+    CHECK(sequenceNumbers[50] == 60);
+
+    std::vector<std::uint64_t> fromSequenceNumber;
+    reader.ReadFromSequenceNumber(firstSequenceNumber + 52, [&](const rtlog::BinaryLogRecordView& record) {
+        fromSequenceNumber.push_back(record.mSequenceNumber - firstSequenceNumber);
+        return false;
+    });
+    REQUIRE(fromSequenceNumber.size() == 1);
+    CHECK(fromSequenceNumber[0] == 60);
+}
+
+TEST_CASE("Binary log record headers are varint and delta encoded")
+{
+    rtlog::BinaryLogRecordHeader previous;
+    previous.mSequenceNumber = 1000;
+    previous.mTimestamp = 5000000000;
+
+    rtlog::BinaryLogRecordHeader header;
+    header.mSequenceNumber = 1001;
+    header.mTimestamp = 5000000000 - 300; // clocks can step back
+    header.mLevel = -1;
+    header.mRegion = 7;
+    header.mThreadId = 3;
+    header.mLogDataBytes = 0;
+    header.mMessageLength = 40;
+
+    unsigned char encoded[rtlog::kMaxEncodedBinaryLogRecordHeaderBytes];
+    const auto* end = rtlog::EncodeBinaryLogRecordHeader(header, previous, encoded);
+    CHECK(end - encoded == 8);
+
+    rtlog::BinaryLogRecordHeader decoded;
+    CHECK(rtlog::DecodeBinaryLogRecordHeader(encoded, end, previous, decoded) == end);
+    CHECK(decoded.mSequenceNumber == header.mSequenceNumber);
+    CHECK(decoded.mTimestamp == header.mTimestamp);
+    CHECK(decoded.mLevel == header.mLevel);
+    CHECK(decoded.mRegion == header.mRegion);
+    CHECK(decoded.mThreadId == header.mThreadId);
+    CHECK(decoded.mMessageLength == header.mMessageLength);
+    CHECK(rtlog::DecodeBinaryLogRecordHeader(encoded, end - 1, previous, decoded) == nullptr);
+
+    header.mSequenceNumber = UINT64_MAX;
+    header.mTimestamp = INT64_MIN;
+    header.mThreadId = UINT32_MAX;
+    end = rtlog::EncodeBinaryLogRecordHeader(header, rtlog::BinaryLogRecordHeader{}, encoded);
+    CHECK(rtlog::DecodeBinaryLogRecordHeader(encoded, end, rtlog::BinaryLogRecordHeader{}, decoded) == end);
+    CHECK(decoded.mSequenceNumber == UINT64_MAX);
+    CHECK(decoded.mTimestamp == INT64_MIN);
+    CHECK(decoded.mThreadId == UINT32_MAX);
+}
+
+TEST_CASE("BinaryLogSink packs LogData with LogDataTraits")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mBloomFilterBytes = 0;
+
+    constexpr int kNumMessages = 1000;
+    {
+        rtlog::Logger<TaggedLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+        rtlog::BinaryLogSink<TaggedLogData> sink(basePath, options);
+        for (int i = 0; i < kNumMessages; i++)
+        {
+            TaggedLogData data{ExampleLogLevel::Info, ExampleLogRegion::Game, 0, {}};
+            if (i % 10 == 0)
+            {
+                data.tagLength = 3;
+                std::memcpy(data.tag, "gpu", 3);
+            }
+            CHECK(logger.Log(std::move(data), "x") == rtlog::Status::Success);
+            if (i % 50 == 49)
+            {
+                logger.PrintAndClearLogQueue(sink);
+            }
+        }
+    }
+
+    rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, 0));
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.LogDataBytes() == sizeof(TaggedLogData));
+
+    // Header, packed LogData and the one character message, with the block headers spread over the records
+    const auto bytesPerRecord = static_cast<double>(reader.Size()) / kNumMessages;
+    CHECK(bytesPerRecord < 14);
+
+    int i = 0;
+    reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        TaggedLogData data{};
+        CHECK(rtlog::UnpackLogData(record, data));
+        CHECK(record.mLevel == static_cast<int>(ExampleLogLevel::Info));
+        CHECK(record.mRegion == static_cast<int>(ExampleLogRegion::Game));
+        CHECK(std::string(data.tag, data.tagLength) == (i % 10 == 0 ? "gpu" : ""));
+        i++;
+        return true;
+    });
+    CHECK(i == kNumMessages);
+}
+
+TEST_CASE("BinaryLogSink starts new segments")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 8;
+    options.mMaxSegmentBytes = 4096;
+
+    rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+    const auto firstSequenceNumber = WriteMessages(sink, 500);
+    REQUIRE(sink.NumSegments() > 1);
+
+    std::uint64_t expected = firstSequenceNumber;
+    for (size_t i = 0; i < sink.NumSegments(); i++)
+    {
+        rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, i));
+        REQUIRE(reader.IsOpen());
+        CHECK(reader.FirstSequenceNumber() == expected);
+        reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+            CHECK(record.mSequenceNumber == expected);
+            expected++;
+            return true;
+        });
+    }
+    CHECK(expected == firstSequenceNumber + 500);
+}
+
+TEST_CASE("BinaryLogSink retries a segment it could not open")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+    const auto segmentPath = rtlog::BinaryLogSegmentPath(basePath, 0);
+
+    // A directory in the way of the index makes opening the segment fail
+    const auto indexPath = rtlog::BinaryLogIndexPath(segmentPath);
+    REQUIRE(::mkdir(indexPath.c_str(), 0755) == 0);
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 8;
+    rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+    WriteMessages(sink, 10);
+    CHECK(sink.NumWriteErrors() > 0);
+    CHECK(sink.NumSegments() == 0);
+
+    REQUIRE(::rmdir(indexPath.c_str()) == 0);
+    const auto numWriteErrors = sink.NumWriteErrors();
+    const auto firstSequenceNumber = WriteMessages(sink, 100);
+    CHECK(sink.NumWriteErrors() == numWriteErrors);
+    CHECK(sink.NumSegments() == 1);
+
+    rtlog::BinaryLogReader reader(segmentPath);
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.FirstSequenceNumber() == firstSequenceNumber);
+    CHECK(reader.NumIndexEntries() >= 100 / 8);
+    std::uint64_t expected = firstSequenceNumber;
+    reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        CHECK(record.mSequenceNumber == expected);
+        expected++;
+        return true;
+    });
+    CHECK(expected == firstSequenceNumber + 100);
+}
+
+TEST_CASE("Segment bloom filters rule out segments")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mRecordsPerBlock = 8;
+    options.mMaxSegmentBytes = 4096;
+    options.mBloomFilterBytes = 1024;
+
+    size_t numSegments = 0;
+    std::uint64_t firstSequenceNumber = 0;
+    {
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        firstSequenceNumber = WriteMessages(sink, 500);
+        numSegments = sink.NumSegments();
+        CHECK(sink.NumWriteErrors() == 0);
+    }
+    REQUIRE(numSegments > 4);
+
+    rtlog::BinaryLogQuery hasMessage250;
+    hasMessage250.mTokens.push_back("250");
+
+    rtlog::BinaryLogQuery hasNetwork;
+    hasNetwork.mRegion = static_cast<int>(ExampleLogRegion::Network);
+
+    rtlog::BinaryLogQuery hasAudio;
+    hasAudio.mRegion = static_cast<int>(ExampleLogRegion::Audio);
+    hasAudio.mTokens.push_back("message");
+
+    size_t numMayHave250 = 0;
+    size_t numMayHaveNetwork = 0;
+    for (size_t i = 0; i < numSegments; i++)
+    {
+        rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, i));
+        REQUIRE(reader.IsOpen());
+        CHECK(reader.HasBloomFilter());
+        CHECK(reader.MayContain(hasAudio));
+
+        bool has250 = false;
+        CHECK(reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+            has250 = has250 || record.mSequenceNumber == firstSequenceNumber + 250;
+            return true;
+        }) > 0);
+        if (has250)
+        {
+            CHECK(reader.MayContain(hasMessage250));
+        }
+        numMayHave250 += reader.MayContain(hasMessage250) ? 1 : 0;
+        numMayHaveNetwork += reader.MayContain(hasNetwork) ? 1 : 0;
+    }
+    CHECK(numMayHave250 >= 1);
+    CHECK(numMayHave250 < numSegments / 2);
+    CHECK(numMayHaveNetwork < numSegments / 2);
+}
+
+TEST_CASE("BinaryLogQuery only takes the tokens within a substring")
+{
+    rtlog::BinaryLogQuery query;
+    query.AddTokensWithin("derrun on bus 1234 of mixer");
+    REQUIRE(query.mTokens.size() == 2);
+    CHECK(query.mTokens[0] == "bus");
+    CHECK(query.mTokens[1] == "1234");
+}
+
+TEST_CASE("BinaryLogSink commits durable records in groups")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    SUBCASE("Without a window, every flush with a durable record commits")
+    {
+        std::vector<std::uint64_t> durableSequenceNumbers;
+        rtlog::BinaryLogSinkOptions options;
+        options.mDurableMinLevel = static_cast<int>(ExampleLogLevel::Critical);
+        options.mOnDurable = [&](std::uint64_t sequenceNumber) { durableSequenceNumbers.push_back(sequenceNumber); };
+        options.mGroupCommitWindow = std::chrono::microseconds(0);
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        const auto firstSequenceNumber = WriteMessages(sink, 1000);
+
+        // WriteMessages flushes every 50 messages, and every fourth message is Critical
+        CHECK(sink.NumCommits() == 20);
+        CHECK(sink.NumWriteErrors() == 0);
+        CHECK(sink.DurableSequenceNumber() == firstSequenceNumber + 999);
+        REQUIRE(durableSequenceNumbers.size() == 20);
+        CHECK(durableSequenceNumbers[0] == firstSequenceNumber + 49);
+    }
+
+    SUBCASE("A long window groups them into one commit, and the rest is committed on close")
+    {
+        std::vector<std::uint64_t> durableSequenceNumbers;
+        rtlog::BinaryLogSinkOptions options;
+        options.mDurableMinLevel = static_cast<int>(ExampleLogLevel::Critical);
+        options.mOnDurable = [&](std::uint64_t sequenceNumber) { durableSequenceNumbers.push_back(sequenceNumber); };
+        options.mGroupCommitWindow = std::chrono::hours(1);
+        std::uint64_t firstSequenceNumber = 0;
+        {
+            rtlog::BinaryLogSink<ExampleLogData> sink(directory.Path("grouped"), options);
+            firstSequenceNumber = WriteMessages(sink, 1000);
+            CHECK(sink.NumCommits() == 1);
+            CHECK(sink.DurableSequenceNumber() == firstSequenceNumber + 49);
+        }
+        REQUIRE(durableSequenceNumbers.size() == 2);
+        CHECK(durableSequenceNumbers[1] == firstSequenceNumber + 999);
+    }
+
+#if defined(__linux__)
+    SUBCASE("A segment whose commit fails when it is closed is synced again before anything is durable")
+    {
+        std::vector<std::uint64_t> durableSequenceNumbers;
+        rtlog::BinaryLogSinkOptions options;
+        options.mRecordsPerBlock = 8;
+        options.mMaxSegmentBytes = 4096;
+        options.mDurableMinLevel = static_cast<int>(ExampleLogLevel::Critical);
+        options.mOnDurable = [&](std::uint64_t sequenceNumber) {
+            // Nothing counts as durable while a segment's data may not have reached the disk
+            CHECK(gUnsyncedInode.load() == 0);
+            durableSequenceNumbers.push_back(sequenceNumber);
+        };
+        options.mGroupCommitWindow = std::chrono::hours(1);
+        rtlog::BinaryLogSink<ExampleLogData> sink(directory.Path("rotated"), options);
+
+        // The first flush commits, the rest wait for the window or for their segment to be closed
+        WriteMessages(sink, 50);
+        REQUIRE(durableSequenceNumbers.size() == 1);
+
+        gNumFailingDataSyncs = 1;
+        WriteMessages(sink, 1000);
+        CHECK(gNumFailingDataSyncs.load() == 0);
+        CHECK(sink.NumSegments() > 2);
+        CHECK(sink.NumWriteErrors() == 1);
+        CHECK(durableSequenceNumbers.size() > 1);
+        CHECK(gUnsyncedInode.load() == 0);
+    }
+#endif
+
+    SUBCASE("Records below the durable level are not committed")
+    {
+        std::vector<std::uint64_t> durableSequenceNumbers;
+        rtlog::BinaryLogSinkOptions options;
+        options.mDurableMinLevel = static_cast<int>(ExampleLogLevel::Critical);
+        options.mOnDurable = [&](std::uint64_t sequenceNumber) { durableSequenceNumbers.push_back(sequenceNumber); };
+        options.mDurableMinLevel = INT_MAX;
+        rtlog::BinaryLogSink<ExampleLogData> sink(directory.Path("not_durable"), options);
+        WriteMessages(sink, 100);
+        CHECK(sink.NumCommits() == 0);
+        CHECK(sink.DurableSequenceNumber() == 0);
+    }
+}
+
+TEST_CASE("BinaryLogSink::WaitUntilDurable")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mGroupCommitWindow = std::chrono::microseconds(0);
+
+    ExampleLogger logger;
+    rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+    rtlog::LogProcessingThread thread(logger, sink, std::chrono::milliseconds(1));
+
+    CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Audio}, "not durable by level") ==
+          rtlog::Status::Success);
+    const auto sequenceNumber = gSequenceNumber.load();
+    CHECK(sink.WaitUntilDurable(sequenceNumber, std::chrono::seconds(5)));
+    CHECK(sink.DurableSequenceNumber() >= sequenceNumber);
+    thread.Stop();
+}
+
+TEST_CASE("LogProcessingThread flushes print functions that have Flush")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    ExampleLogger logger;
+    rtlog::BinaryLogSink<ExampleLogData> sink(basePath);
+    {
+        rtlog::LogProcessingThread thread(logger, sink, std::chrono::milliseconds(1));
+        for (int i = 0; i < 10; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Audio}, "message %d", i) ==
+                  rtlog::Status::Success);
+        }
+    }
+
+    // The sink is still open, with its block size far from reached
+    rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, 0));
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.ReadAll([](const rtlog::BinaryLogRecordView&) { return true; }) == 10);
+}
+
+TEST_CASE("LogProcessingThread flushes sinks wrapped in a BacktraceBuffer")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+
+    ExampleLogger logger;
+    rtlog::BinaryLogSink<ExampleLogData> sink(basePath);
+    rtlog::BacktraceBuffer<ExampleLogData, decltype(sink), MAX_LOG_MESSAGE_LENGTH> backtrace(
+        sink, static_cast<int>(ExampleLogLevel::Info), static_cast<int>(ExampleLogLevel::Warning));
+    {
+        rtlog::LogProcessingThread thread(logger, backtrace, std::chrono::milliseconds(1));
+        for (int i = 0; i < 10; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Audio}, "message %d", i) ==
+                  rtlog::Status::Success);
+        }
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "held back") == rtlog::Status::Success);
+    }
+
+    // The sink is still open, so only the thread's flushes can have written the records out
+    rtlog::BinaryLogReader reader(rtlog::BinaryLogSegmentPath(basePath, 0));
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.ReadAll([](const rtlog::BinaryLogRecordView&) { return true; }) == 10);
+}
+
+TEST_CASE("BinaryLogSink with O_DIRECT")
+{
+    TemporaryDirectory directory;
+    const auto basePath = directory.Path("log");
+    const auto segmentPath = rtlog::BinaryLogSegmentPath(basePath, 0);
+
+    rtlog::BinaryLogSinkOptions options;
+    options.mDirectIo = true;
+    options.mRecordsPerBlock = 16;
+    options.mBloomFilterBytes = 1000; // not a multiple of the alignment, to leave a partial page at the end
+
+    std::uint64_t firstSequenceNumber = 0;
+    {
+        rtlog::BinaryLogSink<ExampleLogData> sink(basePath, options);
+        firstSequenceNumber = WriteMessages(sink, 1000);
+        CHECK(sink.NumWriteErrors() == 0);
+
+        // While the segment is open it may end in padding, which readers skip
+        rtlog::BinaryLogReader reader(segmentPath);
+        REQUIRE(reader.IsOpen());
+        CHECK(reader.ReadAll([](const rtlog::BinaryLogRecordView&) { return true; }) == 1000);
+        if (sink.UsesDirectIo())
+        {
+            CHECK(reader.Size() % rtlog::BinaryLogSink<ExampleLogData>::kDirectIoAlignment == 0);
+        }
+    }
+
+    rtlog::BinaryLogReader reader(segmentPath);
+    REQUIRE(reader.IsOpen());
+    CHECK(reader.HasBloomFilter());
+    int i = 0;
+    CHECK(reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        CHECK(record.mSequenceNumber == firstSequenceNumber + i);
+        CHECK(MessageOf(record) == "message " + std::to_string(i));
+        i++;
+        return true;
+    }) == 1000);
+}
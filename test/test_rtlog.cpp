@@ -1,7 +1,18 @@
 #include <doctest/doctest.h>
 //#include <rtlog/rtlog.h>
+#include <rtlog/BacktraceBuffer.h>
 #include <rtlog/LogProcessingThread.h>
 #include <rtlog/Logger.h>
+#include <rtlog/Metrics.h>
+#include <rtlog/PerCpuLanes.h>
+#include <rtlog/PriorityLogger.h>
+#include <rtlog/Symbolizer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace rtlog::test
 {
@@ -85,6 +96,19 @@ static auto PrintMessage = [](const ExampleLogData& data, size_t sequenceNumber,
         buffer.data());
 };
 
+template <typename LoggerType>
+__attribute__((noinline)) void LogCritical(LoggerType& logger)
+{
+    logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "Something bad happened");
+}
+
+template <typename LoggerType>
+__attribute__((noinline)) void CallsLogCritical(LoggerType& logger)
+{
+    LogCritical(logger);
+    asm volatile(""); // keep this from being a tail call
+}
+
 } // namespace rtlog::test
 
 using namespace rtlog::test;
@@ -191,6 +215,996 @@ TEST_CASE("Errors are returned from Log")
     }
 }
 
+TEST_CASE("MultipleProducerSingleConsumer logger")
+{
+    using MpscLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerSingleConsumer>;
+
+    SUBCASE("Messages come out intact")
+    {
+        MpscLogger logger;
+
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %d!", 123) == rtlog::Status::Success);
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "Hello, %s!", "world") == rtlog::Status::Success);
+
+        std::vector<std::string> messages;
+        auto InspectLogMessage = [&messages](const ExampleLogData& data, size_t sequenceNumber, const char* fstring, ...)
+        {
+            (void)data;
+            (void)sequenceNumber;
+
+            std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer{};
+            va_list args;
+            va_start(args, fstring);
+            vsnprintf(buffer.data(), buffer.size(), fstring, args);
+            va_end(args);
+
+            messages.emplace_back(buffer.data());
+        };
+
+        CHECK(logger.PrintAndClearLogQueue(InspectLogMessage) == 2);
+        REQUIRE(messages.size() == 2);
+        CHECK(messages[0] == "Hello, 123!");
+        CHECK(messages[1] == "Hello, world!");
+    }
+
+    SUBCASE("Many threads can log at once")
+    {
+        MpscLogger logger;
+
+        constexpr auto numThreads = 4;
+        constexpr auto numMessagesPerThread = 2000;
+
+        std::atomic<int> numProducersRunning{ numThreads };
+        std::vector<std::thread> producers;
+        for (int i = 0; i < numThreads; i++)
+        {
+            producers.emplace_back([&logger, &numProducersRunning, i]() {
+                for (int j = 0; j < numMessagesPerThread; j++)
+                {
+                    while (logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "%d %d", i, j) == rtlog::Status::Error_QueueFull)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                numProducersRunning--;
+            });
+        }
+
+        std::array<int, numThreads> nextExpected{};
+        auto CheckOrder = [&nextExpected](const ExampleLogData&, size_t, const char* fstring, ...)
+        {
+            va_list args;
+            va_start(args, fstring);
+            const char* message = va_arg(args, const char*);
+            va_end(args);
+
+            int thread = -1;
+            int index = -1;
+            sscanf(message, "%d %d", &thread, &index);
+            REQUIRE(thread >= 0);
+            REQUIRE(thread < static_cast<int>(nextExpected.size()));
+            CHECK(nextExpected[thread] == index);
+            nextExpected[thread] = index + 1;
+        };
+
+        int numProcessed = 0;
+        while (numProducersRunning > 0)
+        {
+            numProcessed += logger.PrintAndClearLogQueue(CheckOrder);
+        }
+        numProcessed += logger.PrintAndClearLogQueue(CheckOrder);
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+
+        CHECK(numProcessed == numThreads * numMessagesPerThread);
+    }
+
+    SUBCASE("Enqueue more than capacity and get an error")
+    {
+        const auto maxNumMessages = 10;
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerSingleConsumer> logger;
+
+        auto status = rtlog::Status::Success;
+        while (status == rtlog::Status::Success)
+        {
+            status = logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %s!", "world");
+        }
+
+        CHECK(status == rtlog::Status::Error_QueueFull);
+        CHECK(logger.PrintAndClearLogQueue(PrintMessage) > maxNumMessages);
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %s!", "world") == rtlog::Status::Success);
+    }
+}
+
+TEST_CASE("MultipleProducerMultipleConsumer logger")
+{
+    using MpmcLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerMultipleConsumer>;
+
+    SUBCASE("Messages come out intact")
+    {
+        MpmcLogger logger;
+
+        for (int i = 0; i < 3; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %d!", i) == rtlog::Status::Success);
+        }
+
+        std::vector<std::string> messages;
+        auto InspectLogMessage = [&messages](const ExampleLogData&, size_t, const char* fstring, ...)
+        {
+            va_list args;
+            va_start(args, fstring);
+            messages.emplace_back(va_arg(args, const char*));
+            va_end(args);
+        };
+
+        CHECK(logger.PrintAndClearLogQueue(InspectLogMessage) == 3);
+        REQUIRE(messages.size() == 3);
+        CHECK(messages[0] == "Hello, 0!");
+        CHECK(messages[2] == "Hello, 2!");
+        CHECK(logger.PrintAndClearLogQueue(InspectLogMessage) == 0);
+    }
+
+    SUBCASE("Many threads drain at once and every message is processed exactly once")
+    {
+        MpmcLogger logger;
+
+        constexpr auto numProducers = 4;
+        constexpr auto numConsumers = 3;
+        constexpr auto numMessagesPerThread = 5000;
+
+        std::atomic<int> numProducersRunning{ numProducers };
+        std::vector<std::thread> producers;
+        for (int i = 0; i < numProducers; i++)
+        {
+            producers.emplace_back([&logger, &numProducersRunning, i]() {
+                for (int j = 0; j < numMessagesPerThread; j++)
+                {
+                    while (logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "%d %d", i, j) == rtlog::Status::Error_QueueFull)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                numProducersRunning--;
+            });
+        }
+
+        // Each consumer has its own print log function; within it, each producer's messages must stay in order
+        struct Consumer
+        {
+            std::array<int, numProducers> mLastSeen{ -1, -1, -1, -1 };
+            std::vector<std::pair<int, int>> mMessages;
+            int mNumOutOfOrder = 0;
+
+            void operator()(const ExampleLogData&, size_t, const char* fstring, ...)
+            {
+                va_list args;
+                va_start(args, fstring);
+                const char* message = va_arg(args, const char*);
+                va_end(args);
+
+                int thread = -1;
+                int index = -1;
+                sscanf(message, "%d %d", &thread, &index);
+                if (thread < 0 || thread >= numProducers || index <= mLastSeen[thread])
+                {
+                    mNumOutOfOrder++;
+                    return;
+                }
+                mLastSeen[thread] = index;
+                mMessages.emplace_back(thread, index);
+            }
+        };
+
+        std::array<Consumer, numConsumers> consumerFns;
+        std::array<int, numConsumers> numProcessed{};
+        std::vector<std::thread> consumers;
+        for (int i = 0; i < numConsumers; i++)
+        {
+            consumers.emplace_back([&, i]() {
+                while (numProducersRunning > 0)
+                {
+                    numProcessed[i] += logger.PrintAndClearLogQueue(consumerFns[i]);
+                }
+                numProcessed[i] += logger.PrintAndClearLogQueue(consumerFns[i]);
+            });
+        }
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+        for (auto& consumer : consumers)
+        {
+            consumer.join();
+        }
+
+        std::vector<std::vector<int>> seen(numProducers, std::vector<int>(numMessagesPerThread, 0));
+        int total = 0;
+        for (int i = 0; i < numConsumers; i++)
+        {
+            CHECK(consumerFns[i].mNumOutOfOrder == 0);
+            CHECK(numProcessed[i] == static_cast<int>(consumerFns[i].mMessages.size()));
+            total += numProcessed[i];
+            for (const auto& [thread, index] : consumerFns[i].mMessages)
+            {
+                seen[thread][index]++;
+            }
+        }
+        CHECK(total == numProducers * numMessagesPerThread);
+
+        int numNotSeenOnce = 0;
+        for (const auto& producerSeen : seen)
+        {
+            numNotSeenOnce += static_cast<int>(std::count_if(producerSeen.begin(), producerSeen.end(), [](int count) { return count != 1; }));
+        }
+        CHECK(numNotSeenOnce == 0);
+    }
+
+    SUBCASE("A full queue is freed by draining")
+    {
+        const auto maxNumMessages = 10;
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerMultipleConsumer> logger;
+
+        auto status = rtlog::Status::Success;
+        while (status == rtlog::Status::Success)
+        {
+            status = logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %s!", "world");
+        }
+
+        CHECK(status == rtlog::Status::Error_QueueFull);
+        CHECK(logger.PrintAndClearLogQueue(PrintMessage) > maxNumMessages);
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %s!", "world") == rtlog::Status::Success);
+    }
+}
+
+TEST_CASE("MpscByteRing frees runs read with ReadChunk in order")
+{
+    rtlog::MpscByteRing<1024, 64> ring;
+
+    for (std::uint64_t i = 0; i < 4; i++)
+    {
+        REQUIRE(ring.TryWrite(&i, sizeof(i), nullptr, 0));
+    }
+    const auto usedBytes = ring.SizeApprox();
+
+    // The first run is held up in its read function while a second consumer reads the next run
+    std::atomic<bool> firstRunStarted{ false };
+    std::atomic<bool> releaseFirstRun{ false };
+    std::vector<std::uint64_t> firstRun;
+    std::thread slowConsumer([&]() {
+        ring.ReadChunk(2, [&](const void* data, size_t numBytes) {
+            std::uint64_t value{};
+            std::memcpy(&value, data, std::min(numBytes, sizeof(value)));
+            firstRun.push_back(value);
+            firstRunStarted = true;
+            while (!releaseFirstRun)
+            {
+                std::this_thread::yield();
+            }
+        });
+    });
+
+    while (!firstRunStarted)
+    {
+        std::this_thread::yield();
+    }
+
+    std::vector<std::uint64_t> secondRun;
+    CHECK(ring.ReadChunk(2, [&](const void* data, size_t numBytes) {
+        std::uint64_t value{};
+        std::memcpy(&value, data, std::min(numBytes, sizeof(value)));
+        secondRun.push_back(value);
+    }) == 2);
+    CHECK(secondRun == std::vector<std::uint64_t>{ 2, 3 });
+
+    // Nothing is freed until the run before it is
+    CHECK(ring.SizeApprox() == usedBytes);
+    CHECK(ring.ReadChunk(2, [](const void*, size_t) {}) == 0);
+
+    releaseFirstRun = true;
+    slowConsumer.join();
+    CHECK(firstRun == std::vector<std::uint64_t>{ 0, 1 });
+    CHECK(ring.SizeApprox() == 0);
+
+    // The ring keeps going around
+    size_t numRead = 0;
+    for (std::uint64_t i = 0; i < 1000; i++)
+    {
+        REQUIRE(ring.TryWrite(&i, sizeof(i), nullptr, 0));
+        numRead += ring.ReadChunk(3, [&](const void* data, size_t) {
+            std::uint64_t value{};
+            std::memcpy(&value, data, sizeof(value));
+            CHECK(value == numRead);
+        });
+    }
+    CHECK(numRead == 1000);
+    CHECK(ring.SizeApprox() == 0);
+}
+
+TEST_CASE("PerCpuLanes hands out every record intact while many threads write")
+{
+    using Lanes = rtlog::PerCpuLanes<4096, 64>;
+    Lanes lanes;
+
+#if defined(RTLOG_HAS_RSEQ_COMMIT)
+    CHECK(lanes.UsesRestartableSequences() == (__rseq_size > 0));
+#else
+    CHECK_FALSE(lanes.UsesRestartableSequences());
+#endif
+
+    struct Record
+    {
+        std::uint64_t key;
+        std::uint32_t thread;
+        std::uint32_t check;
+    };
+
+    constexpr auto numThreads = 4;
+    constexpr std::uint32_t numRecordsPerThread = 20000;
+
+    std::atomic<std::uint64_t> nextKey{ 0 };
+    std::atomic<int> numProducersRunning{ numThreads };
+    std::vector<std::thread> producers;
+    for (std::uint32_t i = 0; i < numThreads; i++)
+    {
+        producers.emplace_back([&, i]() {
+            for (std::uint32_t j = 0; j < numRecordsPerThread; j++)
+            {
+                const Record record{ nextKey++, i, j ^ 0x5a5a5a5au };
+                while (!lanes.TryWrite(&record, sizeof(record), &j, sizeof(j)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            numProducersRunning--;
+        });
+    }
+
+    std::vector<std::uint32_t> nextPerThread(numThreads, 0);
+    size_t numRead = 0;
+    size_t numCorrupt = 0;
+    auto Key = [](const void* data, size_t) {
+        Record record{};
+        std::memcpy(&record, data, sizeof(record));
+        return record.key;
+    };
+    auto Read = [&](const void* data, size_t numBytes) {
+        Record record{};
+        std::uint32_t payload{};
+        std::memcpy(&record, data, sizeof(record));
+        std::memcpy(&payload, static_cast<const char*>(data) + sizeof(record), sizeof(payload));
+        if (numBytes != sizeof(record) + sizeof(payload) || record.thread >= numThreads || (record.check ^ 0x5a5a5a5au) != payload)
+        {
+            numCorrupt++;
+            return;
+        }
+        // Records of one thread are only reordered if it was migrated or preempted mid-write, never lost or repeated
+        nextPerThread[record.thread] = std::max(nextPerThread[record.thread], payload + 1);
+        numRead++;
+    };
+
+    while (numProducersRunning > 0)
+    {
+        lanes.ReadAll(Key, Read);
+    }
+    lanes.ReadAll(Key, Read);
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    CHECK(numCorrupt == 0);
+    CHECK(numRead == numThreads * numRecordsPerThread);
+    CHECK(nextPerThread == std::vector<std::uint32_t>(numThreads, numRecordsPerThread));
+    CHECK(lanes.SizeApprox() == 0);
+}
+
+TEST_CASE("PerCpuMultipleProducerSingleConsumer logger")
+{
+    using PerCpuLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::PerCpuMultipleProducerSingleConsumer>;
+
+    SUBCASE("Messages come out in sequence number order")
+    {
+        PerCpuLogger logger;
+
+        for (int i = 0; i < 50; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello, %d!", i) == rtlog::Status::Success);
+        }
+
+        size_t lastSequenceNumber = 0;
+        auto CheckOrder = [&lastSequenceNumber](const ExampleLogData&, size_t sequenceNumber, const char*, ...)
+        {
+            CHECK(sequenceNumber > lastSequenceNumber);
+            lastSequenceNumber = sequenceNumber;
+        };
+
+        CHECK(logger.PrintAndClearLogQueue(CheckOrder) == 50);
+    }
+
+    SUBCASE("Many threads can log at once")
+    {
+        PerCpuLogger logger;
+
+        constexpr auto numThreads = 4;
+        constexpr auto numMessagesPerThread = 2000;
+
+        std::atomic<int> numProducersRunning{ numThreads };
+        std::vector<std::thread> producers;
+        for (int i = 0; i < numThreads; i++)
+        {
+            producers.emplace_back([&logger, &numProducersRunning, i]() {
+                for (int j = 0; j < numMessagesPerThread; j++)
+                {
+                    while (logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "%d %d", i, j) == rtlog::Status::Error_QueueFull)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                numProducersRunning--;
+            });
+        }
+
+        auto Ignore = [](const ExampleLogData&, size_t, const char*, ...) {};
+
+        int numProcessed = 0;
+        while (numProducersRunning > 0)
+        {
+            numProcessed += logger.PrintAndClearLogQueue(Ignore);
+        }
+        numProcessed += logger.PrintAndClearLogQueue(Ignore);
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+
+        CHECK(numProcessed == numThreads * numMessagesPerThread);
+    }
+}
+
+TEST_CASE("PerThreadSingleProducerSingleConsumer logger")
+{
+    using PerThreadLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::PerThreadSingleProducerSingleConsumer>;
+
+    SUBCASE("Messages from many threads come out in sequence number order")
+    {
+        PerThreadLogger logger;
+
+        std::vector<std::thread> producers;
+        for (int i = 0; i < 4; i++)
+        {
+            producers.emplace_back([&logger, i]() {
+                CHECK(logger.WarmUpCurrentThread());
+                for (int j = 0; j < 10; j++)
+                {
+                    CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "%d %d", i, j) == rtlog::Status::Success);
+                }
+            });
+        }
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+
+        size_t lastSequenceNumber = 0;
+        auto CheckOrder = [&lastSequenceNumber](const ExampleLogData&, size_t sequenceNumber, const char*, ...)
+        {
+            CHECK(sequenceNumber > lastSequenceNumber);
+            lastSequenceNumber = sequenceNumber;
+        };
+
+        CHECK(logger.PrintAndClearLogQueue(CheckOrder) == 40);
+    }
+
+    SUBCASE("Lanes of exited threads are reused once drained")
+    {
+        PerThreadLogger logger;
+
+        for (int i = 0; i < RTLOG_MAX_NUM_THREAD_LANES * 3; i++)
+        {
+            std::thread producer([&logger]() {
+                REQUIRE(logger.WarmUpCurrentThread());
+                for (int j = 0; j < 5; j++)
+                {
+                    CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "Hello, %d!", j) == rtlog::Status::Success);
+                }
+            });
+            producer.join();
+
+            CHECK(logger.PrintAndClearLogQueue(PrintMessage) == 5);
+        }
+    }
+
+    SUBCASE("A thread can log to more loggers than it holds lanes in at once, one after another")
+    {
+        std::thread producer([]() {
+            for (int i = 0; i < RTLOG_MAX_NUM_REGISTRIES_PER_THREAD + 4; i++)
+            {
+                PerThreadLogger logger;
+                CHECK(logger.WarmUpCurrentThread());
+                CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "logger %d", i) == rtlog::Status::Success);
+                CHECK(logger.PrintAndClearLogQueue(PrintMessage) == 1);
+            }
+        });
+        producer.join();
+    }
+}
+
+TEST_CASE("BacktraceBuffer holds debug messages until a warning")
+{
+    rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+
+    std::vector<std::string> printed;
+    auto CollectMessage = [&printed](const rtlog::LogRecord<ExampleLogData>& record)
+    {
+        CHECK(record.mThreadId == rtlog::CurrentThreadId());
+        CHECK(strlen(record.mMessage) == record.mMessageLength);
+        printed.emplace_back(record.mMessage);
+    };
+
+    constexpr auto numHeldPerThread = 3;
+    rtlog::BacktraceBuffer<ExampleLogData, decltype(CollectMessage), MAX_LOG_MESSAGE_LENGTH, numHeldPerThread> backtrace(
+        CollectMessage, static_cast<int>(ExampleLogLevel::Info), static_cast<int>(ExampleLogLevel::Warning));
+
+    for (int i = 0; i < 5; i++)
+    {
+        logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "debug %d", i);
+    }
+    logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "info");
+
+    CHECK(logger.PrintAndClearLogQueue(backtrace) == 6);
+    REQUIRE(printed.size() == 1);
+    CHECK(printed[0] == "info");
+
+    logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "warning");
+    CHECK(logger.PrintAndClearLogQueue(backtrace) == 1);
+
+    REQUIRE(printed.size() == 5);
+    CHECK(printed[1] == "debug 2");
+    CHECK(printed[2] == "debug 3");
+    CHECK(printed[3] == "debug 4");
+    CHECK(printed[4] == "warning");
+    CHECK(backtrace.NumDiscarded() == 2);
+
+    logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Engine}, "critical");
+    CHECK(logger.PrintAndClearLogQueue(backtrace) == 1);
+    REQUIRE(printed.size() == 6);
+    CHECK(printed[5] == "critical");
+}
+
+#if RTLOG_MAX_STACK_FRAMES > 0
+TEST_CASE("Stack traces are captured at and above the stack capture level")
+{
+    auto CheckStackCapture = [](auto& logger)
+    {
+        REQUIRE(logger.WarmUpCurrentThread());
+        logger.SetStackCaptureLevel(static_cast<int>(ExampleLogLevel::Critical));
+
+        logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Audio}, "No stack please");
+        CallsLogCritical(logger);
+
+        rtlog::Symbolizer symbolizer;
+        std::vector<size_t> numFrames;
+        bool foundCaller = false;
+        auto InspectStack = [&](const rtlog::LogRecord<ExampleLogData>& record)
+        {
+            numFrames.push_back(record.mNumStackFrames);
+            for (size_t i = 0; i < record.mNumStackFrames; i++)
+            {
+                foundCaller |= symbolizer.Symbolize(record.mStackFrames[i]).find("CallsLogCritical") != std::string::npos;
+            }
+        };
+
+        CHECK(logger.PrintAndClearLogQueue(InspectStack) == 2);
+        REQUIRE(numFrames.size() == 2);
+        CHECK(numFrames[0] == 0);
+        CHECK(numFrames[1] > 0);
+        CHECK(numFrames[1] <= RTLOG_MAX_STACK_FRAMES);
+        CHECK(foundCaller);
+    };
+
+    SUBCASE("SingleProducerSingleConsumer")
+    {
+        rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+        CheckStackCapture(logger);
+    }
+
+    SUBCASE("MultipleProducerSingleConsumer")
+    {
+        rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerSingleConsumer> logger;
+        CheckStackCapture(logger);
+    }
+
+    SUBCASE("Nothing is captured on threads whose stack bounds aren't known")
+    {
+        std::thread thread([]() {
+            std::array<void*, 8> frames{};
+            CHECK(rtlog::CaptureStackFrames(frames.data(), frames.size()) == 0);
+            rtlog::WarmUpStackCapture();
+            CHECK(rtlog::CaptureStackFrames(frames.data(), frames.size()) > 0);
+        });
+        thread.join();
+    }
+}
+#endif // RTLOG_MAX_STACK_FRAMES > 0
+
+TEST_CASE("Metrics are aggregated across threads")
+{
+    rtlog::MetricsRegistry<8> metrics;
+    const auto xruns = metrics.AddCounter("xruns");
+    const auto load = metrics.AddGauge("load");
+    const auto callbackTime = metrics.AddHistogram("callback_us");
+
+    constexpr auto numThreads = 3;
+    for (int round = 0; round < 2; round++)
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < numThreads; i++)
+        {
+            threads.emplace_back([&]() {
+                REQUIRE(metrics.WarmUpCurrentThread());
+                for (int j = 0; j < 1000; j++)
+                {
+                    metrics.Increment(xruns);
+                    metrics.Record(callbackTime, 5);
+                }
+                metrics.Set(load, 0.5);
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        // Exited threads are folded in the first time round, and must not be counted twice the second time
+        for (int collection = 0; collection < 2; collection++)
+        {
+            std::vector<rtlog::MetricSnapshot> snapshots;
+            CHECK(metrics.Collect([&](const rtlog::MetricSnapshot& snapshot) { snapshots.push_back(snapshot); }) == 3);
+            REQUIRE(snapshots.size() == 3);
+
+            const auto expectedCount = static_cast<std::uint64_t>((round + 1) * numThreads * 1000);
+            CHECK(snapshots[0].mCount == expectedCount);
+            CHECK(snapshots[1].mValue == 0.5);
+            CHECK(snapshots[2].mCount == expectedCount);
+            CHECK(snapshots[2].mSum == expectedCount * 5);
+            CHECK((*snapshots[2].mBuckets)[3] == expectedCount); // 5 is in [4, 8)
+        }
+    }
+
+    CHECK(metrics.NumDroppedUpdates() == 0);
+}
+
+TEST_CASE("A thread keeps updating metrics of registries created one after another")
+{
+    std::thread updater([]() {
+        for (int i = 0; i < RTLOG_MAX_NUM_REGISTRIES_PER_THREAD + 4; i++)
+        {
+            rtlog::MetricsRegistry<2> metrics;
+            const auto blocks = metrics.AddCounter("blocks");
+            const auto blockTime = metrics.AddHistogram("block_us");
+            CHECK(metrics.WarmUpCurrentThread());
+            metrics.Increment(blocks);
+            metrics.Record(blockTime, 3);
+
+            std::vector<rtlog::MetricSnapshot> snapshots;
+            CHECK(metrics.Collect([&](const rtlog::MetricSnapshot& snapshot) { snapshots.push_back(snapshot); }) == 2);
+            REQUIRE(snapshots.size() == 2);
+            CHECK(snapshots[0].mCount == 1);
+            CHECK(snapshots[1].mCount == 1);
+            CHECK(metrics.NumDroppedUpdates() == 0);
+        }
+    });
+    updater.join();
+}
+
+TEST_CASE("MetricsReporter emits metrics through the print log function")
+{
+    rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+    rtlog::MetricsRegistry<4> metrics;
+    const auto xruns = metrics.AddCounter("xruns");
+    metrics.Increment(xruns, 3);
+
+    rtlog::MetricsReporter reporter(logger, metrics, std::chrono::milliseconds(1000), ExampleLogData{ExampleLogLevel::Info, ExampleLogRegion::Audio}, gSequenceNumber);
+
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "Hello");
+
+    std::vector<std::string> printed;
+    auto CollectMessage = [&printed](const rtlog::LogRecord<ExampleLogData>& record) { printed.emplace_back(record.mMessage); };
+
+    CHECK(reporter.PrintAndClearLogQueue(CollectMessage) == 2);
+    REQUIRE(printed.size() == 2);
+    CHECK(printed[0] == "Hello");
+    CHECK(printed[1] == "xruns=3");
+
+    // Not due again for another second
+    CHECK(reporter.PrintAndClearLogQueue(CollectMessage) == 0);
+}
+
+TEST_CASE("Load shedding drops low levels as the queue fills up")
+{
+    constexpr auto maxNumMessages = 20;
+
+    auto DrainQueue = [](auto& logger) {
+        auto Ignore = [](const rtlog::LogRecord<ExampleLogData>&) {};
+        return logger.PrintAndClearLogQueue(Ignore);
+    };
+
+    SUBCASE("SingleProducerSingleConsumer")
+    {
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+        logger.EnableLoadShedding();
+
+        // Under half full, everything goes through
+        for (int i = 0; i < maxNumMessages / 2; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "%d", i) == rtlog::Status::Success);
+        }
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "shed") == rtlog::Status::Error_MessageShed);
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "kept") == rtlog::Status::Success);
+
+        // Fill up with Info until Info is shed too, Critical is never shed
+        auto status = rtlog::Status::Success;
+        while (status == rtlog::Status::Success)
+        {
+            status = logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "kept");
+        }
+        CHECK(status == rtlog::Status::Error_MessageShed);
+        CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "kept") == rtlog::Status::Success);
+
+        while (status != rtlog::Status::Error_QueueFull)
+        {
+            status = logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Engine}, "kept");
+            CHECK(status != rtlog::Status::Error_MessageShed);
+        }
+
+        CHECK(logger.NumShedMessages(static_cast<int>(ExampleLogLevel::Debug)) == 1);
+        CHECK(logger.NumShedMessages(static_cast<int>(ExampleLogLevel::Info)) == 1);
+        CHECK(logger.NumShedMessages(static_cast<int>(ExampleLogLevel::Critical)) == 0);
+        CHECK(logger.NumShedMessages() == 2);
+
+        // Once the consumer catches up, Debug comes back
+        CHECK(DrainQueue(logger) == maxNumMessages);
+        CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "kept") == rtlog::Status::Success);
+
+        logger.DisableLoadShedding();
+        for (int i = 0; i < maxNumMessages - 1; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "%d", i) == rtlog::Status::Success);
+        }
+    }
+
+    SUBCASE("Hysteresis keeps the level up until the fill drops well below the watermark")
+    {
+        rtlog::LoadShedder shedder;
+        shedder.Enable({{0.5f, 1}}, 0.2f);
+
+        CHECK_FALSE(shedder.ShouldShed(0, 49, 100));
+        CHECK(shedder.ShouldShed(0, 50, 100));
+        CHECK(shedder.CurrentMinLevel() == 1);
+        CHECK(shedder.ShouldShed(0, 31, 100));
+        CHECK_FALSE(shedder.ShouldShed(0, 29, 100));
+        CHECK(shedder.CurrentMinLevel() == INT_MIN);
+    }
+
+    SUBCASE("MultipleProducerSingleConsumer")
+    {
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, rtlog::QueuePolicy::MultipleProducerSingleConsumer> logger;
+        logger.EnableLoadShedding({{0.0f, static_cast<int>(ExampleLogLevel::Warning)}});
+
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "shed") == rtlog::Status::Error_MessageShed);
+        CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "kept") == rtlog::Status::Success);
+        CHECK(DrainQueue(logger) == 1);
+    }
+}
+
+TEST_CASE("PriorityLogger")
+{
+    constexpr auto maxNumMessages = 8;
+
+    SUBCASE("Severe messages are printed first, and are not crowded out by a flood")
+    {
+        rtlog::PriorityLogger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, 2> logger(rtlog::DrainOrder::HighestPriorityFirst, {static_cast<int>(ExampleLogLevel::Critical)});
+
+        CHECK(logger.PriorityOf({ExampleLogLevel::Warning, ExampleLogRegion::Engine}) == 0);
+        CHECK(logger.PriorityOf({ExampleLogLevel::Critical, ExampleLogRegion::Engine}) == 1);
+
+        std::vector<std::string> messages;
+        auto CollectMessage = [&messages](const rtlog::LogRecord<ExampleLogData>& record) { messages.emplace_back(record.mMessage); };
+
+        while (logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "debug") == rtlog::Status::Success)
+        {
+        }
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "critical %d", 1) == rtlog::Status::Success);
+
+        CHECK(logger.PrintAndClearLogQueue(CollectMessage) == maxNumMessages + 1);
+        REQUIRE(messages.size() == maxNumMessages + 1);
+        CHECK(messages.front() == "critical 1");
+        CHECK(messages.back() == "debug");
+    }
+
+    SUBCASE("Sequence number order can be kept")
+    {
+        rtlog::PriorityLogger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, 4> logger(rtlog::DrainOrder::SequenceNumber);
+
+        std::vector<std::string> messages;
+        auto CollectMessage = [&messages](const rtlog::LogRecord<ExampleLogData>& record) { messages.emplace_back(record.mMessage); };
+
+        for (int i = 0; i < 3; i++)
+        {
+            logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "%d", i * 4);
+            logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Audio}, "%d", i * 4 + 1);
+            logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, "%d", i * 4 + 2);
+            logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Audio}, "%d", i * 4 + 3);
+        }
+
+        CHECK(logger.PrintAndClearLogQueue(CollectMessage) == 12);
+        REQUIRE(messages.size() == 12);
+        for (int i = 0; i < 12; i++)
+        {
+            CHECK(messages[i] == std::to_string(i));
+        }
+    }
+}
+
+TEST_CASE("Producers wake the LogProcessingThread early once the queue fills up")
+{
+    for (const auto policy : {rtlog::WakePolicy::Futex, rtlog::WakePolicy::Flag})
+    {
+        constexpr auto maxNumMessages = 16;
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+        logger.EnableEarlyWake(0.5f, policy);
+
+        std::atomic<int> numPrinted{0};
+        auto CountMessage = [&numPrinted](const rtlog::LogRecord<ExampleLogData>&) { numPrinted++; };
+
+        const auto start = std::chrono::steady_clock::now();
+        {
+            // Far longer than the test is allowed to take
+            rtlog::LogProcessingThread thread(logger, CountMessage, std::chrono::milliseconds(60 * 1000));
+
+            for (int i = 0; i < maxNumMessages / 2; i++)
+            {
+                CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "%d", i) == rtlog::Status::Success);
+            }
+            while (numPrinted.load() != maxNumMessages / 2)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            thread.Stop();
+        }
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    }
+}
+
+TEST_CASE("PriorityLogger and MetricsReporter wake the LogProcessingThread early too")
+{
+    constexpr auto maxNumMessages = 16;
+    auto LogUntilPrinted = [](auto& logger, std::atomic<int>& numPrinted, ExampleLogLevel level) {
+        for (int i = 0; i < maxNumMessages / 2; i++)
+        {
+            CHECK(logger.Log({level, ExampleLogRegion::Engine}, "%d", i) == rtlog::Status::Success);
+        }
+        while (numPrinted.load() != maxNumMessages / 2)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    SUBCASE("A PriorityLogger wakes it once the queue of any priority fills up")
+    {
+        rtlog::PriorityLogger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber, 2> logger(rtlog::DrainOrder::HighestPriorityFirst, {static_cast<int>(ExampleLogLevel::Critical)});
+        logger.EnableEarlyWake(0.5f);
+
+        for (const auto level : {ExampleLogLevel::Debug, ExampleLogLevel::Critical})
+        {
+            std::atomic<int> numPrinted{0};
+            auto CountMessage = [&numPrinted](const rtlog::LogRecord<ExampleLogData>&) { numPrinted++; };
+
+            const auto start = std::chrono::steady_clock::now();
+            {
+                // Far longer than the test is allowed to take
+                rtlog::LogProcessingThread thread(logger, CountMessage, std::chrono::milliseconds(60 * 1000));
+                LogUntilPrinted(logger, numPrinted, level);
+                thread.Stop();
+            }
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+        }
+    }
+
+    SUBCASE("A MetricsReporter passes the wake on from its logger")
+    {
+        rtlog::Logger<ExampleLogData, maxNumMessages, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+        logger.EnableEarlyWake(0.5f);
+        rtlog::MetricsRegistry<4> metrics;
+        rtlog::MetricsReporter reporter(logger, metrics, std::chrono::milliseconds(1000), ExampleLogData{ExampleLogLevel::Info, ExampleLogRegion::Audio}, gSequenceNumber);
+
+        std::atomic<int> numPrinted{0};
+        auto CountMessage = [&numPrinted](const rtlog::LogRecord<ExampleLogData>&) { numPrinted++; };
+
+        const auto start = std::chrono::steady_clock::now();
+        {
+            rtlog::LogProcessingThread thread(reporter, CountMessage, std::chrono::milliseconds(60 * 1000));
+            LogUntilPrinted(logger, numPrinted, ExampleLogLevel::Debug);
+            thread.Stop();
+        }
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    }
+}
+
+TEST_CASE("Adaptive poll interval follows the arrival rate")
+{
+    using namespace std::chrono_literals;
+
+    SUBCASE("AdaptivePollScheduler")
+    {
+        rtlog::AdaptivePollScheduler scheduler({1ms, 100ms, 0.5f}, 1000);
+
+        // Idle: wait as long as allowed
+        CHECK(scheduler.Next(0, 100ms) == 100ms);
+
+        // 500 messages in 100ms fill half the queue in 100ms
+        CHECK(scheduler.Next(500, 100ms) == 100ms);
+
+        // A burst shortens the very next wait, down to the minimum
+        CHECK(scheduler.Next(1000, 20ms) == 10ms);
+        CHECK(scheduler.Next(1000, 1ms) == 1ms);
+
+        // The rate comes down gradually afterwards
+        CHECK(scheduler.Next(0, 1ms) < 100ms);
+        auto wait = 1ms;
+        for (int i = 0; i < 100 && wait < 100ms; i++)
+        {
+            wait = scheduler.Next(0, wait);
+        }
+        CHECK(wait == 100ms);
+    }
+
+    SUBCASE("LogProcessingThread")
+    {
+        rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+
+        std::atomic<int> numPrinted{0};
+        auto CountMessage = [&numPrinted](const rtlog::LogRecord<ExampleLogData>&) { numPrinted++; };
+
+        rtlog::LogProcessingThread thread(logger, CountMessage, rtlog::AdaptivePollInterval{1ms, 50ms, 0.25f});
+        CHECK(thread.WaitTime() == 50ms);
+
+        // A burst fills the queue faster than it is processed, so the wait shrinks
+        auto shortestWait = thread.WaitTime();
+        for (int i = 0; i < 400; i++)
+        {
+            while (logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, "%d", i) == rtlog::Status::Error_QueueFull)
+            {
+                shortestWait = std::min(shortestWait, thread.WaitTime());
+                std::this_thread::sleep_for(1ms);
+            }
+        }
+        while (numPrinted.load() != 400)
+        {
+            shortestWait = std::min(shortestWait, thread.WaitTime());
+            std::this_thread::sleep_for(1ms);
+        }
+        CHECK(shortestWait < 25ms);
+
+        // Idle, it grows back to the maximum
+        const auto idleSince = std::chrono::steady_clock::now();
+        while (thread.WaitTime() < 50ms && std::chrono::steady_clock::now() - idleSince < 10s)
+        {
+            std::this_thread::sleep_for(5ms);
+        }
+        CHECK(thread.WaitTime() == 50ms);
+        thread.Stop();
+    }
+}
+
 #ifdef RTLOG_USE_FMTLIB
 
 TEST_CASE("Formatlib version works as intended")
@@ -0,0 +1,438 @@
+#include <doctest/doctest.h>
+#include <rtlog/BinaryLog.h>
+#include <rtlog/BinaryLogReader.h>
+#include <rtlog/SharedLogCollector.h>
+#include <rtlog/SharedLogRing.h>
+#include <rtlog/SharedLogTail.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace rtlog::test
+{
+
+enum class ExampleLogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Critical
+};
+
+enum class ExampleLogRegion
+{
+    Engine,
+    Game,
+    Network,
+    Audio
+};
+
+struct ExampleLogData
+{
+    ExampleLogLevel level;
+    ExampleLogRegion region;
+};
+
+constexpr size_t kRingBytes = 64 * 1024;
+constexpr size_t kMaxMessageLength = 128;
+
+using ExampleSharedLogger = rtlog::SharedLogger<ExampleLogData, kRingBytes, kMaxMessageLength>;
+using ExampleCollector = rtlog::SharedLogCollector<kRingBytes, kMaxMessageLength>;
+using ExampleTail = rtlog::SharedLogTail<kRingBytes, kMaxMessageLength>;
+
+// A directory that is removed, with everything in it, at the end of the test
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory()
+    {
+        char path[] = "/tmp/rtlog_test_XXXXXX";
+        mPath = mkdtemp(path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        const auto command = "rm -rf " + mPath;
+        std::system(command.c_str());
+    }
+
+    const std::string& Path() const
+    {
+        return mPath;
+    }
+
+private:
+    std::string mPath;
+};
+
+struct CollectedRecord
+{
+    std::string mProcessName;
+    std::uint32_t mProcessId{};
+    std::int64_t mTimestamp{};
+    size_t mSequenceNumber{};
+    int mLevel{};
+    int mRegion{};
+    std::string mMessage;
+};
+
+struct CollectingSink
+{
+    void operator()(const rtlog::LogRecord<rtlog::SharedLogData>& record)
+    {
+        mRecords.push_back({record.mLogData.processName,
+                            record.mLogData.processId,
+                            record.mLogData.timestamp,
+                            record.mSequenceNumber,
+                            record.mLogData.level,
+                            record.mLogData.region,
+                            std::string(record.mMessage, record.mMessageLength)});
+    }
+
+    std::vector<CollectedRecord> mRecords;
+};
+
+} // namespace rtlog::test
+
+using namespace rtlog::test;
+
+TEST_CASE("SharedLogCollector merges the rings of several loggers in time order")
+{
+    TemporaryDirectory directory;
+    ExampleCollector collector(directory.Path());
+    CHECK(collector.Rescan() == 0);
+
+    ExampleSharedLogger audio(directory.Path(), "audio");
+    ExampleSharedLogger video(directory.Path(), "video");
+    REQUIRE(audio.IsOpen());
+    REQUIRE(video.IsOpen());
+
+    for (int i = 0; i < 100; i++)
+    {
+        auto& logger = i % 3 == 0 ? video : audio;
+        CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Audio}, "message %d", i) == rtlog::Status::Success);
+    }
+    CHECK(collector.Rescan() == 2);
+
+    CollectingSink sink;
+    CHECK(collector.Drain(sink, true) == 100);
+    REQUIRE(sink.mRecords.size() == 100);
+    for (int i = 0; i < 100; i++)
+    {
+        const auto& record = sink.mRecords[i];
+        CHECK(record.mMessage == "message " + std::to_string(i));
+        CHECK(record.mProcessName == (i % 3 == 0 ? "video" : "audio"));
+        CHECK(record.mProcessId == static_cast<std::uint32_t>(::getpid()));
+        CHECK(record.mSequenceNumber == static_cast<size_t>(i + 1));
+        CHECK(record.mLevel == 2);
+        CHECK(record.mRegion == 3);
+        if (i > 0)
+        {
+            CHECK(record.mTimestamp >= sink.mRecords[i - 1].mTimestamp);
+        }
+    }
+}
+
+TEST_CASE("SharedLogCollector holds records back for the merge delay")
+{
+    TemporaryDirectory directory;
+    ExampleSharedLogger logger(directory.Path(), "app");
+    CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "recent") == rtlog::Status::Success);
+
+    rtlog::SharedLogCollectorOptions options;
+    options.mMergeDelay = std::chrono::hours(1);
+    ExampleCollector collector(directory.Path(), options);
+    CHECK(collector.Rescan() == 1);
+
+    CollectingSink sink;
+    CHECK(collector.Drain(sink) == 0);
+    CHECK(collector.Drain(sink, true) == 1);
+}
+
+TEST_CASE("SharedLogCollector removes rings once their logger is gone and they are drained")
+{
+    TemporaryDirectory directory;
+    ExampleCollector collector(directory.Path());
+    CollectingSink sink;
+    std::string path;
+    {
+        ExampleSharedLogger logger(directory.Path(), "short-lived");
+        path = logger.Path();
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "last words") == rtlog::Status::Success);
+        CHECK(collector.Rescan() == 1);
+    }
+
+    // Not drained yet
+    CHECK(collector.Rescan() == 1);
+    CHECK(::access(path.c_str(), F_OK) == 0);
+
+    CHECK(collector.Drain(sink, true) == 1);
+    CHECK(collector.Rescan() == 0);
+    CHECK(::access(path.c_str(), F_OK) != 0);
+    REQUIRE(sink.mRecords.size() == 1);
+    CHECK(sink.mRecords[0].mMessage == "last words");
+}
+
+TEST_CASE("SharedLogCollector drains rings of other processes")
+{
+    TemporaryDirectory directory;
+    ExampleCollector collector(directory.Path());
+
+    const pid_t child = ::fork();
+    REQUIRE(child >= 0);
+    if (child == 0)
+    {
+        int exitCode = 0;
+        {
+            ExampleSharedLogger logger(directory.Path(), "child");
+            for (int i = 0; i < 10; i++)
+            {
+                exitCode |= logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Network}, "from the child %d", i)
+                            != rtlog::Status::Success;
+            }
+        }
+        ::_exit(exitCode);
+    }
+    int status = 0;
+    REQUIRE(::waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+
+    CHECK(collector.Rescan() == 1);
+    CollectingSink sink;
+    CHECK(collector.Drain(sink, true) == 10);
+    REQUIRE(sink.mRecords.size() == 10);
+    CHECK(sink.mRecords[0].mProcessId == static_cast<std::uint32_t>(child));
+    CHECK(sink.mRecords[9].mMessage == "from the child 9");
+    CHECK(collector.Rescan() == 0);
+}
+
+TEST_CASE("SharedLogCollector ignores rings of other sizes")
+{
+    TemporaryDirectory directory;
+    rtlog::SharedLogger<ExampleLogData, kRingBytes * 2, kMaxMessageLength> logger(directory.Path(), "bigger");
+    REQUIRE(logger.IsOpen());
+    ExampleCollector collector(directory.Path());
+    CHECK(collector.Rescan() == 0);
+}
+
+TEST_CASE("SharedLogCollector detaches rings with forged records")
+{
+    // Overwrites the commit word of the only record in the ring at path, found by its value
+    auto Forge = [](const std::string& path, std::uint64_t commitWord, std::uint64_t forgedWord) {
+        const int fd = ::open(path.c_str(), O_RDWR);
+        REQUIRE(fd >= 0);
+        struct stat status{};
+        REQUIRE(::fstat(fd, &status) == 0);
+        void* mapping = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        REQUIRE(mapping != MAP_FAILED);
+
+        auto* words = static_cast<std::uint64_t*>(mapping);
+        int numForged = 0;
+        for (size_t i = sizeof(rtlog::SharedLogRingHeader) / sizeof(std::uint64_t); i < static_cast<size_t>(status.st_size) / sizeof(std::uint64_t); i++)
+        {
+            if (words[i] == commitWord)
+            {
+                words[i] = forgedWord;
+                numForged++;
+            }
+        }
+        ::munmap(mapping, static_cast<size_t>(status.st_size));
+        CHECK(numForged == 1);
+    };
+
+    const std::string message = "forged";
+    const std::uint64_t recordBytes = sizeof(rtlog::SharedLogRecordHeader) + message.size();
+    const std::uint64_t commitWord = (recordBytes << 32) | ((8 + recordBytes + 7) & ~std::uint64_t{ 7 });
+
+    const std::uint64_t forgedWords[] = {
+        (std::uint64_t{ 1 } << 40) | 16,  // far longer than any record
+        recordBytes << 32,                // no space for the record at all
+        std::uint64_t{ 8 },               // shorter than a record header
+    };
+    for (const auto forgedWord : forgedWords)
+    {
+        TemporaryDirectory directory;
+        ExampleSharedLogger good(directory.Path(), "good");
+        ExampleSharedLogger forged(directory.Path(), "forged");
+        REQUIRE(good.IsOpen());
+        REQUIRE(forged.IsOpen());
+        CHECK(good.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "fine") == rtlog::Status::Success);
+        CHECK(forged.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "%s", message.c_str()) == rtlog::Status::Success);
+        Forge(forged.Path(), commitWord, forgedWord);
+
+        ExampleCollector collector(directory.Path());
+        CHECK(collector.Rescan() == 2);
+
+        CollectingSink sink;
+        CHECK(collector.Drain(sink, true) == 1);
+        REQUIRE(sink.mRecords.size() == 1);
+        CHECK(sink.mRecords[0].mMessage == "fine");
+
+        // Detached, left in place, and not attached again
+        CHECK(collector.Rescan() == 1);
+        CHECK(collector.NumCorruptRings() == 1);
+        CHECK(::access(forged.Path().c_str(), F_OK) == 0);
+        CHECK(collector.Rescan() == 1);
+
+        CHECK(good.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "still fine") == rtlog::Status::Success);
+        CHECK(collector.Drain(sink, true) == 1);
+    }
+}
+
+TEST_CASE("SharedLogCollector writes merged records to a binary log")
+{
+    TemporaryDirectory directory;
+    ExampleSharedLogger logger(directory.Path(), "app");
+    for (int i = 0; i < 20; i++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Engine}, "binary %d", i) == rtlog::Status::Success);
+    }
+
+    const auto basePath = directory.Path() + "/merged";
+    {
+        rtlog::BinaryLogSink<rtlog::SharedLogData> sink(basePath);
+        ExampleCollector collector(directory.Path());
+        CHECK(collector.Rescan() == 1);
+        CHECK(collector.Drain(sink, true) == 20);
+    }
+
+    rtlog::BinaryLogReader reader(basePath + ".000000.rtlog");
+    REQUIRE(reader.IsOpen());
+    int numRead = 0;
+    reader.ReadAll([&](const rtlog::BinaryLogRecordView& record) {
+        rtlog::SharedLogData data;
+        CHECK(rtlog::UnpackLogData(record, data));
+        CHECK(std::string(data.processName) == "app");
+        CHECK(data.processId == static_cast<std::uint32_t>(::getpid()));
+        CHECK(data.timestamp > 0);
+        CHECK(record.mLevel == 3);
+        CHECK(std::string(record.mMessage, record.mMessageLength) == "binary " + std::to_string(numRead));
+        numRead++;
+        return true;
+    });
+    CHECK(numRead == 20);
+}
+
+TEST_CASE("SharedLogTail copies the newest records without draining them")
+{
+    TemporaryDirectory directory;
+    ExampleSharedLogger logger(directory.Path(), "app");
+    for (int i = 0; i < 50; i++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Network}, "message %d", i) == rtlog::Status::Success);
+    }
+
+    ExampleTail tail(logger.Path());
+    REQUIRE(tail.IsOpen());
+    CHECK(std::string(tail.ProcessName()) == "app");
+    CHECK(tail.ProcessId() == static_cast<std::uint32_t>(::getpid()));
+    CHECK(!tail.IsClosed());
+
+    CollectingSink newest;
+    CHECK(tail.Snapshot(newest, 10) == 10);
+    REQUIRE(newest.mRecords.size() == 10);
+    CHECK(newest.mRecords[0].mMessage == "message 40");
+    CHECK(newest.mRecords[0].mSequenceNumber == 41);
+    CHECK(newest.mRecords[9].mMessage == "message 49");
+    CHECK(newest.mRecords[9].mLevel == 2);
+    CHECK(newest.mRecords[9].mRegion == 2);
+    CHECK(newest.mRecords[9].mProcessName == "app");
+
+    CollectingSink all;
+    CHECK(tail.Snapshot(all, 1000) == 50);
+
+    // The collector still gets every record
+    ExampleCollector collector(directory.Path());
+    CHECK(collector.Rescan() == 1);
+    CollectingSink drained;
+    CHECK(collector.Drain(drained, true) == 50);
+    CHECK(tail.Snapshot(all, 1000) == 0);
+}
+
+TEST_CASE("SharedLogTail snapshots are consistent while producers write and the collector drains")
+{
+    TemporaryDirectory directory;
+    ExampleSharedLogger logger(directory.Path(), "busy");
+    ExampleCollector collector(directory.Path());
+    REQUIRE(collector.Rescan() == 1);
+    ExampleTail tail(logger.Path());
+    REQUIRE(tail.IsOpen());
+
+    // Each message can be checked on its own: "t<thread> n<i> " followed by i % 64 copies of one letter
+    const auto makeMessage = [](int thread, int i) {
+        char prefix[32];
+        std::snprintf(prefix, sizeof(prefix), "t%d n%d ", thread, i);
+        return std::string(prefix) + std::string(static_cast<size_t>(i % 64), static_cast<char>('a' + i % 26));
+    };
+
+    std::atomic<bool> running{true};
+    std::atomic<int> numLogged{0};
+    std::vector<std::thread> producers;
+    for (int thread = 0; thread < 2; thread++)
+    {
+        producers.emplace_back([&, thread] {
+            for (int i = 0; running; i++)
+            {
+                const auto message = makeMessage(thread, i);
+                if (logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "%s", message.c_str()) == rtlog::Status::Success)
+                {
+                    numLogged++;
+                }
+            }
+        });
+    }
+
+    std::atomic<int> numDrained{0};
+    std::thread consumer([&] {
+        CollectingSink sink;
+        while (running)
+        {
+            numDrained += collector.Drain(sink, true);
+            sink.mRecords.clear();
+        }
+    });
+
+    int numSnapshotted = 0;
+    int numInconsistent = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        CollectingSink sink;
+        tail.Snapshot(sink, 1000); // the whole ring, up to the records being drained
+        for (const auto& record : sink.mRecords)
+        {
+            int thread = -1;
+            int i = -1;
+            const bool parsed = std::sscanf(record.mMessage.c_str(), "t%d n%d ", &thread, &i) == 2;
+            numInconsistent += parsed && record.mMessage == makeMessage(thread, i) ? 0 : 1;
+        }
+        numSnapshotted += static_cast<int>(sink.mRecords.size());
+    }
+
+    running = false;
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    consumer.join();
+    CollectingSink sink;
+    numDrained += collector.Drain(sink, true);
+
+    CHECK(numInconsistent == 0);
+    CHECK(numSnapshotted > 0);
+    CHECK(numDrained == numLogged);
+}
@@ -0,0 +1,886 @@
+#include <doctest/doctest.h>
+#include <rtlog/BinaryLog.h>
+#include <rtlog/ConsoleSink.h>
+#include <rtlog/JournalSink.h>
+#include <rtlog/Logger.h>
+#include <rtlog/NetworkLogListener.h>
+#include <rtlog/NetworkSink.h>
+#include <rtlog/PipeSink.h>
+#include <rtlog/TextLineFormat.h>
+#include <rtlog/TimestampFormatter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace rtlog::test
+{
+
+std::atomic<std::size_t> gSequenceNumber{ 0 };
+
+constexpr auto MAX_LOG_MESSAGE_LENGTH = 256;
+constexpr auto MAX_NUM_LOG_MESSAGES = 100;
+
+enum class ExampleLogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Critical
+};
+
+enum class ExampleLogRegion
+{
+    Engine,
+    Game,
+    Network,
+    Audio
+};
+
+struct ExampleLogData
+{
+    ExampleLogLevel level;
+    ExampleLogRegion region;
+};
+
+using ExampleLogger = rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber>;
+
+// Reads a file descriptor until EOF on a thread of its own
+class FdReader
+{
+public:
+    explicit FdReader(int fd)
+        : mThread([this, fd] {
+              char buffer[4096];
+              for (ssize_t n = ::read(fd, buffer, sizeof(buffer)); n > 0; n = ::read(fd, buffer, sizeof(buffer)))
+              {
+                  mContents.append(buffer, static_cast<size_t>(n));
+              }
+          })
+    {
+    }
+
+    std::string Join()
+    {
+        mThread.join();
+        return std::move(mContents);
+    }
+
+private:
+    std::string mContents;
+    std::thread mThread;
+};
+
+std::vector<std::string> SplitLines(const std::string& text)
+{
+    std::vector<std::string> lines;
+    size_t begin = 0;
+    for (auto end = text.find('\n'); end != std::string::npos; end = text.find('\n', begin))
+    {
+        lines.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return lines;
+}
+
+// Counts the lines that don't end in " message <i>", for i counting up from 0
+int NumLinesOutOfPlace(const std::vector<std::string>& lines)
+{
+    int numOutOfPlace = 0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        const auto suffix = " message " + std::to_string(i);
+        const bool inPlace = lines[i].size() >= suffix.size()
+            && lines[i].compare(lines[i].size() - suffix.size(), suffix.size(), suffix) == 0;
+        numOutOfPlace += inPlace ? 0 : 1;
+    }
+    return numOutOfPlace;
+}
+
+// Flushes until everything is sent, as a LogProcessingThread would, giving up after a while
+bool FlushUntilSent(rtlog::NetworkSink<ExampleLogData>& sink)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!sink.Flush())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+struct DeviceLogData
+{
+    ExampleLogLevel level;
+    ExampleLogRegion region;
+    const char* device;
+    int channel;
+};
+
+// Stands in for journald: a datagram socket bound to a path of its own
+class JournalStandIn
+{
+public:
+    explicit JournalStandIn(std::string path)
+        : mPath(std::move(path))
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        mPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+        ::unlink(mPath.c_str());
+        mFd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (mFd >= 0 && ::bind(mFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            ::close(mFd);
+            mFd = -1;
+        }
+    }
+
+    ~JournalStandIn()
+    {
+        if (mFd >= 0)
+        {
+            ::close(mFd);
+        }
+        ::unlink(mPath.c_str());
+    }
+
+    bool IsOpen() const
+    {
+        return mFd >= 0;
+    }
+
+    // Returns the datagrams received so far, waiting for at least numDatagrams of them for a few seconds. Entries
+    // passed as a memfd are read from it, if it is sealed as journald requires.
+    std::vector<std::string> Receive(size_t numDatagrams = 0)
+    {
+        std::vector<std::string> datagrams;
+        char buffer[64 * 1024];
+        while (true)
+        {
+            iovec data{buffer, sizeof(buffer)};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+            msghdr message{};
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            const auto n = ::recvmsg(mFd, &message, MSG_DONTWAIT);
+            const auto* header = n >= 0 ? CMSG_FIRSTHDR(&message) : nullptr;
+            if (header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+            {
+                int memfd = -1;
+                std::memcpy(&memfd, CMSG_DATA(header), sizeof(memfd));
+                const int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+                if ((::fcntl(memfd, F_GET_SEALS) & seals) == seals)
+                {
+                    std::string entry;
+                    off_t offset = 0;
+                    for (auto m = ::pread(memfd, buffer, sizeof(buffer), offset); m > 0; m = ::pread(memfd, buffer, sizeof(buffer), offset))
+                    {
+                        entry.append(buffer, static_cast<size_t>(m));
+                        offset += m;
+                    }
+                    datagrams.push_back(std::move(entry));
+                }
+                ::close(memfd);
+                continue;
+            }
+            if (n >= 0)
+            {
+                datagrams.emplace_back(buffer, static_cast<size_t>(n));
+                continue;
+            }
+            pollfd fd{mFd, POLLIN, 0};
+            if (datagrams.size() >= numDatagrams || ::poll(&fd, 1, 5000) <= 0)
+            {
+                return datagrams;
+            }
+        }
+    }
+
+private:
+    std::string mPath;
+    int mFd = -1;
+};
+
+// Reads the fields of a journal entry in the native protocol, both "NAME=value\n" and the binary form
+std::map<std::string, std::string> ParseJournalEntry(const std::string& datagram)
+{
+    std::map<std::string, std::string> fields;
+    size_t position = 0;
+    while (position < datagram.size())
+    {
+        const auto nameEnd = datagram.find_first_of("=\n", position);
+        if (nameEnd == std::string::npos)
+        {
+            return {};
+        }
+        const auto name = datagram.substr(position, nameEnd - position);
+        if (datagram[nameEnd] == '=')
+        {
+            const auto valueEnd = datagram.find('\n', nameEnd);
+            fields[name] = datagram.substr(nameEnd + 1, valueEnd - nameEnd - 1);
+            position = valueEnd + 1;
+        }
+        else
+        {
+            std::uint64_t length = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                length |= std::uint64_t{static_cast<unsigned char>(datagram[nameEnd + 1 + i])} << (8 * i);
+            }
+            fields[name] = datagram.substr(nameEnd + 9, length);
+            position = nameEnd + 9 + length + 1;
+        }
+    }
+    return fields;
+}
+
+} // namespace rtlog::test
+
+template <>
+struct rtlog::LogDataTraits<rtlog::test::DeviceLogData>
+{
+    static int Level(const rtlog::test::DeviceLogData& data) { return static_cast<int>(data.level); }
+    static int Region(const rtlog::test::DeviceLogData& data) { return static_cast<int>(data.region); }
+
+    static void JournalFields(const rtlog::test::DeviceLogData& data, rtlog::JournalFieldWriter& fields)
+    {
+        fields.Add("AUDIO_DEVICE", data.device);
+        fields.Add("AUDIO_CHANNEL", data.channel);
+    }
+};
+
+using namespace rtlog::test;
+
+TEST_CASE("FormatTextLine")
+{
+    ExampleLogData data{ExampleLogLevel::Warning, ExampleLogRegion::Audio};
+    const char message[] = "buffer underrun";
+    rtlog::LogRecord<ExampleLogData> record{data, 42, message, sizeof(message) - 1, 7};
+
+    char line[rtlog::kMaxTextLineOverhead + 8];
+    auto length = rtlog::FormatTextLine(record, line, sizeof(line));
+    CHECK(std::string(line, length) == "42 L2 R3 T7 buffer underrun\n");
+
+    length = rtlog::FormatTextLine(record, line, rtlog::kMaxTextLineOverhead - 1);
+    CHECK(length == 0);
+}
+
+TEST_CASE("PipeSink hands every line to the pipe in order")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    FdReader reader(fds[0]);
+
+    constexpr int kNumMessages = 20000; // several times around the ring
+    size_t numBytesWritten = 0;
+    {
+        rtlog::PipeSinkOptions options;
+        options.mPipeBytes = 16 * 1024;
+        rtlog::PipeSink<ExampleLogData> sink(fds[1], options);
+#if defined(__linux__)
+        CHECK(sink.UsesVmsplice());
+#endif
+
+        ExampleLogger logger;
+        for (int i = 0; i < kNumMessages; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "message %d", i) == rtlog::Status::Success);
+            if (i % MAX_NUM_LOG_MESSAGES == MAX_NUM_LOG_MESSAGES - 1)
+            {
+                logger.PrintAndClearLogQueue(sink);
+            }
+            if (i % 1000 == 0)
+            {
+                CHECK(sink.Flush());
+            }
+        }
+        logger.PrintAndClearLogQueue(sink);
+        CHECK(sink.Flush());
+        CHECK(sink.NumWriteErrors() == 0);
+        numBytesWritten = sink.NumBytesWritten();
+    }
+    ::close(fds[1]);
+
+    const auto contents = reader.Join();
+    CHECK(contents.size() == numBytesWritten);
+
+    const auto lines = SplitLines(contents);
+    REQUIRE(lines.size() == kNumMessages);
+    int numOutOfPlace = 0;
+    for (int i = 0; i < kNumMessages; i++)
+    {
+        const auto suffix = " message " + std::to_string(i);
+        const bool inPlace = lines[i].find(" L1 R1 T") != std::string::npos && lines[i].size() >= suffix.size()
+            && lines[i].compare(lines[i].size() - suffix.size(), suffix.size(), suffix) == 0;
+        numOutOfPlace += inPlace ? 0 : 1;
+    }
+    CHECK(numOutOfPlace == 0);
+    ::close(fds[0]);
+}
+
+TEST_CASE("PipeSink writes to file descriptors that aren't pipes")
+{
+    char path[] = "/tmp/rtlog_pipe_sink_XXXXXX";
+    const int fd = ::mkstemp(path);
+    REQUIRE(fd >= 0);
+    {
+        rtlog::PipeSink<ExampleLogData> sink(fd);
+        CHECK(!sink.UsesVmsplice());
+
+        ExampleLogger logger;
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Engine}, "to a file") == rtlog::Status::Success);
+        logger.PrintAndClearLogQueue(sink);
+        CHECK(sink.Flush());
+    }
+
+    std::string contents(256, '\0');
+    contents.resize(static_cast<size_t>(::pread(fd, contents.data(), contents.size(), 0)));
+    CHECK(contents.find(" L3 R0 T") != std::string::npos);
+    CHECK(contents.find(" to a file\n") != std::string::npos);
+    ::close(fd);
+    std::remove(path);
+}
+
+TEST_CASE("ConsoleSink writes a batch with one write")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    FdReader reader(fds[0]);
+    {
+        rtlog::ConsoleSinkOptions options;
+        options.mFd = fds[1];
+        rtlog::ConsoleSink<ExampleLogData> sink(options);
+        CHECK(!sink.UsesColor()); // not a terminal
+
+        ExampleLogger logger;
+        for (int i = 0; i < 50; i++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "line %d", i) == rtlog::Status::Success);
+        }
+        logger.PrintAndClearLogQueue(sink);
+        CHECK(sink.NumWrites() == 0);
+        CHECK(sink.Flush());
+        CHECK(sink.NumWrites() == 1);
+        CHECK(sink.NumWriteErrors() == 0);
+    }
+    ::close(fds[1]);
+
+    const auto lines = SplitLines(reader.Join());
+    REQUIRE(lines.size() == 50);
+    CHECK(lines[0].find(" L1 R0 T") != std::string::npos);
+    CHECK(lines[49].find(" line 49") == lines[49].size() - 8);
+    ::close(fds[0]);
+}
+
+TEST_CASE("ConsoleSink colours lines by level")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    FdReader reader(fds[0]);
+    {
+        rtlog::ConsoleSinkOptions options;
+        options.mFd = fds[1];
+        options.mColor = rtlog::ConsoleColor::Always;
+        rtlog::ConsoleSink<ExampleLogData> sink(options);
+        CHECK(sink.UsesColor());
+
+        ExampleLogger logger;
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "on fire") == rtlog::Status::Success);
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Audio}, "all good") == rtlog::Status::Success);
+        logger.PrintAndClearLogQueue(sink);
+    }
+    ::close(fds[1]);
+
+    const auto lines = SplitLines(reader.Join());
+    REQUIRE(lines.size() == 2);
+    CHECK(lines[0].rfind("\033[1;31m", 0) == 0);
+    CHECK(lines[0].find("on fire\033[0m") == lines[0].size() - 11);
+    CHECK(lines[1].find('\033') == std::string::npos); // Info has no colour
+    ::close(fds[0]);
+}
+
+TEST_CASE("TimestampFormatter")
+{
+    char out[rtlog::TimestampFormatter::kMaxBytes];
+    const auto format = [&](rtlog::TimestampFormatter& timestamps, std::int64_t nanoseconds) {
+        return std::string(out, timestamps.Format(nanoseconds, out));
+    };
+
+    SUBCASE("UTC")
+    {
+        rtlog::TimestampFormatter timestamps;
+        CHECK(format(timestamps, 0) == "1970-01-01T00:00:00.000000Z");
+        CHECK(format(timestamps, 1700000000123456789) == "2023-11-14T22:13:20.123456Z");
+        CHECK(format(timestamps, 1700000000999999999) == "2023-11-14T22:13:20.999999Z"); // same second, from the cache
+        CHECK(format(timestamps, 1700000001000000000) == "2023-11-14T22:13:21.000000Z");
+        CHECK(format(timestamps, -1) == "1969-12-31T23:59:59.999999Z");
+    }
+
+    SUBCASE("Fraction digits")
+    {
+        rtlog::TimestampFormatter nanoseconds(9);
+        CHECK(format(nanoseconds, 1700000000012345678) == "2023-11-14T22:13:20.012345678Z");
+        rtlog::TimestampFormatter milliseconds(3);
+        CHECK(format(milliseconds, 1700000000012345678) == "2023-11-14T22:13:20.012Z");
+        rtlog::TimestampFormatter seconds(0);
+        CHECK(format(seconds, 1700000000012345678) == "2023-11-14T22:13:20Z");
+    }
+
+    SUBCASE("Local time")
+    {
+        const char* previousZone = std::getenv("TZ");
+        const std::string savedZone = previousZone != nullptr ? previousZone : "";
+        ::setenv("TZ", "XYZ-5:30", 1);
+        ::tzset();
+
+        rtlog::TimestampFormatter timestamps(9, rtlog::TimestampZone::Local);
+        CHECK(format(timestamps, 1700000000012345678) == "2023-11-15T03:43:20.012345678+05:30");
+
+        if (previousZone != nullptr)
+        {
+            ::setenv("TZ", savedZone.c_str(), 1);
+        }
+        else
+        {
+            ::unsetenv("TZ");
+        }
+        ::tzset();
+    }
+}
+
+TEST_CASE("Text sinks can start lines with a timestamp")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    FdReader reader(fds[0]);
+    {
+        rtlog::ConsoleSinkOptions options;
+        options.mFd = fds[1];
+        options.mTimestamps = true;
+        rtlog::ConsoleSink<ExampleLogData> sink(options);
+
+        ExampleLogger logger;
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "stamped") == rtlog::Status::Success);
+        logger.PrintAndClearLogQueue(sink);
+    }
+    ::close(fds[1]);
+
+    const auto lines = SplitLines(reader.Join());
+    REQUIRE(lines.size() == 1);
+    // 2026-10-17T13:57:11.578084Z 1 L1 R1 T1 stamped
+    REQUIRE(lines[0].size() > 28);
+    CHECK(lines[0][10] == 'T');
+    CHECK(lines[0][19] == '.');
+    CHECK(lines[0][26] == 'Z');
+    CHECK(lines[0][27] == ' ');
+    CHECK(lines[0].find(" L1 R1 T") != std::string::npos);
+    ::close(fds[0]);
+}
+
+TEST_CASE("NetworkSink streams text lines over TCP")
+{
+    rtlog::NetworkLogListener listener;
+    REQUIRE(listener.IsListening());
+    REQUIRE(listener.Port() != 0);
+
+    constexpr int kNumMessages = 5000;
+    rtlog::NetworkSinkOptions options;
+    options.mPort = listener.Port();
+    options.mSendBytes = 4096;
+    rtlog::NetworkSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    for (int i = 0; i < kNumMessages; i++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Network}, "message %d", i) == rtlog::Status::Success);
+        if (i % MAX_NUM_LOG_MESSAGES == MAX_NUM_LOG_MESSAGES - 1)
+        {
+            logger.PrintAndClearLogQueue(sink);
+            sink.Flush();
+        }
+    }
+    CHECK(FlushUntilSent(sink));
+    CHECK(sink.IsConnected());
+    CHECK(sink.NumConnects() == 1);
+    CHECK(sink.NumDropped() == 0);
+    CHECK(sink.NumPendingBytes() == 0);
+
+    REQUIRE(listener.WaitForBytes(sink.NumBytesSent(), std::chrono::seconds(5)));
+    const auto lines = SplitLines(listener.Received());
+    REQUIRE(lines.size() == kNumMessages);
+    CHECK(lines[0].find(" L1 R2 T") != std::string::npos);
+    CHECK(NumLinesOutOfPlace(lines) == 0);
+}
+
+TEST_CASE("NetworkSink streams binary records over a Unix domain socket")
+{
+    const std::string path = "/tmp/rtlog_network_sink_" + std::to_string(::getpid());
+    rtlog::NetworkLogListener listener(path);
+    REQUIRE(listener.IsListening());
+
+    rtlog::NetworkSinkOptions options;
+    options.mUnixPath = path;
+    options.mFormat = rtlog::NetworkSinkFormat::Binary;
+    rtlog::NetworkSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio}, "message %d", i) == rtlog::Status::Success);
+    }
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(FlushUntilSent(sink));
+    REQUIRE(listener.WaitForBytes(sink.NumBytesSent(), std::chrono::seconds(5)));
+
+    const auto received = listener.Received();
+    const auto* in = reinterpret_cast<const unsigned char*>(received.data());
+    const auto* end = in + received.size();
+    int numRecords = 0;
+    int numMismatched = 0;
+    while (in != end)
+    {
+        rtlog::BinaryLogRecordHeader header;
+        in = rtlog::DecodeBinaryLogRecordHeader(in, end, rtlog::BinaryLogRecordHeader{}, header);
+        REQUIRE(in != nullptr);
+        REQUIRE(static_cast<size_t>(end - in) >= header.mLogDataBytes + header.mMessageLength);
+
+        ExampleLogData data{};
+        const bool unpacked = rtlog::detail::UnpackLogData(in, header.mLogDataBytes, data);
+        in += header.mLogDataBytes;
+        const std::string message(reinterpret_cast<const char*>(in), header.mMessageLength);
+        in += header.mMessageLength;
+
+        const bool matches = unpacked && data.level == ExampleLogLevel::Critical && header.mLevel == 3
+            && header.mRegion == 3 && header.mThreadId != 0 && header.mTimestamp > 0
+            && message == "message " + std::to_string(numRecords);
+        numMismatched += matches ? 0 : 1;
+        numRecords++;
+    }
+    CHECK(numRecords == 10);
+    CHECK(numMismatched == 0);
+}
+
+TEST_CASE("NetworkSink keeps records while it can't connect")
+{
+    const std::string path = "/tmp/rtlog_network_sink_late_" + std::to_string(::getpid());
+    ::unlink(path.c_str());
+
+    rtlog::NetworkSinkOptions options;
+    options.mUnixPath = path;
+    options.mSpillBytes = 16 * 1024;
+    options.mMinReconnectDelay = std::chrono::milliseconds(1);
+    options.mMaxReconnectDelay = std::chrono::milliseconds(4);
+    rtlog::NetworkSink<ExampleLogData> sink(options);
+    CHECK(!sink.IsConnected());
+
+    ExampleLogger logger;
+    int numLogged = 0;
+    for (; numLogged < MAX_NUM_LOG_MESSAGES; numLogged++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "message %d", numLogged) == rtlog::Status::Success);
+    }
+    logger.PrintAndClearLogQueue(sink);
+
+    const auto flushStart = std::chrono::steady_clock::now();
+    CHECK(!sink.Flush());
+    CHECK(std::chrono::steady_clock::now() - flushStart < std::chrono::milliseconds(500));
+    CHECK(sink.NumPendingBytes() > 0);
+    CHECK(sink.NumDropped() == 0);
+
+    rtlog::NetworkLogListener listener(path);
+    REQUIRE(listener.IsListening());
+    CHECK(FlushUntilSent(sink));
+    CHECK(sink.IsConnected());
+    REQUIRE(listener.WaitForBytes(sink.NumBytesSent(), std::chrono::seconds(5)));
+
+    const auto lines = SplitLines(listener.Received());
+    CHECK(lines.size() == static_cast<size_t>(numLogged));
+    CHECK(NumLinesOutOfPlace(lines) == 0);
+}
+
+TEST_CASE("NetworkSink sends long messages whole")
+{
+    const std::string message(20000, 'x');
+    const rtlog::LogRecord<ExampleLogData> record{{ExampleLogLevel::Info, ExampleLogRegion::Game}, 1, message.data(), message.size(), 7};
+
+    for (const auto format : {rtlog::NetworkSinkFormat::Text, rtlog::NetworkSinkFormat::Binary})
+    {
+        const std::string path = "/tmp/rtlog_network_sink_long_" + std::to_string(::getpid());
+        rtlog::NetworkLogListener listener(path);
+        REQUIRE(listener.IsListening());
+
+        rtlog::NetworkSinkOptions options;
+        options.mUnixPath = path;
+        options.mFormat = format;
+        rtlog::NetworkSink<ExampleLogData> sink(options);
+        sink(record);
+        CHECK(FlushUntilSent(sink));
+        REQUIRE(listener.WaitForBytes(sink.NumBytesSent(), std::chrono::seconds(5)));
+
+        const auto received = listener.Received();
+        if (format == rtlog::NetworkSinkFormat::Text)
+        {
+            const auto lines = SplitLines(received);
+            REQUIRE(lines.size() == 1);
+            CHECK(static_cast<size_t>(std::count(lines[0].begin(), lines[0].end(), 'x')) == message.size());
+        }
+        else
+        {
+            const auto* in = reinterpret_cast<const unsigned char*>(received.data());
+            const auto* end = in + received.size();
+            rtlog::BinaryLogRecordHeader header;
+            in = rtlog::DecodeBinaryLogRecordHeader(in, end, rtlog::BinaryLogRecordHeader{}, header);
+            REQUIRE(in != nullptr);
+            CHECK(header.mMessageLength == message.size());
+            CHECK(static_cast<size_t>(end - in) == header.mLogDataBytes + message.size());
+        }
+    }
+}
+
+TEST_CASE("NetworkSink drops records once its spill buffer is full")
+{
+    rtlog::NetworkSinkOptions options;
+    options.mUnixPath = "/tmp/rtlog_network_sink_nobody_" + std::to_string(::getpid());
+    options.mSpillBytes = 16 * 1024;
+    rtlog::NetworkSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    while (sink.NumDropped() == 0)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "dropped") == rtlog::Status::Success);
+        logger.PrintAndClearLogQueue(sink);
+    }
+    CHECK(sink.NumPendingBytes() <= options.mSpillBytes);
+    CHECK(sink.NumPendingBytes() > options.mSpillBytes - 64);
+    CHECK(sink.NumBytesSent() == 0);
+}
+
+TEST_CASE("NetworkSink connects again when the peer drops the connection")
+{
+    rtlog::NetworkLogListener listener;
+    REQUIRE(listener.IsListening());
+
+    rtlog::NetworkSinkOptions options;
+    options.mPort = listener.Port();
+    options.mMinReconnectDelay = std::chrono::milliseconds(1);
+    options.mMaxReconnectDelay = std::chrono::milliseconds(4);
+    rtlog::NetworkSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    int numLogged = 0;
+    for (int batch = 0; batch < 3; batch++)
+    {
+        for (int i = 0; i < 10; i++, numLogged++)
+        {
+            CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "message %d", numLogged) == rtlog::Status::Success);
+        }
+        logger.PrintAndClearLogQueue(sink);
+        CHECK(FlushUntilSent(sink));
+        REQUIRE(listener.WaitForBytes(sink.NumBytesSent(), std::chrono::seconds(5)));
+        listener.DropConnections();
+    }
+
+    CHECK(sink.NumConnects() == 3);
+    CHECK(listener.NumAccepted() == 3);
+    const auto lines = SplitLines(listener.Received());
+    CHECK(lines.size() == static_cast<size_t>(numLogged));
+    CHECK(NumLinesOutOfPlace(lines) == 0);
+}
+
+TEST_CASE("JournalSink sends structured entries in the native protocol")
+{
+    const std::string path = "/tmp/rtlog_journal_" + std::to_string(::getpid());
+    JournalStandIn journal(path);
+    REQUIRE(journal.IsOpen());
+
+    rtlog::JournalSinkOptions options;
+    options.mSocketPath = path;
+    options.mIdentifier = "rtlog-test";
+    rtlog::JournalSink<DeviceLogData> sink(options);
+
+    rtlog::Logger<DeviceLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH, gSequenceNumber> logger;
+    const auto firstSequenceNumber = gSequenceNumber.load() + 1;
+    CHECK(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio, "hw:0", 3}, "xrun of %d frames", 64) == rtlog::Status::Success);
+    CHECK(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Audio, "hw:1", 0}, "two\nlines") == rtlog::Status::Success);
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(journal.Receive().empty()); // not before the flush
+    CHECK(sink.Flush());
+    CHECK(sink.NumSent() == 2);
+    CHECK(sink.NumSendCalls() == 1);
+
+    const auto datagrams = journal.Receive();
+    REQUIRE(datagrams.size() == 2);
+    auto fields = ParseJournalEntry(datagrams[0]);
+    CHECK(fields["MESSAGE"] == "xrun of 64 frames");
+    CHECK(fields["PRIORITY"] == "2");
+    CHECK(fields["SYSLOG_IDENTIFIER"] == "rtlog-test");
+    CHECK(fields["RTLOG_LEVEL"] == "3");
+    CHECK(fields["RTLOG_REGION"] == "3");
+    CHECK(fields["RTLOG_SEQUENCE_NUMBER"] == std::to_string(firstSequenceNumber));
+    CHECK(fields["RTLOG_THREAD"] == std::to_string(rtlog::CurrentThreadId()));
+    CHECK(fields["AUDIO_DEVICE"] == "hw:0");
+    CHECK(fields["AUDIO_CHANNEL"] == "3");
+
+    fields = ParseJournalEntry(datagrams[1]);
+    CHECK(fields["MESSAGE"] == "two\nlines");
+    CHECK(fields["PRIORITY"] == "7");
+    CHECK(fields["AUDIO_DEVICE"] == "hw:1");
+}
+
+TEST_CASE("JournalSink sends a batch of entries with one sendmmsg")
+{
+    const std::string path = "/tmp/rtlog_journal_batch_" + std::to_string(::getpid());
+    JournalStandIn journal(path);
+    REQUIRE(journal.IsOpen());
+
+    rtlog::JournalSinkOptions options;
+    options.mSocketPath = path;
+    options.mBatchSize = 8; // fewer than the datagrams a socket queues by default (net.unix.max_dgram_qlen)
+    options.mTimeBudget = std::chrono::seconds(5);
+    rtlog::JournalSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    int numLogged = 0;
+    for (; numLogged < 8; numLogged++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "message %d", numLogged) == rtlog::Status::Success);
+    }
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(sink.NumSendCalls() == 1);
+    auto datagrams = journal.Receive(8);
+    CHECK(datagrams.size() == 8);
+
+    // More than the socket queues, so the sink waits for the reader
+    std::vector<std::string> moreDatagrams;
+    std::thread reader([&] { moreDatagrams = journal.Receive(MAX_NUM_LOG_MESSAGES); });
+    for (int i = 0; i < MAX_NUM_LOG_MESSAGES; i++, numLogged++)
+    {
+        CHECK(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Engine}, "message %d", numLogged) == rtlog::Status::Success);
+    }
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(sink.Flush());
+    reader.join();
+    datagrams.insert(datagrams.end(), moreDatagrams.begin(), moreDatagrams.end());
+
+    CHECK(sink.NumSent() == static_cast<size_t>(numLogged));
+    CHECK(sink.NumDropped() == 0);
+    REQUIRE(datagrams.size() == static_cast<size_t>(numLogged));
+    int numOutOfPlace = 0;
+    for (size_t i = 0; i < datagrams.size(); i++)
+    {
+        auto fields = ParseJournalEntry(datagrams[i]);
+        numOutOfPlace += fields["MESSAGE"] == "message " + std::to_string(i) && fields["PRIORITY"] == "6" ? 0 : 1;
+    }
+    CHECK(numOutOfPlace == 0);
+}
+
+TEST_CASE("JournalSink drops entries while journald is away, and connects once it is back")
+{
+    const std::string path = "/tmp/rtlog_journal_restart_" + std::to_string(::getpid());
+    ::unlink(path.c_str());
+
+    rtlog::JournalSinkOptions options;
+    options.mSocketPath = path;
+    rtlog::JournalSink<ExampleLogData> sink(options);
+
+    ExampleLogger logger;
+    CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "lost") == rtlog::Status::Success);
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(!sink.Flush());
+    CHECK(sink.NumDropped() == 1);
+
+    {
+        JournalStandIn journal(path);
+        REQUIRE(journal.IsOpen());
+        CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "found") == rtlog::Status::Success);
+        logger.PrintAndClearLogQueue(sink);
+        CHECK(sink.Flush());
+        const auto datagrams = journal.Receive();
+        REQUIRE(datagrams.size() == 1);
+        CHECK(ParseJournalEntry(datagrams[0])["MESSAGE"] == "found");
+    }
+
+    // Restarted: a new socket at the same path
+    JournalStandIn journal(path);
+    REQUIRE(journal.IsOpen());
+    CHECK(logger.Log({ExampleLogLevel::Warning, ExampleLogRegion::Engine}, "found again") == rtlog::Status::Success);
+    logger.PrintAndClearLogQueue(sink);
+    CHECK(sink.Flush());
+    const auto datagrams = journal.Receive();
+    REQUIRE(datagrams.size() == 1);
+    CHECK(ParseJournalEntry(datagrams[0])["MESSAGE"] == "found again");
+    CHECK(sink.NumDropped() == 1);
+}
+
+TEST_CASE("JournalSink hands entries too large for a datagram over in a sealed memfd")
+{
+    const std::string path = "/tmp/rtlog_journal_large_" + std::to_string(::getpid());
+    JournalStandIn journal(path);
+    REQUIRE(journal.IsOpen());
+
+    rtlog::JournalSinkOptions options;
+    options.mSocketPath = path;
+    rtlog::JournalSink<ExampleLogData> sink(options);
+
+    const std::string large(4 * 1024 * 1024, 'x');
+    sink(rtlog::LogRecord<ExampleLogData>{{ExampleLogLevel::Info, ExampleLogRegion::Game}, 1, large.data(), large.size(), 7});
+    sink(rtlog::LogRecord<ExampleLogData>{{ExampleLogLevel::Info, ExampleLogRegion::Game}, 2, "small", 5, 7});
+    CHECK(sink.Flush());
+    CHECK(sink.NumSent() == 2);
+    CHECK(sink.NumDropped() == 0);
+
+    const auto datagrams = journal.Receive(2);
+    REQUIRE(datagrams.size() == 2);
+    CHECK(ParseJournalEntry(datagrams[0])["MESSAGE"] == large);
+    CHECK(ParseJournalEntry(datagrams[1])["MESSAGE"] == "small");
+}
+
+TEST_CASE("JournalSink makes its socket later if it could not when it was made")
+{
+    const std::string path = "/tmp/rtlog_journal_nosocket_" + std::to_string(::getpid());
+    JournalStandIn journal(path);
+    REQUIRE(journal.IsOpen());
+
+    rtlog::JournalSinkOptions options;
+    options.mSocketPath = path;
+
+    // Out of file descriptors while the sink is made
+    const int lowestFree = ::open("/dev/null", O_RDONLY);
+    REQUIRE(lowestFree >= 0);
+    ::close(lowestFree);
+    rlimit limit{};
+    REQUIRE(::getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    rlimit lowered = limit;
+    lowered.rlim_cur = static_cast<rlim_t>(lowestFree);
+    REQUIRE(::setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+    rtlog::JournalSink<ExampleLogData> sink(options);
+    REQUIRE(::setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    sink(rtlog::LogRecord<ExampleLogData>{{ExampleLogLevel::Info, ExampleLogRegion::Game}, 1, "found", 5, 7});
+    CHECK(sink.Flush());
+    CHECK(sink.NumDropped() == 0);
+    const auto datagrams = journal.Receive(1);
+    REQUIRE(datagrams.size() == 1);
+    CHECK(ParseJournalEntry(datagrams[0])["MESSAGE"] == "found");
+}
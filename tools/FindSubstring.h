@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace rtlog::tools
+{
+
+/**
+ * @brief Returns whether needle occurs in haystack.
+ *
+ * With SSE2, 16 candidate positions are tested at a time by comparing both the first and the last byte of the needle,
+ * and only positions where both match are compared in full. That rejects almost every position of typical log text
+ * in a couple of instructions per 16 bytes.
+ */
+inline bool ContainsSubstring( const char* haystack, size_t haystackSize, const char* needle, size_t needleSize )
+{
+    if ( needleSize == 0 ) {
+        return true;
+    }
+    if ( needleSize > haystackSize ) {
+        return false;
+    }
+
+    size_t position = 0;
+#if defined( __SSE2__ )
+    const auto first = _mm_set1_epi8( needle[0] );
+    const auto last  = _mm_set1_epi8( needle[needleSize - 1] );
+    for ( ; position + needleSize - 1 + 16 <= haystackSize; position += 16 ) {
+        const auto blockFirst = _mm_loadu_si128( reinterpret_cast<const __m128i*>( haystack + position ) );
+        const auto blockLast =
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( haystack + position + needleSize - 1 ) );
+        auto mask = static_cast<unsigned>(
+            _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( first, blockFirst ), _mm_cmpeq_epi8( last, blockLast ) ) ) );
+        while ( mask != 0 ) {
+            const auto offset = static_cast<size_t>( __builtin_ctz( mask ) );
+            if ( std::memcmp( haystack + position + offset + 1, needle + 1, needleSize - 1 ) == 0 ) {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for ( ; position + needleSize <= haystackSize; position++ ) {
+        if ( haystack[position] == needle[0] && std::memcmp( haystack + position, needle, needleSize ) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace rtlog::tools
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <rtlog/BinaryLogReader.h>
+#include <rtlog/TimestampFormatter.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+namespace rtlog::tools
+{
+
+/**
+ * @brief Appends one line describing record to line: sequence number, UTC time, level, region, thread and message.
+ *
+ * @param timestamps Formats the time, with nanoseconds in UTC. One per thread.
+ */
+inline void FormatRecord( const BinaryLogRecordView& record, TimestampFormatter& timestamps, std::string& line )
+{
+    char       date[TimestampFormatter::kMaxBytes];
+    const auto dateLength = timestamps.Format( record.mTimestamp, date );
+
+    char prefix[128];
+    std::snprintf( prefix,
+                   sizeof( prefix ),
+                   "%" PRIu64 " %.*s L%d R%d T%" PRIu32 " ",
+                   record.mSequenceNumber,
+                   static_cast<int>( dateLength ),
+                   date,
+                   record.mLevel,
+                   record.mRegion,
+                   record.mThreadId );
+    line += prefix;
+    line.append( record.mMessage, record.mMessageLength );
+    line += '\n';
+}
+
+} // namespace rtlog::tools
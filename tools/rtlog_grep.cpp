@@ -0,0 +1,230 @@
+// rtlog-grep: prints the records of a binary log written by rtlog::BinaryLogSink that match a substring and optional
+// level, region and thread filters, in sequence number order.
+//
+// usage: rtlog-grep [--min-level N] [--region N] [--thread N] [--token WORD]... [--jobs N] PATTERN segment.rtlog...
+//
+// --token only matches messages that have WORD as a whole word. Pass an empty PATTERN to match every message.
+//
+// Segments whose bloom filter rules out the region, thread, tokens or words within PATTERN are skipped without being
+// read. The rest are cut into chunks at arbitrary offsets, which works because every block starts with a sync marker,
+// and the chunks are decoded and filtered by a pool of threads.
+
+#include <rtlog/BinaryLogReader.h>
+
+#include "FindSubstring.h"
+#include "RecordFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct Filter
+{
+    std::string              mPattern{};
+    int                      mMinLevel{ INT_MIN };
+    bool                     mHasRegion{};
+    int                      mRegion{};
+    bool                     mHasThread{};
+    unsigned int             mThreadId{};
+    std::vector<std::string> mTokens{};
+
+    bool Matches( const rtlog::BinaryLogRecordView& record ) const
+    {
+        return record.mLevel >= mMinLevel && ( !mHasRegion || record.mRegion == mRegion )
+            && ( !mHasThread || record.mThreadId == mThreadId )
+            && rtlog::tools::ContainsSubstring(
+                   record.mMessage, record.mMessageLength, mPattern.data(), mPattern.size() )
+            && std::all_of( mTokens.begin(), mTokens.end(), [&]( const std::string& token ) {
+                   return HasToken( record, token );
+               } );
+    }
+
+    rtlog::BinaryLogQuery Query() const
+    {
+        rtlog::BinaryLogQuery query;
+        if ( mHasRegion ) {
+            query.mRegion = mRegion;
+        }
+        if ( mHasThread ) {
+            query.mThreadId = mThreadId;
+        }
+        query.mTokens = mTokens;
+        query.AddTokensWithin( mPattern );
+        return query;
+    }
+
+    static bool HasToken( const rtlog::BinaryLogRecordView& record, const std::string& token )
+    {
+        bool found = false;
+        rtlog::BinaryLogBloomFilter::ForEachToken(
+            record.mMessage, record.mMessageLength, [&]( const char* candidate, size_t length ) {
+                found = found || ( length == token.size() && std::memcmp( candidate, token.data(), length ) == 0 );
+            } );
+        return found;
+    }
+};
+
+struct Chunk
+{
+    const rtlog::BinaryLogReader* mSegment{};
+    size_t                        mBeginOffset{};
+    size_t                        mEndOffset{};
+};
+
+struct Match
+{
+    std::uint64_t mSequenceNumber{};
+    size_t        mBegin{}; // of the formatted line in its chunk's output
+    size_t        mEnd{};
+};
+
+struct ChunkOutput
+{
+    std::string        mLines{};
+    std::vector<Match> mMatches{};
+};
+
+constexpr size_t kMinChunkBytes = 1024 * 1024;
+
+void PrintUsage()
+{
+    std::fprintf( stderr,
+                  "usage: rtlog-grep [--min-level N] [--region N] [--thread N] [--token WORD]... [--jobs N] PATTERN "
+                  "segment.rtlog...\n" );
+}
+
+std::vector<Chunk> SplitIntoChunks( const std::vector<std::unique_ptr<rtlog::BinaryLogReader>>& segments,
+                                    size_t                                                      numJobs )
+{
+    size_t totalBytes = 0;
+    for ( const auto& segment : segments ) {
+        totalBytes += segment->Size();
+    }
+    // A few chunks per thread keeps threads busy when matches are unevenly spread
+    const auto chunkBytes = std::max( kMinChunkBytes, totalBytes / ( numJobs * 4 ) + 1 );
+
+    std::vector<Chunk> chunks;
+    for ( const auto& segment : segments ) {
+        for ( size_t offset = 0; offset < segment->Size(); offset += chunkBytes ) {
+            chunks.push_back( { segment.get(), offset, std::min( offset + chunkBytes, segment->Size() ) } );
+        }
+    }
+    return chunks;
+}
+
+void GrepChunks( const std::vector<Chunk>& chunks,
+                 const Filter&             filter,
+                 std::atomic<size_t>&      nextChunk,
+                 std::vector<ChunkOutput>& outputs )
+{
+    rtlog::TimestampFormatter timestamps( 9 );
+    for ( auto i = nextChunk.fetch_add( 1 ); i < chunks.size(); i = nextChunk.fetch_add( 1 ) ) {
+        auto& output = outputs[i];
+        chunks[i].mSegment->ReadRange(
+            chunks[i].mBeginOffset, chunks[i].mEndOffset, [&]( const rtlog::BinaryLogRecordView& record ) {
+                if ( filter.Matches( record ) ) {
+                    const auto begin = output.mLines.size();
+                    rtlog::tools::FormatRecord( record, timestamps, output.mLines );
+                    output.mMatches.push_back( { record.mSequenceNumber, begin, output.mLines.size() } );
+                }
+                return true;
+            } );
+    }
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Filter filter;
+    size_t numJobs    = std::max( 1u, std::thread::hardware_concurrency() );
+    bool   hasPattern = false;
+
+    std::vector<std::unique_ptr<rtlog::BinaryLogReader>> segments;
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if ( argument == "--min-level" && i + 1 < argc ) {
+            filter.mMinLevel = std::atoi( argv[++i] );
+        }
+        else if ( argument == "--region" && i + 1 < argc ) {
+            filter.mHasRegion = true;
+            filter.mRegion    = std::atoi( argv[++i] );
+        }
+        else if ( argument == "--thread" && i + 1 < argc ) {
+            filter.mHasThread = true;
+            filter.mThreadId  = static_cast<unsigned int>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( argument == "--token" && i + 1 < argc ) {
+            filter.mTokens.push_back( argv[++i] );
+        }
+        else if ( argument == "--jobs" && i + 1 < argc ) {
+            numJobs = std::max<size_t>( 1, std::strtoull( argv[++i], nullptr, 10 ) );
+        }
+        else if ( argument.rfind( "--", 0 ) == 0 ) {
+            PrintUsage();
+            return 1;
+        }
+        else if ( !hasPattern ) {
+            hasPattern      = true;
+            filter.mPattern = argument;
+        }
+        else {
+            auto reader = std::make_unique<rtlog::BinaryLogReader>( argument );
+            if ( !reader->IsOpen() ) {
+                std::fprintf( stderr, "rtlog-grep: %s is not a binary log this version can read\n", argument.c_str() );
+                return 1;
+            }
+            segments.push_back( std::move( reader ) );
+        }
+    }
+    if ( segments.empty() ) {
+        PrintUsage();
+        return 1;
+    }
+
+    const auto query = filter.Query();
+    segments.erase( std::remove_if( segments.begin(),
+                                    segments.end(),
+                                    [&]( const auto& segment ) { return !segment->MayContain( query ); } ),
+                    segments.end() );
+
+    const auto               chunks = SplitIntoChunks( segments, numJobs );
+    std::vector<ChunkOutput> outputs( chunks.size() );
+    std::atomic<size_t>      nextChunk{ 0 };
+
+    std::vector<std::thread> workers;
+    for ( size_t i = 1; i < std::min( numJobs, chunks.size() ); i++ ) {
+        workers.emplace_back( GrepChunks, std::cref( chunks ), std::cref( filter ), std::ref( nextChunk ),
+                              std::ref( outputs ) );
+    }
+    GrepChunks( chunks, filter, nextChunk, outputs );
+    for ( auto& worker : workers ) {
+        worker.join();
+    }
+
+    // Within a chunk, matches are already in sequence order; segments and chunks may interleave, so merge them all
+    std::vector<std::pair<const ChunkOutput*, const Match*>> merged;
+    for ( const auto& output : outputs ) {
+        for ( const auto& match : output.mMatches ) {
+            merged.emplace_back( &output, &match );
+        }
+    }
+    std::stable_sort( merged.begin(), merged.end(), []( const auto& a, const auto& b ) {
+        return a.second->mSequenceNumber < b.second->mSequenceNumber;
+    } );
+    for ( const auto& [output, match] : merged ) {
+        std::fwrite( output->mLines.data() + match->mBegin, 1, match->mEnd - match->mBegin, stdout );
+    }
+    return 0;
+}
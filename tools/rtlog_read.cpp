@@ -0,0 +1,142 @@
+// rtlog-read: prints the records of a binary log written by rtlog::BinaryLogSink, optionally starting at a sequence
+// number or a time, without reading the part of the log before it.
+//
+// usage: rtlog-read [--sequence N | --time T] [--count N] segment.rtlog...
+//
+// T is either seconds since the epoch, or an ISO 8601 UTC time such as 2024-03-01T10:42:07.
+
+#include <rtlog/BinaryLogReader.h>
+
+#include "RecordFormat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+enum class SeekMode
+{
+    None,
+    SequenceNumber,
+    Timestamp,
+};
+
+void PrintUsage()
+{
+    std::fprintf( stderr, "usage: rtlog-read [--sequence N | --time T] [--count N] segment.rtlog...\n" );
+}
+
+bool ParseTime( const char* text, std::int64_t& timestamp )
+{
+    char*      end     = nullptr;
+    const auto seconds = std::strtoll( text, &end, 10 );
+    if ( *end == '\0' ) {
+        timestamp = static_cast<std::int64_t>( seconds ) * 1000000000;
+        return true;
+    }
+
+    std::tm     time{};
+    const char* rest = strptime( text, "%Y-%m-%dT%H:%M:%S", &time );
+    if ( rest == nullptr ) {
+        return false;
+    }
+    std::int64_t nanoseconds = 0;
+    if ( *rest == '.' ) {
+        std::int64_t scale = 100000000;
+        for ( rest++; *rest >= '0' && *rest <= '9' && scale > 0; rest++, scale /= 10 ) {
+            nanoseconds += ( *rest - '0' ) * scale;
+        }
+    }
+    timestamp = static_cast<std::int64_t>( timegm( &time ) ) * 1000000000 + nanoseconds;
+    return true;
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+    auto          mode           = SeekMode::None;
+    std::uint64_t sequenceNumber = 0;
+    std::int64_t  timestamp      = 0;
+    std::uint64_t count          = UINT64_MAX;
+
+    std::vector<std::unique_ptr<rtlog::BinaryLogReader>> segments;
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if ( argument == "--sequence" && i + 1 < argc ) {
+            mode           = SeekMode::SequenceNumber;
+            sequenceNumber = std::strtoull( argv[++i], nullptr, 10 );
+        }
+        else if ( argument == "--time" && i + 1 < argc ) {
+            mode = SeekMode::Timestamp;
+            if ( !ParseTime( argv[++i], timestamp ) ) {
+                std::fprintf( stderr, "rtlog-read: can't parse time %s\n", argv[i] );
+                return 1;
+            }
+        }
+        else if ( argument == "--count" && i + 1 < argc ) {
+            count = std::strtoull( argv[++i], nullptr, 10 );
+        }
+        else if ( argument.rfind( "--", 0 ) == 0 ) {
+            PrintUsage();
+            return 1;
+        }
+        else {
+            auto reader = std::make_unique<rtlog::BinaryLogReader>( argument );
+            if ( !reader->IsOpen() ) {
+                std::fprintf( stderr, "rtlog-read: %s is not a binary log this version can read\n", argument.c_str() );
+                return 1;
+            }
+            segments.push_back( std::move( reader ) );
+        }
+    }
+    if ( segments.empty() ) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::sort( segments.begin(), segments.end(), []( const auto& a, const auto& b ) {
+        return a->FirstSequenceNumber() < b->FirstSequenceNumber();
+    } );
+
+    // Only the last segment starting at or before the target can contain it; later segments are read from the start
+    size_t first = 0;
+    for ( size_t i = 0; i < segments.size(); i++ ) {
+        const bool startsBefore = mode == SeekMode::SequenceNumber ? segments[i]->FirstSequenceNumber() <= sequenceNumber
+                                : mode == SeekMode::Timestamp      ? segments[i]->FirstTimestamp() <= timestamp
+                                                                   : i == 0;
+        if ( startsBefore ) {
+            first = i;
+        }
+    }
+
+    rtlog::TimestampFormatter timestamps( 9 );
+    std::string               line;
+    std::uint64_t             numPrinted = 0;
+    auto                      printFn    = [&]( const rtlog::BinaryLogRecordView& record ) {
+        line.clear();
+        rtlog::tools::FormatRecord( record, timestamps, line );
+        std::fputs( line.c_str(), stdout );
+        return ++numPrinted < count;
+    };
+
+    for ( size_t i = first; i < segments.size() && numPrinted < count; i++ ) {
+        if ( i == first && mode == SeekMode::SequenceNumber ) {
+            segments[i]->ReadFromSequenceNumber( sequenceNumber, printFn );
+        }
+        else if ( i == first && mode == SeekMode::Timestamp ) {
+            segments[i]->ReadFromTimestamp( timestamp, printFn );
+        }
+        else {
+            segments[i]->ReadAll( printFn );
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+// rtlog-tail: prints the newest records waiting in the shared log ring of a running process (see
+// rtlog::SharedLogger), without taking them from rtlogd or whichever collector drains the ring.
+//
+// usage: rtlog-tail [--dir DIR] [-n N] [-f] [--interval-ms N] RING
+//
+// RING is the path of a ring file, or the name or process id of a SharedLogger with a ring in DIR (/dev/shm by
+// default). -n prints the newest N records (10 by default). -f keeps printing new records as they come in, every
+// --interval-ms milliseconds (100 by default), until the logger closes its ring; records the collector drains between
+// two looks are missed.
+
+#include <rtlog/SharedLogTail.h>
+
+#include "RecordFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <dirent.h>
+
+namespace
+{
+
+using Tail = rtlog::SharedLogTail<>;
+
+std::atomic<bool> gRunning{ true };
+
+void Stop( int )
+{
+    gRunning = false;
+}
+
+void PrintUsage()
+{
+    std::fprintf( stderr, "usage: rtlog-tail [--dir DIR] [-n N] [-f] [--interval-ms N] RING\n" );
+}
+
+// Ring files are named "<name>.<process id>.rtring"; returns those in directory that match name or process id
+std::vector<std::string> FindRings( const std::string& directory, const std::string& nameOrProcessId )
+{
+    std::vector<std::string> paths;
+    DIR*                     dir = ::opendir( directory.c_str() );
+    if ( dir == nullptr ) {
+        return paths;
+    }
+    constexpr size_t kExtensionLength = sizeof( rtlog::kSharedLogRingExtension ) - 1;
+    while ( const dirent* entry = ::readdir( dir ) ) {
+        const std::string fileName   = entry->d_name;
+        const auto        stemLength = fileName.size() - kExtensionLength;
+        if ( fileName.size() <= kExtensionLength
+             || fileName.compare( stemLength, kExtensionLength, rtlog::kSharedLogRingExtension ) != 0 ) {
+            continue;
+        }
+        const auto stem = fileName.substr( 0, stemLength );
+        const auto dot  = stem.rfind( '.' );
+        if ( dot != std::string::npos
+             && ( stem.compare( 0, dot, nameOrProcessId ) == 0 || stem.substr( dot + 1 ) == nameOrProcessId ) ) {
+            paths.push_back( directory + "/" + fileName );
+        }
+    }
+    ::closedir( dir );
+    return paths;
+}
+
+} // namespace
+
+int main( int argc, char** argv )
+{
+    std::string directory = "/dev/shm";
+    std::string ring;
+    size_t      count    = 10;
+    bool        follow   = false;
+    auto        interval = std::chrono::milliseconds( 100 );
+
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string argument = argv[i];
+        if ( argument == "--dir" && i + 1 < argc ) {
+            directory = argv[++i];
+        }
+        else if ( argument == "-n" && i + 1 < argc ) {
+            count = std::strtoull( argv[++i], nullptr, 10 );
+        }
+        else if ( argument == "-f" ) {
+            follow = true;
+        }
+        else if ( argument == "--interval-ms" && i + 1 < argc ) {
+            interval = std::chrono::milliseconds( std::strtoll( argv[++i], nullptr, 10 ) );
+        }
+        else if ( argument.rfind( "-", 0 ) == 0 || !ring.empty() ) {
+            PrintUsage();
+            return 1;
+        }
+        else {
+            ring = argument;
+        }
+    }
+    if ( ring.empty() ) {
+        PrintUsage();
+        return 1;
+    }
+
+    auto path = ring;
+    if ( ring.find( '/' ) == std::string::npos ) {
+        const auto paths = FindRings( directory, ring );
+        if ( paths.size() != 1 ) {
+            const auto* format =
+                paths.empty() ? "rtlog-tail: no ring of %s in %s\n" : "rtlog-tail: %s has several rings in %s:\n";
+            std::fprintf( stderr, format, ring.c_str(), directory.c_str() );
+            for ( const auto& candidate : paths ) {
+                std::fprintf( stderr, "  %s\n", candidate.c_str() );
+            }
+            return 1;
+        }
+        path = paths[0];
+    }
+
+    Tail tail( path );
+    if ( !tail.IsOpen() ) {
+        std::fprintf( stderr, "rtlog-tail: %s is not a shared log ring of the default size\n", path.c_str() );
+        return 1;
+    }
+
+    std::signal( SIGINT, Stop );
+    std::signal( SIGTERM, Stop );
+
+    // Several threads log into a ring, so it isn't in sequence number order, and new records can't be told by a number
+    // above the last one printed. Instead each look remembers the records it saw, and the next prints the others; what
+    // is gone from the ring by then can't come back
+    rtlog::TimestampFormatter         timestamps( 9 );
+    std::string                       line;
+    std::unordered_set<std::uint64_t> known;
+    std::unordered_set<std::uint64_t> seen;
+    auto                              printFn = [&]( const rtlog::LogRecord<rtlog::SharedLogData>& record ) {
+        if ( !seen.insert( record.mSequenceNumber ).second || known.count( record.mSequenceNumber ) != 0 ) {
+            return;
+        }
+
+        rtlog::BinaryLogRecordView view;
+        view.mSequenceNumber = record.mSequenceNumber;
+        view.mTimestamp      = record.mLogData.timestamp;
+        view.mLevel          = record.mLogData.level;
+        view.mRegion         = record.mLogData.region;
+        view.mThreadId       = record.mThreadId;
+        view.mMessage        = record.mMessage;
+        view.mMessageLength  = record.mMessageLength;
+        rtlog::tools::FormatRecord( view, timestamps, line );
+    };
+
+    // Every record the ring can hold, so a look misses nothing that is still in it
+    constexpr size_t kMaxRecordsInRing =
+        rtlog::kDefaultSharedLogRingBytes / ( 8 + sizeof( rtlog::SharedLogRecordHeader ) );
+    const auto look = [&] {
+        line.clear();
+        seen.clear();
+        tail.Snapshot( printFn, kMaxRecordsInRing );
+        known.swap( seen );
+        std::fputs( line.c_str(), stdout );
+        std::fflush( stdout );
+    };
+
+    // All but the newest count records count as printed already
+    std::vector<std::uint64_t> skipped;
+    auto                       skipFn = [&]( const rtlog::LogRecord<rtlog::SharedLogData>& record ) {
+        skipped.push_back( record.mSequenceNumber );
+    };
+    tail.Snapshot( skipFn, kMaxRecordsInRing );
+    known.insert( skipped.begin(), skipped.end() - static_cast<std::ptrdiff_t>( std::min( count, skipped.size() ) ) );
+
+    std::printf( "%s[%u]\n", tail.ProcessName(), tail.ProcessId() );
+    look();
+
+    while ( follow && gRunning ) {
+        const bool closed = tail.IsClosed();
+        look();
+        if ( closed ) {
+            break;
+        }
+        std::this_thread::sleep_for( interval );
+    }
+    return 0;
+}